@@ -0,0 +1,857 @@
+#include "archive_session.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <memory>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+
+#include "archiver_log.h"
+#include "blob_cache.h"
+#include "buffer_source.h"
+#include "dedupe.h"
+#include "dir_walker.h"
+#include "extractor.h"
+#include "fd_source.h"
+
+namespace {
+
+// Файлы от этого размера не читаются в память, libzip читает их сам при zip_close
+constexpr uint64_t STREAMING_THRESHOLD = 1024 * 1024;
+
+// Сессии, у которых сейчас идет createZip
+std::mutex active_mutex;
+std::vector<ArchiveSession*> active_sessions;
+
+} // namespace
+
+unsigned ArchiveSession::core_share() {
+    std::lock_guard<std::mutex> lock(active_mutex);
+    size_t active = std::max<size_t>(1, active_sessions.size());
+    return std::max(1u, static_cast<unsigned>(ThreadPool::instance().size() / active));
+}
+
+void ArchiveSession::join_active(ArchiveSession* session) {
+    {
+        std::lock_guard<std::mutex> lock(active_mutex);
+        active_sessions.push_back(session);
+    }
+    rebalance();
+}
+
+void ArchiveSession::leave_active(ArchiveSession* session) {
+    {
+        std::lock_guard<std::mutex> lock(active_mutex);
+        active_sessions.erase(std::remove(active_sessions.begin(), active_sessions.end(), session), active_sessions.end());
+    }
+    rebalance();
+}
+
+void ArchiveSession::rebalance() {
+    std::lock_guard<std::mutex> lock(active_mutex);
+    if (active_sessions.empty()) {
+        return;
+    }
+    auto share = std::max(1u, static_cast<unsigned>(ThreadPool::instance().size() / active_sessions.size()));
+    for (auto* session : active_sessions) {
+        if (session->current_group) {
+            ThreadPool::instance().set_limit(*session->current_group, share);
+        }
+    }
+}
+
+SessionStats ArchiveSession::stats() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return current_stats;
+}
+
+void ArchiveSession::reset_stats() {
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        current_stats = SessionStats{};
+    }
+    current_job.reset();
+}
+
+// Вызывается из zip_close после записи каждой записи архива
+void ArchiveSession::entry_written(zip_t*, zip_uint64_t index, const zip_stat_t* st, void* userdata) {
+    auto* session = static_cast<ArchiveSession*>(userdata);
+    auto now = JobStats::Clock::now();
+    EntryStats entry;
+    entry.index = index;
+    entry.size = st->size;
+    entry.comp_size = st->comp_size;
+    entry.method = st->comp_method;
+    entry.nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - session->last_entry_written).count());
+    session->last_entry_written = now;
+    session->current_job.add_entry(entry);
+}
+
+void ArchiveSession::note_extracted(const ExtractEntry& file, uint64_t nanos) {
+    current_job.stage(Stage::Extract).add(nanos, file.size);
+    EntryStats entry;
+    entry.index = file.index;
+    entry.size = file.size;
+    entry.comp_size = file.comp_size;
+    entry.method = file.method;
+    entry.nanos = nanos;
+    current_job.add_entry(entry);
+}
+
+void ArchiveSession::count(uint64_t SessionStats::*field, uint64_t amount) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    current_stats.*field += amount;
+}
+
+void ArchiveSession::process_file(const InputFile& input, MemoryBudget& budget, bool compress) {
+    if (cancelled) {
+        if (input.fd >= 0) {
+            close(input.fd);
+        }
+        return;
+    }
+    LOGD("Processing file: %s", input.name.c_str());
+
+    FileData file_data;
+    file_data.name = input.name;
+    file_data.mtime = input.mtime;
+
+    // Файлы, сжатые в прошлых заданиях, берутся из кэша готовыми; новые
+    // сжимаются в кэш здесь же, а с compress - в память. Большие файлы и
+    // файлы, не влезающие в бюджет, отдаем libzip потоком.
+    if (take_from_cache(input, file_data) ||
+        (compress && input.size < STREAMING_THRESHOLD && compress_in_memory(input, file_data.blob, budget, Stage::Compress))) {
+        file_data.cached = true;
+        if (input.fd >= 0) {
+            close(input.fd);
+        }
+    } else if (input.size >= STREAMING_THRESHOLD || !budget.try_reserve(input.size)) {
+        file_data.path = input.path;
+        file_data.fd = input.fd;
+        file_data.streamed = true;
+    } else {
+        bool ok = read_input(input, file_data, budget);
+        if (input.fd >= 0 && !file_data.streamed) {
+            close(input.fd);
+        }
+        if (!ok) {
+            count(&SessionStats::files_failed);
+            return;
+        }
+    }
+
+    enqueue(std::move(file_data));
+
+    LOGD("Finished processing: %s", input.name.c_str());
+}
+
+void ArchiveSession::process_group(const std::vector<InputFile>& inputs, const std::vector<size_t>& members, MemoryBudget& budget) {
+    const InputFile& input = inputs[members.front()];
+    FileData shared;
+    bool ok = !cancelled && (take_from_cache(input, shared) || compress_in_memory(input, shared.blob, budget, Stage::Dedupe));
+    if (!ok) {
+        // без общей сжатой копии каждый файл обрабатывается как обычно
+        for (size_t i : members) {
+            process_file(inputs[i], budget);
+        }
+        return;
+    }
+    LOGD("Compressed once for %zu files: %s", members.size(), input.name.c_str());
+
+    for (size_t k = 0; k < members.size(); k++) {
+        const InputFile& member = inputs[members[k]];
+        if (member.fd >= 0) {
+            close(member.fd);
+        }
+        FileData file_data;
+        file_data.name = member.name;
+        file_data.mtime = member.mtime;
+        file_data.cached = true;
+        file_data.deduplicated = k > 0;
+        file_data.blob = shared.blob;
+        // блоб из кэша закрепляется за каждым источником отдельно
+        if (k > 0 && !file_data.blob.data) {
+            BlobCache::instance().retain(file_data.blob);
+        }
+        enqueue(std::move(file_data));
+    }
+}
+
+void ArchiveSession::enqueue(FileData&& file_data) {
+    file_data.queued_at = JobStats::Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        file_queue.push(std::move(file_data));
+        current_job.note_queue_depth(file_queue.size());
+    }
+    queue_cv.notify_one();
+}
+
+bool ArchiveSession::take_from_cache(const InputFile& input, FileData& file_data) {
+    BlobCache& cache = BlobCache::instance();
+    if (input.size == UINT64_MAX || !cache.wants(input.size)) {
+        return false;
+    }
+    int fd = input.fd >= 0 ? input.fd : open(input.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    StageTimer cache_timer(current_job, Stage::Cache, input.size);
+    BlobKey key;
+    bool found = false;
+    if (BlobCache::key_for_fd(fd, key) && key.size == input.size) {
+        if (cache.lookup(key, file_data.blob)) {
+            count(&SessionStats::files_cached);
+            found = true;
+        } else {
+            found = cache.store(key, fd, file_data.blob, cancelled, &current_job.stage(Stage::Read));
+        }
+    }
+    if (fd != input.fd) {
+        close(fd);
+    }
+    file_data.cached = found;
+    return found;
+}
+
+// Сжатые данные держатся в памяти до zip_close и учитываются в бюджете;
+// на время сжатия резервируется полный размер файла
+bool ArchiveSession::compress_in_memory(const InputFile& input, Blob& blob, MemoryBudget& budget, Stage stage) {
+    if (input.size == UINT64_MAX || !budget.try_reserve(input.size)) {
+        return false;
+    }
+    int fd = input.fd >= 0 ? input.fd : open(input.path.c_str(), O_RDONLY | O_CLOEXEC);
+    bool ok = false;
+    if (fd >= 0) {
+        StageTimer compress_timer(current_job, stage, input.size);
+        ok = compress_to_memory(fd, input.size, blob, cancelled, &current_job.stage(Stage::Read));
+        if (fd != input.fd) {
+            close(fd);
+        }
+    }
+    uint64_t kept = ok ? std::min<uint64_t>(input.size, blob.data->size()) : 0;
+    budget.release(input.size - kept);
+    return ok;
+}
+
+bool ArchiveSession::read_input(const InputFile& input, FileData& file_data, MemoryBudget& budget) {
+    StageCounters& reads = current_job.stage(Stage::Read);
+
+    if (input.fd >= 0) {
+        // дескриптор читаем через pread, размер известен из fstat
+        file_data.content = BufferPool::instance().acquire(input.size);
+        if (!fd_read_fully(input.fd, file_data.content.data(), input.size, &reads)) {
+            LOGE("Failed to read file: %s", input.name.c_str());
+            BufferPool::instance().recycle(std::move(file_data.content));
+            budget.release(input.size);
+            return false;
+        }
+        count(&SessionStats::bytes_buffered, input.size);
+        return true;
+    }
+
+    // Файл по пути читается так же через pread, чтобы считать системные вызовы
+    int fd = open(input.path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        LOGE("Failed to open file: %s", input.path.c_str());
+        if (fd >= 0) {
+            close(fd);
+        }
+        budget.release(input.size);
+        return false;
+    }
+
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (size != input.size) {
+        // файл изменился после stat, держим бюджет в соответствии с реальным размером
+        budget.release(input.size);
+        if (!budget.try_reserve(size)) {
+            close(fd);
+            file_data.path = input.path;
+            file_data.streamed = true;
+            return true;
+        }
+    }
+
+    // буфер из пула; после записи архива libzip вернет его обратно
+    file_data.content = BufferPool::instance().acquire(size);
+
+    bool ok = fd_read_fully(fd, file_data.content.data(), size, &reads);
+    close(fd);
+    if (!ok) {
+        LOGE("Failed to read file: %s", input.path.c_str());
+        BufferPool::instance().recycle(std::move(file_data.content));
+        budget.release(size);
+        return false;
+    }
+    count(&SessionStats::bytes_buffered, size);
+    return true;
+}
+
+void ArchiveSession::writer_loop(zip_t* zip, zip_flags_t add_flags) {
+    while (true) {
+        FileData file_data;
+
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cv.wait(lock, [this] {
+                return !file_queue.empty() || all_files_processed;
+            });
+
+            if (file_queue.empty()) {
+                break;
+            }
+
+            file_data = std::move(file_queue.front());
+            file_queue.pop();
+        }
+
+        if (file_data.directory) {
+            zip_int64_t index = zip_dir_add(zip, file_data.name.c_str(), ZIP_FL_ENC_UTF_8 | add_flags);
+            if (index < 0 || zip_file_set_mtime(zip, static_cast<zip_uint64_t>(index), file_data.mtime, 0) < 0) {
+                LOGE("Failed to add directory %s to archive: %s", file_data.name.c_str(), zip_strerror(zip));
+                count(&SessionStats::files_failed);
+            }
+            continue;
+        }
+
+        size_t size = file_data.content.size();
+        current_job.stage(Stage::QueueWait).add(JobStats::nanos_since(file_data.queued_at), size);
+        StageTimer add_timer(current_job, Stage::Add, size);
+
+        zip_source_t* source;
+
+        if (file_data.cached) {
+            // блоб закреплен в кэше, пока источник не освобожден
+            source = blob_source_create(zip, file_data.blob, file_data.mtime, &current_job.stage(Stage::StreamRead));
+        } else if (file_data.streamed && file_data.fd >= 0) {
+            // дескриптор переходит во владение источника
+            source = fd_source_create(zip, file_data.fd, &current_job.stage(Stage::StreamRead));
+            if (!source) {
+                close(file_data.fd);
+            }
+        } else if (file_data.streamed) {
+            // libzip сам прочитает файл во время zip_close. Не zip_source_mmap:
+            // пользовательский файл может укоротиться за время долгого
+            // zip_close, и чтение отображения за новым концом файла - SIGBUS,
+            // а read() просто вернет ошибку длины данных
+            source = zip_source_file(zip, file_data.path.c_str(), 0, ZIP_LENGTH_TO_END);
+        } else {
+            // Передаем буфер источнику без копирования
+            source = buffer_source_create(zip, std::move(file_data.content), file_data.mtime, &BufferPool::instance());
+        }
+
+        if (!source) {
+            LOGE("Failed to create source for %s", file_data.name.c_str());
+            BufferPool::instance().recycle(std::move(file_data.content));
+            count(&SessionStats::files_failed);
+            continue;
+        }
+
+        zip_int64_t index = zip_file_add(zip, file_data.name.c_str(), source, ZIP_FL_ENC_UTF_8 | add_flags);
+        if (index < 0) {
+            LOGE("Failed to add %s to archive: %s", file_data.name.c_str(), zip_strerror(zip));
+            zip_source_free(source);
+            count(&SessionStats::files_failed);
+        } else if (file_data.cached) {
+            // Несжимаемые данные хранятся в блобе без сжатия: запись так
+            // и остается, без новых проб и попытки сжатия
+            if (file_data.blob.method == ZIP_CM_STORE) {
+                zip_set_file_compression(zip, static_cast<zip_uint64_t>(index), ZIP_CM_STORE, 0);
+            }
+            if (file_data.deduplicated) {
+                LOGI("Added to archive: %s (duplicate, compressed once)", file_data.name.c_str());
+                count(&SessionStats::files_deduplicated);
+            } else if (file_data.blob.data) {
+                LOGI("Added to archive: %s (compressed in memory)", file_data.name.c_str());
+            } else {
+                LOGI("Added to archive: %s (compressed, from cache)", file_data.name.c_str());
+            }
+            count(&SessionStats::files_added);
+        } else if (file_data.streamed) {
+            LOGI("Added to archive: %s (streamed)", file_data.name.c_str());
+            count(&SessionStats::files_added);
+            count(&SessionStats::files_streamed);
+        } else {
+            LOGI("Added to archive: %s (size: %zu bytes)", file_data.name.c_str(), size);
+            count(&SessionStats::files_added);
+        }
+    }
+}
+
+bool ArchiveSession::create_zip(const std::vector<InputFile>& inputs, const std::string& output_path, Progress& progress) {
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+
+    cancelled = false;
+    reset_stats();
+
+    LOGI("Creating zip archive at: %s", output_path.c_str());
+
+    // Создаем архив
+    int err = 0;
+    zip_t* zip = zip_open(output_path.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &err);
+    if (!zip) {
+        LOGE("Failed to create zip archive: error %d", err);
+        close_inputs(inputs);
+        return false;
+    }
+
+    return write_archive(zip, inputs, progress);
+}
+
+bool ArchiveSession::create_zip(const std::vector<InputFile>& inputs, int output_fd, Progress& progress) {
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+
+    cancelled = false;
+    reset_stats();
+
+    LOGI("Creating zip archive in descriptor %d", output_fd);
+
+    // Архив пишется прямо в fd, без временного файла
+    zip_error_t error;
+    zip_error_init(&error);
+    zip_t* zip = nullptr;
+    zip_source_t* output = fd_output_source_create(output_fd, &error, &current_job.stage(Stage::Write));
+    if (output) {
+        zip = zip_open_from_source(output, ZIP_TRUNCATE, &error);
+        if (!zip) {
+            zip_source_free(output); // закрывает output_fd
+        }
+    } else {
+        close(output_fd);
+    }
+    if (!zip) {
+        LOGE("Failed to create zip archive: %s", zip_error_strerror(&error));
+        zip_error_fini(&error);
+        close_inputs(inputs);
+        return false;
+    }
+    zip_error_fini(&error);
+
+    return write_archive(zip, inputs, progress);
+}
+
+bool ArchiveSession::create_zip_from_directory(const std::string& root, const std::string& output_path, Progress& progress) {
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+
+    cancelled = false;
+    reset_stats();
+
+    LOGI("Creating zip archive at %s from directory %s", output_path.c_str(), root.c_str());
+
+    struct stat st;
+    if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        LOGE("Not a directory: %s", root.c_str());
+        return false;
+    }
+
+    int err = 0;
+    zip_t* zip = zip_open(output_path.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &err);
+    if (!zip) {
+        LOGE("Failed to create zip archive: error %d", err);
+        return false;
+    }
+
+    // Обход и чтение файлов идут в одной группе: файлы каталога ставятся
+    // в пул сразу после его чтения, writer добавляет их в архив, пока
+    // остальные каталоги еще читаются. Файлы меньше STREAMING_THRESHOLD
+    // сжимаются в память прямо в задачах пула, иначе сжатие началось бы
+    // только в zip_close, после конца обхода; zip_close копирует их как есть. Каталоги идут в очередь writer
+    // напрямую, zip_dir_add вызывается только из него.
+    std::unique_ptr<DirWalker> walker;
+    bool ok = run_archive(zip, [&](TaskGroup& group, MemoryBudget& budget) {
+        auto on_directory = [this](const std::string& name, time_t mtime) {
+            FileData file_data;
+            file_data.name = name;
+            file_data.mtime = mtime;
+            file_data.directory = true;
+            enqueue(std::move(file_data));
+        };
+        auto on_files = [this, &group, &budget](std::vector<InputFile>&& files) {
+            std::vector<Task> tasks;
+            tasks.reserve(files.size());
+            for (auto& input : files) {
+                note_scheduled(input);
+                uint64_t weight = input.size;
+                tasks.push_back(Task{[this, input = std::move(input), &budget] { process_file(input, budget, true); }, weight});
+            }
+            ThreadPool::instance().submit(std::move(tasks), group);
+        };
+        walker = std::make_unique<DirWalker>(on_directory, on_files, cancelled, current_job.stage(Stage::Walk));
+        if (!walker->start(root, group)) {
+            count(&SessionStats::files_failed);
+        }
+    }, progress, 0);
+
+    if (walker && walker->failed() > 0) {
+        LOGE("Failed to read %llu directories under %s", static_cast<unsigned long long>(walker->failed()), root.c_str());
+        count(&SessionStats::files_failed, walker->failed());
+    }
+    return ok;
+}
+
+bool ArchiveSession::update_zip(const std::vector<InputFile>& inputs, const std::string& archive_path, const UpdateOptions& options, Progress& progress) {
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+
+    cancelled = false;
+    reset_stats();
+
+    LOGI("Updating zip archive at: %s", archive_path.c_str());
+
+    // Без ZIP_TRUNCATE: записи, которые не будут заменены, zip_close
+    // переносит в новый файл сжатыми, как есть
+    int err = 0;
+    zip_t* zip = zip_open(archive_path.c_str(), ZIP_CREATE, &err);
+    if (!zip) {
+        LOGE("Failed to open zip archive: error %d", err);
+        close_inputs(inputs);
+        return false;
+    }
+
+    std::vector<InputFile> changed;
+    std::vector<char> unchanged(inputs.size(), 0);
+    {
+        StageTimer plan_timer(current_job, Stage::Plan, 0, inputs.size());
+
+        // Поиск в архиве - в этом потоке: zip_name_locate и zip_stat_index
+        // пишут ошибку и кэш имен в zip_t. На общем пуле только чтение
+        // файлов для сравнения CRC.
+        TaskGroup group;
+        ThreadPool::instance().set_limit(group, core_share());
+        std::vector<Task> tasks;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            uint32_t stored_crc = 0;
+            if (!stored_matches(zip, inputs[i], stored_crc)) {
+                continue;
+            }
+            if (!options.check_crc) {
+                unchanged[i] = 1;
+                continue;
+            }
+            tasks.push_back(Task{[this, &inputs, &unchanged, i, stored_crc] {
+                if (!cancelled) {
+                    unchanged[i] = content_matches(inputs[i], stored_crc);
+                }
+            }, inputs[i].size});
+        }
+        ThreadPool::instance().submit(std::move(tasks), group);
+        group.wait();
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            if (unchanged[i]) {
+                if (inputs[i].fd >= 0) {
+                    close(inputs[i].fd);
+                }
+                count(&SessionStats::files_unchanged);
+            } else {
+                changed.push_back(inputs[i]);
+            }
+        }
+
+        if (options.remove_missing) {
+            std::unordered_set<std::string> names;
+            for (const auto& input : inputs) {
+                names.insert(input.name);
+            }
+            zip_int64_t entries = zip_get_num_entries(zip, 0);
+            for (zip_int64_t i = 0; i < entries; i++) {
+                const char* name = zip_get_name(zip, static_cast<zip_uint64_t>(i), 0);
+                if (name && names.find(name) == names.end() && zip_delete(zip, static_cast<zip_uint64_t>(i)) == 0) {
+                    count(&SessionStats::files_removed);
+                }
+            }
+        }
+    }
+
+    SessionStats planned = stats();
+    LOGI("Update: %zu files changed or new, %llu unchanged, %llu removed", changed.size(),
+         static_cast<unsigned long long>(planned.files_unchanged), static_cast<unsigned long long>(planned.files_removed));
+
+    // Одноименная запись заменяется новой, остальные не трогаются
+    return write_archive(zip, changed, progress, ZIP_FL_OVERWRITE);
+}
+
+bool ArchiveSession::stored_matches(zip_t* zip, const InputFile& input, uint32_t& stored_crc) {
+    if (input.size == UINT64_MAX) {
+        return false;
+    }
+    zip_int64_t index = zip_name_locate(zip, input.name.c_str(), 0);
+    zip_stat_t st;
+    if (index < 0 || zip_stat_index(zip, static_cast<zip_uint64_t>(index), 0, &st) < 0) {
+        return false;
+    }
+    // В архиве mtime хранится в DOS-формате с шагом 2 секунды и округляется вниз
+    constexpr zip_uint64_t required = ZIP_STAT_SIZE | ZIP_STAT_MTIME | ZIP_STAT_CRC;
+    if ((st.valid & required) != required || st.size != input.size || input.mtime < st.mtime || input.mtime - st.mtime >= 2) {
+        return false;
+    }
+    stored_crc = st.crc;
+    return true;
+}
+
+bool ArchiveSession::content_matches(const InputFile& input, uint32_t stored_crc) {
+    int fd = input.fd;
+    if (fd < 0) {
+        fd = open(input.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+    }
+    uint32_t crc = 0;
+    bool ok = fd_crc32(fd, input.size, crc, &current_job.stage(Stage::Read));
+    if (fd != input.fd) {
+        close(fd);
+    }
+    return ok && crc == stored_crc;
+}
+
+void ArchiveSession::close_inputs(const std::vector<InputFile>& inputs) {
+    for (const auto& input : inputs) {
+        if (input.fd >= 0) {
+            close(input.fd);
+        }
+    }
+}
+
+void ArchiveSession::note_scheduled(const InputFile& input) {
+    scheduled_files++;
+    if (input.size != UINT64_MAX) {
+        scheduled_bytes += input.size;
+    }
+}
+
+bool ArchiveSession::write_archive(zip_t* zip, const std::vector<InputFile>& inputs, Progress& progress, zip_flags_t add_flags) {
+    LOGI("Processing %zu files", inputs.size());
+
+    return run_archive(zip, [this, &inputs](TaskGroup& group, MemoryBudget& budget) {
+        // Одинаковые файлы (жесткие ссылки, копии) сжимаются один раз:
+        // одна задача на группу, первым в группе идет основной файл
+        std::vector<std::vector<size_t>> groups;
+        {
+            StageTimer plan_timer(current_job, Stage::Plan, 0, inputs.size());
+            std::vector<size_t> primary = find_duplicates(inputs, core_share(), current_job.stage(Stage::Read));
+            std::vector<size_t> group_of(inputs.size());
+            for (size_t i = 0; i < inputs.size(); i++) {
+                note_scheduled(inputs[i]);
+                if (primary[i] == i) {
+                    group_of[i] = groups.size();
+                    groups.push_back({i});
+                } else {
+                    groups[group_of[primary[i]]].push_back(i);
+                }
+            }
+        }
+
+        // Задачи для общего пула потоков; вес задачи - размер файла,
+        // чтобы крупные файлы начинали читаться первыми. groups не
+        // переживает этот вызов, поэтому группа копируется в задачу.
+        std::vector<Task> tasks;
+        tasks.reserve(groups.size());
+        for (auto& members : groups) {
+            const InputFile& input = inputs[members.front()];
+            if (members.size() == 1) {
+                tasks.push_back(Task{[this, &input, &budget] { process_file(input, budget); }, input.size});
+            } else {
+                tasks.push_back(Task{[this, &inputs, members = std::move(members), &budget] { process_group(inputs, members, budget); }, input.size});
+            }
+        }
+        ThreadPool::instance().submit(std::move(tasks), group);
+    }, progress, add_flags);
+}
+
+bool ArchiveSession::run_archive(zip_t* zip, const Scheduler& schedule, Progress& progress, zip_flags_t add_flags) {
+    all_files_processed = false;
+    scheduled_files = 0;
+    scheduled_bytes = 0;
+
+    StageTimer job_timer(current_job, Stage::Job);
+
+    TaskGroup group;
+    current_group = &group;
+    join_active(this);
+
+    // Запускаем writer thread
+    MemoryBudget budget(memory_budget_bytes.load());
+    std::thread writer(&ArchiveSession::writer_loop, this, zip, add_flags);
+
+    // Ждем, пока пул обработает все файлы
+    schedule(group, budget);
+    group.wait();
+    job_timer.set_bytes(scheduled_bytes.load());
+    job_timer.set_calls(scheduled_files.load());
+
+    // Сообщаем writer thread, что все файлы обработаны
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        all_files_processed = true;
+    }
+    queue_cv.notify_one();
+    writer.join();
+
+    {
+        std::lock_guard<std::mutex> lock(active_mutex);
+        current_group = nullptr;
+    }
+
+    if (cancelled) {
+        LOGI("Zip archive creation cancelled");
+        zip_discard(zip);
+        leave_active(this);
+        return false;
+    }
+
+    // Сжатие идет в zip_close на потоках libzip: сессия получает свою долю
+    // ядер. Прочитанные в память файлы и сжатые копии дубликатов держат
+    // свою часть бюджета до конца zip_close, поэтому сжатым, но еще не
+    // записанным данным остается только незанятый остаток (0 для libzip -
+    // предел по умолчанию, поэтому не меньше 1: тогда параллельно не
+    // сжимается ничего)
+    uint64_t close_memory = std::max<uint64_t>(1, budget.capacity() - budget.in_use());
+    zip_set_archive_flag(zip, ZIP_AFL_PARALLEL_CLOSE, 1);
+    // JPEG, MP4, APK и прочее уже сжатое сохраняется без сжатия по пробам данных,
+    // а не после полного deflate
+    zip_set_archive_flag(zip, ZIP_AFL_ADAPTIVE_COMPRESSION, 1);
+    zip_set_parallel_close_limits(zip, core_share(), close_memory);
+    progress.attach(zip);
+    zip_register_entry_written_callback_with_state(zip, &ArchiveSession::entry_written, nullptr, this);
+
+    bool ok;
+    {
+        StageTimer close_timer(current_job, Stage::Close, scheduled_bytes.load());
+        last_entry_written = JobStats::Clock::now();
+        ok = zip_close(zip) == 0;
+    }
+    if (!ok) {
+        LOGE("Failed to write zip archive: %s", zip_strerror(zip));
+        zip_discard(zip);
+    } else {
+        LOGI("Zip archive created successfully with %llu files", static_cast<unsigned long long>(scheduled_files.load()));
+    }
+    leave_active(this);
+
+    return ok;
+}
+
+bool ArchiveSession::extract_zip(int archive_fd, const std::string& output_dir, Progress& progress) {
+    std::lock_guard<std::mutex> job_lock(job_mutex);
+
+    cancelled = false;
+    reset_stats();
+
+    LOGI("Extracting zip archive from descriptor %d to %s", archive_fd, output_dir.c_str());
+
+    StageTimer job_timer(current_job, Stage::Job, 0, 0);
+
+    // Центральный каталог читает libzip один раз, а данные записей потоки
+    // читают через pread по своей копии дескриптора
+    int data_fd = dup(archive_fd);
+    if (data_fd < 0) {
+        LOGE("Failed to duplicate archive descriptor");
+        close(archive_fd);
+        return false;
+    }
+    int err = 0;
+    zip_t* zip = zip_fdopen(archive_fd, ZIP_RDONLY, &err);
+    if (!zip) {
+        LOGE("Failed to open zip archive: error %d", err);
+        close(archive_fd);
+        close(data_fd);
+        return false;
+    }
+
+    std::vector<ExtractEntry> files;
+    bool planned;
+    {
+        StageTimer plan_timer(current_job, Stage::Plan);
+        planned = plan_extraction(zip, output_dir, files);
+    }
+    if (!planned) {
+        zip_discard(zip);
+        close(data_fd);
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (const auto& file : files) {
+        total += file.size;
+    }
+    job_timer.set_bytes(total);
+    job_timer.set_calls(files.size());
+    std::atomic<uint64_t> bytes_done{0};
+    auto report = [&] {
+        progress.report(total > 0 ? static_cast<double>(bytes_done.load()) / static_cast<double>(total) : 1.0);
+    };
+
+    TaskGroup group;
+    current_group = &group;
+    join_active(this);
+
+    // Вес задачи - размер файла: большие записи начинаются первыми
+    std::vector<Task> tasks;
+    for (const auto& file : files) {
+        if (!file.parallel) {
+            continue;
+        }
+        tasks.push_back(Task{[this, &file, data_fd, &bytes_done] {
+            if (cancelled) {
+                return;
+            }
+            auto start = JobStats::Clock::now();
+            if (extract_entry(data_fd, file, cancelled, bytes_done, current_job)) {
+                note_extracted(file, JobStats::nanos_since(start));
+                count(&SessionStats::files_added);
+            } else if (!cancelled) {
+                count(&SessionStats::files_failed);
+            }
+        }, file.size});
+    }
+    ThreadPool::instance().submit(std::move(tasks), group);
+
+    // Прогресс отправляется отсюда: JNIEnv принадлежит этому потоку
+    while (!group.wait_for(Progress::POLL_INTERVAL)) {
+        report();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(active_mutex);
+        current_group = nullptr;
+    }
+    leave_active(this);
+
+    // Шифрованные записи и прочие методы сжатия - через libzip в этом потоке
+    for (const auto& file : files) {
+        if (file.parallel || cancelled) {
+            continue;
+        }
+        auto start = JobStats::Clock::now();
+        if (extract_entry_with_libzip(zip, file, cancelled, bytes_done, current_job)) {
+            note_extracted(file, JobStats::nanos_since(start));
+            count(&SessionStats::files_added);
+            count(&SessionStats::files_streamed);
+        } else if (!cancelled) {
+            count(&SessionStats::files_failed);
+        }
+        report();
+    }
+
+    zip_discard(zip);
+    close(data_fd);
+
+    if (cancelled) {
+        LOGI("Zip archive extraction cancelled");
+        return false;
+    }
+
+    SessionStats result = stats();
+    if (result.files_failed > 0) {
+        LOGE("Failed to extract %llu of %zu files", static_cast<unsigned long long>(result.files_failed), files.size());
+        return false;
+    }
+    report();
+    LOGI("Zip archive extracted successfully with %zu files", files.size());
+    return true;
+}
@@ -0,0 +1,169 @@
+#ifndef ARCHIVER_ARCHIVE_SESSION_H
+#define ARCHIVER_ARCHIVE_SESSION_H
+
+#include <zip.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "blob_cache.h"
+#include "buffer_source.h"
+#include "job_stats.h"
+#include "memory_budget.h"
+#include "progress.h"
+#include "thread_pool.h"
+
+struct ExtractEntry;
+
+// Входной файл архива: путь или открытый дескриптор
+struct InputFile {
+    std::string path;
+    int fd = -1;        // если >= 0, читаем из него; сессия закрывает fd сама
+    std::string name;   // имя внутри архива
+    uint64_t size = 0;
+    time_t mtime = 0;
+};
+
+// Статистика последнего задания сессии; для extractZip files_added -
+// распакованные файлы, files_streamed - прочитанные через libzip, а не pread.
+// files_unchanged и files_removed заполняет только updateZip.
+struct SessionStats {
+    uint64_t files_added = 0;
+    uint64_t files_streamed = 0;
+    uint64_t files_failed = 0;
+    uint64_t bytes_buffered = 0;
+    uint64_t files_unchanged = 0;
+    uint64_t files_removed = 0;
+    uint64_t files_cached = 0;    // взяты из BlobCache без сжатия
+    uint64_t files_deduplicated = 0; // повторы содержимого другого файла, сжатого один раз
+};
+
+// Как update_zip решает, что файл не изменился
+struct UpdateOptions {
+    bool check_crc = false;       // кроме размера и mtime сравнивать CRC-32 содержимого
+    bool remove_missing = false;  // удалять записи, которых нет среди входных файлов
+};
+
+// Одно задание архивации со своей очередью, бюджетом памяти и флагом
+// отмены. Сессии независимы и могут работать одновременно; общий пул
+// потоков и потоки сжатия libzip делятся между активными сессиями поровну.
+class ArchiveSession {
+public:
+    ArchiveSession() = default;
+
+    ArchiveSession(const ArchiveSession&) = delete;
+    ArchiveSession& operator=(const ArchiveSession&) = delete;
+
+    // Создает архив output_path из inputs. Возвращает false при ошибке или отмене.
+    // Дескрипторы из inputs закрываются в любом случае.
+    bool create_zip(const std::vector<InputFile>& inputs, const std::string& output_path, Progress& progress);
+
+    // То же, но архив пишется прямо в output_fd; сессия закрывает его сама.
+    // Если fd не поддерживает позиционирование (канал), архив пишется потоком.
+    bool create_zip(const std::vector<InputFile>& inputs, int output_fd, Progress& progress);
+
+    // Создает архив output_path из дерева каталогов root: имена записей -
+    // пути от root, каталоги добавляются отдельными записями (и пустые).
+    // Обход идет параллельно на общем пуле, и файлы до 1 МиБ читаются и
+    // сжимаются, пока он не закончен; большие файлы libzip читает потоком
+    // и сжимает в zip_close. Порядок записей в архиве не задан.
+    bool create_zip_from_directory(const std::string& root, const std::string& output_path, Progress& progress);
+
+    // Обновляет архив archive_path (или создает, если его нет): файлы с тем же
+    // именем, размером и mtime (с точностью DOS-времени, 2 секунды) остаются
+    // как есть, и zip_close копирует их сжатые данные без пересжатия.
+    // Сжимаются только новые и измененные файлы.
+    bool update_zip(const std::vector<InputFile>& inputs, const std::string& archive_path, const UpdateOptions& options, Progress& progress);
+
+    // Распаковывает архив из archive_fd в каталог output_dir; записи
+    // распаковываются параллельно на общем пуле, каждая читается через pread
+    // по своему смещению. Сессия закрывает archive_fd сама.
+    bool extract_zip(int archive_fd, const std::string& output_dir, Progress& progress);
+
+    void cancel() { cancelled = true; }
+    const std::atomic<bool>& cancel_flag() const { return cancelled; }
+
+    void set_memory_budget(uint64_t bytes) { memory_budget_bytes = bytes; }
+
+    SessionStats stats();
+
+    // Время, объем и системные вызовы по стадиям и записи последнего задания
+    JobStats& job_stats() { return current_job; }
+
+private:
+    // Данные файла на пути от читающей задачи к writer
+    struct FileData {
+        FileBuffer content;
+        std::string name;
+        std::string path;     // для потоковых файлов
+        int fd = -1;          // для потоковых файлов из дескриптора
+        bool streamed = false;
+        bool cached = false;  // сжатые данные в blob, источник - blob_source
+        bool deduplicated = false; // blob общий с другим файлом архива
+        bool directory = false; // запись каталога, данных нет
+        Blob blob;
+        time_t mtime = 0;
+        JobStats::Clock::time_point queued_at;
+    };
+
+    // Ставит задачи чтения файлов в group; вызывается, когда writer уже
+    // работает, задачи могут добавляться и после возврата
+    using Scheduler = std::function<void(TaskGroup& group, MemoryBudget& budget)>;
+
+    // Заполняет открытый архив и закрывает его; job_mutex уже захвачен
+    bool write_archive(zip_t* zip, const std::vector<InputFile>& inputs, Progress& progress, zip_flags_t add_flags = 0);
+    bool run_archive(zip_t* zip, const Scheduler& schedule, Progress& progress, zip_flags_t add_flags);
+    void note_scheduled(const InputFile& input);
+    static void close_inputs(const std::vector<InputFile>& inputs);
+
+    // compress - сжать файл в память здесь же, на задаче пула, а не в zip_close
+    void process_file(const InputFile& input, MemoryBudget& budget, bool compress = false);
+    // Файлы с одинаковым содержимым, members[0] - основной: сжимается
+    // один раз, все записи получают один и тот же blob
+    void process_group(const std::vector<InputFile>& inputs, const std::vector<size_t>& members, MemoryBudget& budget);
+    void enqueue(FileData&& file_data);
+    bool read_input(const InputFile& input, FileData& file_data, MemoryBudget& budget);
+    bool take_from_cache(const InputFile& input, FileData& file_data);
+    bool compress_in_memory(const InputFile& input, Blob& blob, MemoryBudget& budget, Stage stage);
+    void writer_loop(zip_t* zip, zip_flags_t add_flags);
+    // Для update_zip: есть ли запись с тем же размером и mtime, и ее CRC
+    static bool stored_matches(zip_t* zip, const InputFile& input, uint32_t& stored_crc);
+    bool content_matches(const InputFile& input, uint32_t stored_crc);
+    void count(uint64_t SessionStats::*field, uint64_t amount = 1);
+    void note_extracted(const ExtractEntry& file, uint64_t nanos);
+    void reset_stats();
+    static void entry_written(zip_t* zip, zip_uint64_t index, const zip_stat_t* st, void* userdata);
+
+    // Доля ядер на одну сессию при текущем числе активных
+    static unsigned core_share();
+    static void join_active(ArchiveSession* session);
+    static void leave_active(ArchiveSession* session);
+    static void rebalance();
+
+    std::mutex job_mutex; // одна сессия выполняет одно задание за раз
+
+    std::queue<FileData> file_queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    bool all_files_processed = false;
+
+    std::atomic<bool> cancelled{false};
+    std::atomic<uint64_t> memory_budget_bytes{64 * 1024 * 1024};
+    TaskGroup* current_group = nullptr;
+    std::atomic<uint64_t> scheduled_files{0};  // файлы задания, для статистики Job и Close
+    std::atomic<uint64_t> scheduled_bytes{0};
+
+    std::mutex stats_mutex;
+    SessionStats current_stats;
+    JobStats current_job;
+    JobStats::Clock::time_point last_entry_written;
+};
+
+#endif // ARCHIVER_ARCHIVE_SESSION_H
@@ -0,0 +1,29 @@
+#ifndef ARCHIVER_LOG_H
+#define ARCHIVER_LOG_H
+
+// Логирование ядра: на Android в logcat, на хосте (бенчмарки) ошибки идут
+// в stderr, а LOGI/LOGD отключены, чтобы не измерять скорость вывода.
+
+#define LOG_TAG "ZipArchiver"
+
+#ifdef __ANDROID__
+
+#include <android/log.h>
+
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+#else
+
+#include <cstdio>
+
+__attribute__((format(printf, 1, 2))) inline void archiver_log_discard(const char*, ...) {}
+
+#define LOGI(...) archiver_log_discard(__VA_ARGS__)
+#define LOGE(...) (fprintf(stderr, LOG_TAG ": " __VA_ARGS__), fputc('\n', stderr))
+#define LOGD(...) archiver_log_discard(__VA_ARGS__)
+
+#endif
+
+#endif // ARCHIVER_LOG_H
@@ -0,0 +1,664 @@
+// Сквозной бенчмарк ядра архиватора. Генерирует воспроизводимые наборы
+// файлов, архивирует их через ArchiveSession по путям и по дескрипторам,
+// распаковывает обратно и сверяет содержимое, обновляет архив после
+// изменения части файлов. Для каждой операции
+// печатает МБ/с, файлов/с, процессорное время и пиковый RSS. С --baseline
+// завершается с ошибкой, если скорость упала ниже базовой больше чем на
+// --tolerance; если файла базы еще нет, он записывается по этому прогону.
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "archive_session.h"
+#include "blob_cache.h"
+#include "progress.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+    bool full = false;
+    std::string corpus;          // только этот набор
+    std::string work_dir;
+    std::string baseline;
+    std::string write_baseline;
+    double tolerance = 0.5;
+    int repeat = 3;
+    bool keep = false;
+};
+
+// xorshift64*: одинаковые данные на любой платформе и с любой libc
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed ? seed : 1) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+
+    uint64_t uniform(uint64_t low, uint64_t high) { return low + next() % (high - low + 1); }
+
+private:
+    uint64_t state;
+};
+
+const char* const WORDS[] = {
+        "archive", "buffer", "central", "directory", "entry", "file", "header", "index", "local", "method",
+        "offset", "stream", "thread", "window", "zip", "deflate", "the", "of", "and", "to", "in", "is", "for",
+        "data", "size", "time", "value", "error", "state", "queue", "pool", "session", "progress", "memory",
+};
+constexpr size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+enum class Content { Text, Random, Mixed };
+
+void fill_text(std::vector<char>& data, Random& random) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        const char* word = WORDS[random.next() % WORD_COUNT];
+        for (const char* p = word; *p && pos < data.size(); p++) {
+            data[pos++] = *p;
+        }
+        if (pos < data.size()) {
+            data[pos++] = random.next() % 12 == 0 ? '\n' : ' ';
+        }
+    }
+}
+
+void fill_random(std::vector<char>& data, Random& random, size_t begin, size_t end) {
+    for (size_t pos = begin; pos < end; pos += 8) {
+        uint64_t value = random.next();
+        memcpy(data.data() + pos, &value, std::min<size_t>(8, end - pos));
+    }
+}
+
+void fill(std::vector<char>& data, Content content, Random& random) {
+    switch (content) {
+        case Content::Text:
+            fill_text(data, random);
+            break;
+        case Content::Random:
+            fill_random(data, random, 0, data.size());
+            break;
+        case Content::Mixed:
+            // документ со вставленными картинками: текст вперемешку с шумом
+            fill_text(data, random);
+            for (size_t pos = 0; pos < data.size(); pos += 64 * 1024) {
+                fill_random(data, random, pos, std::min(data.size(), pos + 16 * 1024));
+            }
+            break;
+    }
+}
+
+uint64_t fnv1a(const char* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+struct CorpusFile {
+    std::string name;  // имя в архиве
+    uint64_t size;
+    uint64_t hash;
+};
+
+struct Corpus {
+    std::string name;
+    std::string dir;
+    std::vector<CorpusFile> files;
+    uint64_t bytes = 0;
+};
+
+bool add_file(Corpus& corpus, const std::string& name, uint64_t size, Content content, Random& random) {
+    std::vector<char> data(size);
+    fill(data, content, random);
+
+    fs::path path = fs::path(corpus.dir) / name;
+    fs::create_directories(path.parent_path());
+    std::ofstream out(path, std::ios::binary);
+    if (!out.write(data.data(), static_cast<std::streamsize>(size))) {
+        fprintf(stderr, "failed to write %s\n", path.c_str());
+        return false;
+    }
+    corpus.files.push_back(CorpusFile{name, size, fnv1a(data.data(), size)});
+    corpus.bytes += size;
+    return true;
+}
+
+// Копия уже созданного файла набора под другим именем
+bool add_copy(Corpus& corpus, const CorpusFile& original, const std::string& name) {
+    fs::path path = fs::path(corpus.dir) / name;
+    fs::create_directories(path.parent_path());
+    std::error_code error;
+    if (!fs::copy_file(fs::path(corpus.dir) / original.name, path, fs::copy_options::overwrite_existing, error)) {
+        fprintf(stderr, "failed to write %s\n", path.c_str());
+        return false;
+    }
+    corpus.files.push_back(CorpusFile{name, original.size, original.hash});
+    corpus.bytes += original.size;
+    return true;
+}
+
+// Наборы: много мелких файлов, смесь текста и медиа, несколько огромных
+// файлов (блочный deflate), несжимаемые данные и резервная копия, в
+// которой одни и те же файлы лежат в нескольких каталогах
+bool generate(Corpus& corpus, bool full) {
+    Random random(fnv1a(corpus.name.data(), corpus.name.size()));
+    fs::create_directories(corpus.dir);
+
+    if (corpus.name == "tiny") {
+        size_t count = full ? 20000 : 2000;
+        for (size_t i = 0; i < count; i++) {
+            std::string name = "d" + std::to_string(i / 100) + "/f" + std::to_string(i) + ".txt";
+            if (!add_file(corpus, name, random.uniform(64, 4096), Content::Text, random)) {
+                return false;
+            }
+        }
+    } else if (corpus.name == "mixed") {
+        size_t count = full ? 400 : 40;
+        for (size_t i = 0; i < count; i++) {
+            bool ok;
+            switch (i % 5) {
+                case 0:
+                case 1:
+                    ok = add_file(corpus, "doc" + std::to_string(i) + ".txt", random.uniform(16 * 1024, 1024 * 1024), Content::Text, random);
+                    break;
+                case 2:
+                case 3:
+                    ok = add_file(corpus, "img" + std::to_string(i) + ".jpg", random.uniform(64 * 1024, 2 * 1024 * 1024), Content::Random, random);
+                    break;
+                default:
+                    ok = add_file(corpus, "mix" + std::to_string(i) + ".pdf", random.uniform(64 * 1024, 1024 * 1024), Content::Mixed, random);
+                    break;
+            }
+            if (!ok) {
+                return false;
+            }
+        }
+    } else if (corpus.name == "huge") {
+        size_t count = full ? 3 : 2;
+        uint64_t size = full ? 256ULL * 1024 * 1024 : 20ULL * 1024 * 1024;
+        for (size_t i = 0; i < count; i++) {
+            if (!add_file(corpus, "dump" + std::to_string(i) + ".log", size, Content::Text, random)) {
+                return false;
+            }
+        }
+    } else if (corpus.name == "incompressible") {
+        size_t count = full ? 32 : 16;
+        uint64_t size = full ? 16ULL * 1024 * 1024 : 1024 * 1024;
+        for (size_t i = 0; i < count; i++) {
+            if (!add_file(corpus, "video" + std::to_string(i) + ".mp4", size, Content::Random, random)) {
+                return false;
+            }
+        }
+    } else if (corpus.name == "copies") {
+        size_t count = full ? 100 : 10;
+        for (size_t i = 0; i < count; i++) {
+            Content content = i % 2 == 0 ? Content::Text : Content::Random;
+            if (!add_file(corpus, "v0/file" + std::to_string(i), random.uniform(64 * 1024, 2 * 1024 * 1024), content, random)) {
+                return false;
+            }
+        }
+        for (size_t version = 1; version < 4; version++) {
+            for (size_t i = 0; i < count; i++) {
+                CorpusFile original = corpus.files[i];
+                if (!add_copy(corpus, original, "v" + std::to_string(version) + "/file" + std::to_string(i))) {
+                    return false;
+                }
+            }
+        }
+    } else {
+        fprintf(stderr, "unknown corpus %s\n", corpus.name.c_str());
+        return false;
+    }
+    return true;
+}
+
+struct Measurement {
+    std::string corpus;
+    std::string op;
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    double wall = 0;
+    double cpu = 0;
+    uint64_t peak_rss_kb = 0;
+    uint64_t archive_size = 0;
+
+    double mb_per_s() const { return wall > 0 ? static_cast<double>(bytes) / 1e6 / wall : 0; }
+    double files_per_s() const { return wall > 0 ? static_cast<double>(files) / wall : 0; }
+};
+
+double cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Сбрасывает пиковый RSS процесса, чтобы мерить его для одной операции
+void reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+uint64_t peak_rss_kb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+}
+
+// Повторяет операцию repeat раз и оставляет самый быстрый прогон: на
+// коротких операциях одиночный замер сильно шумит. prepare выполняется
+// перед каждым прогоном и в замер не входит.
+bool measure(Measurement& m, int repeat, const std::function<void()>& prepare, const std::function<bool()>& body) {
+    for (int i = 0; i < repeat; i++) {
+        prepare();
+        reset_peak_rss();
+        double cpu_before = cpu_seconds();
+        auto start = std::chrono::steady_clock::now();
+        if (!body()) {
+            return false;
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu = cpu_seconds() - cpu_before;
+        if (i == 0 || wall < m.wall) {
+            m.wall = wall;
+            m.cpu = cpu;
+            m.peak_rss_kb = peak_rss_kb();
+        }
+    }
+    return true;
+}
+
+std::vector<InputFile> inputs_by_path(const Corpus& corpus) {
+    std::vector<InputFile> inputs;
+    for (const auto& file : corpus.files) {
+        InputFile input;
+        input.path = corpus.dir + "/" + file.name;
+        input.name = file.name;
+        input.size = file.size;
+        struct stat st;
+        input.mtime = stat(input.path.c_str(), &st) == 0 ? st.st_mtime : time(nullptr);
+        inputs.push_back(std::move(input));
+    }
+    return inputs;
+}
+
+std::vector<InputFile> inputs_by_fd(const Corpus& corpus) {
+    std::vector<InputFile> inputs = inputs_by_path(corpus);
+    for (auto& input : inputs) {
+        input.fd = open(input.path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    return inputs;
+}
+
+bool verify(const Corpus& corpus, const std::string& dir) {
+    for (const auto& file : corpus.files) {
+        std::ifstream in(dir + "/" + file.name, std::ios::binary);
+        std::vector<char> data(file.size + 1);
+        in.read(data.data(), static_cast<std::streamsize>(data.size()));
+        if (static_cast<uint64_t>(in.gcount()) != file.size || fnv1a(data.data(), file.size) != file.hash) {
+            fprintf(stderr, "%s: extracted %s differs from original\n", corpus.name.c_str(), file.name.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Доля файлов, которые update считает измененными: ночное обновление
+// папки, где поменялась малая часть файлов
+constexpr size_t UPDATE_EVERY = 50;
+
+// Сдвигает mtime каждого UPDATE_EVERY-го файла, содержимое не меняется
+size_t touch_some(const Corpus& corpus) {
+    size_t touched = 0;
+    for (size_t i = 0; i < corpus.files.size(); i += UPDATE_EVERY) {
+        std::string path = corpus.dir + "/" + corpus.files[i].name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            continue;
+        }
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        times[1].tv_sec += 10;
+        if (utimensat(AT_FDCWD, path.c_str(), times, 0) == 0) {
+            touched++;
+        }
+    }
+    return touched;
+}
+
+uint64_t file_size(const std::string& path) {
+    std::error_code error;
+    auto size = fs::file_size(path, error);
+    return error ? 0 : size;
+}
+
+// Архивация по путям (с кэшем сжатых данных и без), по дескрипторам
+// (fd_source и запись в fd) и всего каталога набора с обходом дерева,
+// распаковка и обновление архива после изменения части файлов
+bool run_corpus(const Corpus& corpus, const std::string& work_dir, int repeat, std::vector<Measurement>& results) {
+    std::string archive = work_dir + "/" + corpus.name + ".zip";
+    std::string fd_archive = work_dir + "/" + corpus.name + "-fd.zip";
+    std::string extracted = work_dir + "/" + corpus.name + "-out";
+    std::string updated = work_dir + "/" + corpus.name + "-update.zip";
+    std::string dir_archive = work_dir + "/" + corpus.name + "-dir.zip";
+
+    ArchiveSession session;
+    Progress progress(session.cancel_flag());
+    auto stats_ok = [&] {
+        SessionStats stats = session.stats();
+        if (stats.files_failed > 0) {
+            fprintf(stderr, "%s: %llu files failed\n", corpus.name.c_str(), static_cast<unsigned long long>(stats.files_failed));
+            return false;
+        }
+        return true;
+    };
+
+    Measurement create{corpus.name, "create", corpus.files.size(), corpus.bytes};
+    auto path_inputs = inputs_by_path(corpus);
+    if (!measure(create, repeat, [] {}, [&] { return session.create_zip(path_inputs, archive, progress) && stats_ok(); })) {
+        fprintf(stderr, "%s: create failed\n", corpus.name.c_str());
+        return false;
+    }
+    create.archive_size = file_size(archive);
+    results.push_back(create);
+
+    // То же с кэшем сжатых данных, заполненным предыдущим прогоном: сжатие
+    // файлов от BlobCache::MIN_FILE_SIZE заменяется копированием блобов
+    Measurement create_cached{corpus.name, "create_cached", corpus.files.size(), corpus.bytes};
+    std::string blobs = work_dir + "/" + corpus.name + "-blobs";
+    BlobCache::instance().configure(blobs, 1ULL << 40);
+    bool cached_ok = session.create_zip(path_inputs, archive, progress) && stats_ok() &&
+                     measure(create_cached, repeat, [] {}, [&] { return session.create_zip(path_inputs, archive, progress) && stats_ok(); });
+    BlobCache::instance().configure(blobs, 0);
+    fs::remove_all(blobs);
+    if (!cached_ok) {
+        fprintf(stderr, "%s: create_cached failed\n", corpus.name.c_str());
+        return false;
+    }
+    create_cached.archive_size = file_size(archive);
+    results.push_back(create_cached);
+
+    Measurement create_fd{corpus.name, "create_fd", corpus.files.size(), corpus.bytes};
+    std::vector<InputFile> fd_inputs;
+    int output_fd = -1;
+    // дескрипторы переходят во владение сессии, на каждый прогон открываются заново
+    auto open_fds = [&] {
+        fd_inputs = inputs_by_fd(corpus);
+        output_fd = open(fd_archive.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    };
+    if (!measure(create_fd, repeat, open_fds, [&] { return session.create_zip(fd_inputs, output_fd, progress) && stats_ok(); })) {
+        fprintf(stderr, "%s: create_fd failed\n", corpus.name.c_str());
+        return false;
+    }
+    create_fd.archive_size = file_size(fd_archive);
+    results.push_back(create_fd);
+
+    Measurement extract{corpus.name, "extract", corpus.files.size(), corpus.bytes};
+    int archive_fd = -1;
+    auto prepare_extract = [&] {
+        fs::remove_all(extracted);
+        archive_fd = open(archive.c_str(), O_RDONLY | O_CLOEXEC);
+    };
+    if (!measure(extract, repeat, prepare_extract, [&] { return session.extract_zip(archive_fd, extracted, progress) && stats_ok(); }) ||
+        !verify(corpus, extracted)) {
+        fprintf(stderr, "%s: extract failed\n", corpus.name.c_str());
+        return false;
+    }
+    extract.archive_size = create.archive_size;
+    results.push_back(extract);
+
+    // архив из дескрипторов должен распаковываться так же
+    fs::remove_all(extracted);
+    archive_fd = open(fd_archive.c_str(), O_RDONLY | O_CLOEXEC);
+    if (!session.extract_zip(archive_fd, extracted, progress) || !verify(corpus, extracted)) {
+        fprintf(stderr, "%s: archive written to descriptor is broken\n", corpus.name.c_str());
+        return false;
+    }
+
+    // В каталоге набора только его файлы, поэтому архив дерева
+    // распаковывается в те же файлы, что и архив по списку
+    Measurement create_dir{corpus.name, "create_dir", corpus.files.size(), corpus.bytes};
+    if (!measure(create_dir, repeat, [] {}, [&] { return session.create_zip_from_directory(corpus.dir, dir_archive, progress) && stats_ok(); })) {
+        fprintf(stderr, "%s: create_dir failed\n", corpus.name.c_str());
+        return false;
+    }
+    create_dir.archive_size = file_size(dir_archive);
+    results.push_back(create_dir);
+
+    fs::remove_all(extracted);
+    archive_fd = open(dir_archive.c_str(), O_RDONLY | O_CLOEXEC);
+    if (!session.extract_zip(archive_fd, extracted, progress) || !verify(corpus, extracted)) {
+        fprintf(stderr, "%s: directory archive is broken\n", corpus.name.c_str());
+        return false;
+    }
+
+    // Каждый прогон обновляет копию исходного архива, в которой отмеченные
+    // файлы снова устарели
+    Measurement update{corpus.name, "update", corpus.files.size(), corpus.bytes};
+    size_t touched = touch_some(corpus);
+    auto update_inputs = inputs_by_path(corpus);
+    auto copy_archive = [&] { fs::copy_file(archive, updated, fs::copy_options::overwrite_existing); };
+    auto update_ok = [&] {
+        SessionStats stats = session.stats();
+        if (stats_ok() && stats.files_unchanged + touched == corpus.files.size()) {
+            return true;
+        }
+        fprintf(stderr, "%s: update kept %llu files, expected %zu\n", corpus.name.c_str(),
+                static_cast<unsigned long long>(stats.files_unchanged), corpus.files.size() - touched);
+        return false;
+    };
+    if (!measure(update, repeat, copy_archive, [&] { return session.update_zip(update_inputs, updated, UpdateOptions{}, progress) && update_ok(); })) {
+        fprintf(stderr, "%s: update failed\n", corpus.name.c_str());
+        return false;
+    }
+    update.archive_size = file_size(updated);
+    results.push_back(update);
+
+    fs::remove_all(extracted);
+    archive_fd = open(updated.c_str(), O_RDONLY | O_CLOEXEC);
+    if (!session.extract_zip(archive_fd, extracted, progress) || !verify(corpus, extracted)) {
+        fprintf(stderr, "%s: updated archive is broken\n", corpus.name.c_str());
+        return false;
+    }
+
+    fs::remove_all(extracted);
+    fs::remove(archive);
+    fs::remove(fd_archive);
+    fs::remove(updated);
+    return true;
+}
+
+void print_results(const std::vector<Measurement>& results) {
+    printf("%-15s %-13s %7s %9s %8s %9s %10s %8s %8s %6s\n", "corpus", "op", "files", "MB", "wall_s", "MB/s",
+           "files/s", "cpu_s", "rss_MB", "ratio");
+    for (const auto& m : results) {
+        printf("%-15s %-13s %7llu %9.1f %8.3f %9.1f %10.0f %8.3f %8.1f %6.3f\n", m.corpus.c_str(), m.op.c_str(),
+               static_cast<unsigned long long>(m.files), static_cast<double>(m.bytes) / 1e6, m.wall, m.mb_per_s(),
+               m.files_per_s(), m.cpu, static_cast<double>(m.peak_rss_kb) / 1024.0,
+               m.bytes > 0 ? static_cast<double>(m.archive_size) / static_cast<double>(m.bytes) : 0.0);
+    }
+}
+
+// Базовые значения: строки "corpus op MB/s", # - комментарий
+bool read_baseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "can't read baseline %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        char corpus[64], op[64];
+        double mbps;
+        if (sscanf(line.c_str(), "%63s %63s %lf", corpus, op, &mbps) == 3) {
+            baseline[std::string(corpus) + " " + op] = mbps;
+        }
+    }
+    return true;
+}
+
+bool write_baseline(const std::string& path, const std::vector<Measurement>& results, bool full) {
+    std::ofstream out(path);
+    out << "# archiver_bench baseline, --scale " << (full ? "full" : "small") << ", "
+        << std::thread::hardware_concurrency() << " threads\n";
+    out << "# corpus op MB/s\n";
+    for (const auto& m : results) {
+        char line[160];
+        snprintf(line, sizeof(line), "%s %s %.1f\n", m.corpus.c_str(), m.op.c_str(), m.mb_per_s());
+        out << line;
+    }
+    return static_cast<bool>(out);
+}
+
+bool check_baseline(const std::map<std::string, double>& baseline, const std::vector<Measurement>& results, double tolerance) {
+    bool ok = true;
+    for (const auto& m : results) {
+        auto it = baseline.find(m.corpus + " " + m.op);
+        if (it == baseline.end()) {
+            continue;
+        }
+        double minimum = it->second * (1.0 - tolerance);
+        if (m.mb_per_s() < minimum) {
+            fprintf(stderr, "REGRESSION %s %s: %.1f MB/s, baseline %.1f MB/s, minimum %.1f MB/s\n", m.corpus.c_str(),
+                    m.op.c_str(), m.mb_per_s(), it->second, minimum);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--scale small|full] [--corpus NAME] [--repeat N] [--work-dir DIR] [--keep]\n"
+            "          [--baseline FILE] [--tolerance FRACTION] [--write-baseline FILE]\n"
+            "corpora: tiny mixed huge incompressible copies\n",
+            program);
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--scale" && has_value) {
+            std::string scale = argv[++i];
+            if (scale != "small" && scale != "full") {
+                return false;
+            }
+            options.full = scale == "full";
+        } else if (arg == "--corpus" && has_value) {
+            options.corpus = argv[++i];
+        } else if (arg == "--repeat" && has_value) {
+            options.repeat = atoi(argv[++i]);
+            if (options.repeat < 1) {
+                return false;
+            }
+        } else if (arg == "--work-dir" && has_value) {
+            options.work_dir = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            options.baseline = argv[++i];
+        } else if (arg == "--tolerance" && has_value) {
+            options.tolerance = atof(argv[++i]);
+        } else if (arg == "--write-baseline" && has_value) {
+            options.write_baseline = argv[++i];
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // базовые значения зависят от машины, поэтому первый прогон их записывает
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty()) {
+        if (!fs::exists(options.baseline)) {
+            if (options.write_baseline.empty()) {
+                fprintf(stderr, "no baseline %s yet, recording this run\n", options.baseline.c_str());
+                options.write_baseline = options.baseline;
+            }
+        } else if (!read_baseline(options.baseline, baseline)) {
+            return 2;
+        }
+    }
+
+    bool own_work_dir = options.work_dir.empty();
+    if (own_work_dir) {
+        std::string pattern = (fs::temp_directory_path() / "archiver-bench-XXXXXX").string();
+        if (!mkdtemp(pattern.data())) {
+            perror("mkdtemp");
+            return 2;
+        }
+        options.work_dir = pattern;
+    }
+
+    std::vector<Measurement> results;
+    bool ok = true;
+    for (const char* name : {"tiny", "mixed", "huge", "incompressible", "copies"}) {
+        if (!options.corpus.empty() && options.corpus != name) {
+            continue;
+        }
+        Corpus corpus;
+        corpus.name = name;
+        corpus.dir = options.work_dir + "/" + name;
+        fs::remove_all(corpus.dir);
+        if (!generate(corpus, options.full) || !run_corpus(corpus, options.work_dir, options.repeat, results)) {
+            ok = false;
+        }
+        if (!options.keep) {
+            fs::remove_all(corpus.dir);
+        }
+    }
+    if (own_work_dir && !options.keep) {
+        fs::remove_all(options.work_dir);
+    }
+
+    print_results(results);
+
+    if (ok && !options.write_baseline.empty() && !write_baseline(options.write_baseline, results, options.full)) {
+        fprintf(stderr, "can't write baseline %s\n", options.write_baseline.c_str());
+        ok = false;
+    }
+    if (!baseline.empty() && !check_baseline(baseline, results, options.tolerance)) {
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,531 @@
+#include "blob_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "archiver_log.h"
+#include "fd_source.h"
+
+namespace {
+
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr size_t LOCAL_HEADER_SIZE = 30;
+constexpr const char* BLOB_SUFFIX = ".zip";
+constexpr size_t BLOB_NAME_LENGTH = 4 * 16 + 4;
+
+uint16_t read_le16(const unsigned char* data) {
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+uint32_t read_le32(const unsigned char* data) {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+           (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// Размеры, CRC и смещение локального заголовка единственной записи блоба
+bool stat_blob(zip_t* zip, Blob& blob, zip_uint64_t& header_offset) {
+    zip_stat_t st;
+    constexpr zip_uint64_t required = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+    if (zip_get_num_entries(zip, 0) != 1 || zip_stat_index(zip, 0, 0, &st) != 0 || (st.valid & required) != required ||
+        st.encryption_method != ZIP_EM_NONE) {
+        return false;
+    }
+    zip_int64_t offset = zip_file_get_local_header_offset(zip, 0, 0);
+    if (offset < 0) {
+        return false;
+    }
+    header_offset = static_cast<zip_uint64_t>(offset);
+    blob.size = st.size;
+    blob.comp_size = st.comp_size;
+    blob.crc = st.crc;
+    blob.method = st.comp_method;
+    return true;
+}
+
+// Данные записи начинаются после локального заголовка с именем и extra
+bool parse_local_header(const unsigned char* header, zip_uint64_t header_offset, Blob& blob) {
+    if (read_le32(header) != LOCAL_HEADER_SIGNATURE) {
+        return false;
+    }
+    blob.data_offset = header_offset + LOCAL_HEADER_SIZE + read_le16(header + 26) + read_le16(header + 28);
+    return true;
+}
+
+// Читает размеры, CRC и смещение сжатых данных единственной записи блоба
+bool read_blob(const std::string& path, Blob& blob) {
+    int err = 0;
+    zip_t* zip = zip_open(path.c_str(), ZIP_RDONLY, &err);
+    if (!zip) {
+        return false;
+    }
+    zip_uint64_t header_offset = 0;
+    bool ok = stat_blob(zip, blob, header_offset);
+    zip_discard(zip);
+    if (!ok) {
+        return false;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    unsigned char header[LOCAL_HEADER_SIZE];
+    ssize_t n;
+    do {
+        n = pread(fd, header, sizeof(header), static_cast<off_t>(header_offset));
+    } while (n < 0 && errno == EINTR);
+    close(fd);
+    if (n != static_cast<ssize_t>(sizeof(header)) || !parse_local_header(header, header_offset, blob)) {
+        return false;
+    }
+    blob.path = path;
+    return true;
+}
+
+int cancel_requested(zip_t*, void* userdata) {
+    return static_cast<std::atomic<bool>*>(userdata)->load() ? 1 : 0;
+}
+
+// Блоб пишет сам libzip с теми же настройками, что и обычный архив
+bool add_data_entry(zip_t* zip, int fd, const std::atomic<bool>& cancelled, StageCounters* reads) {
+    int source_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (source_fd < 0) {
+        return false;
+    }
+    zip_set_archive_flag(zip, ZIP_AFL_ADAPTIVE_COMPRESSION, 1);
+    zip_register_cancel_callback_with_state(zip, cancel_requested, nullptr, const_cast<std::atomic<bool>*>(&cancelled));
+    zip_source_t* source = fd_source_create(zip, source_fd, reads);
+    if (!source) {
+        close(source_fd);
+        return false;
+    }
+    if (zip_file_add(zip, "data", source, 0) < 0) {
+        zip_source_free(source);
+        return false;
+    }
+    return true;
+}
+
+std::string base_name(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+struct BlobSource {
+    Blob blob;
+    time_t mtime;
+    int fd = -1;
+    zip_uint64_t offset = 0;
+    StageCounters* reads = nullptr;
+    zip_error_t error;
+};
+
+zip_int64_t blob_source_callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    auto* ctx = static_cast<BlobSource*>(userdata);
+
+    switch (cmd) {
+        case ZIP_SOURCE_OPEN:
+            ctx->offset = 0;
+            if (ctx->blob.data) {
+                return 0;
+            }
+            ctx->fd = open(ctx->blob.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (ctx->fd < 0) {
+                zip_error_set(&ctx->error, ZIP_ER_OPEN, errno);
+                return -1;
+            }
+            return 0;
+
+        case ZIP_SOURCE_READ: {
+            if (ctx->offset >= ctx->blob.comp_size) {
+                return 0;
+            }
+            if (len > ctx->blob.comp_size - ctx->offset) {
+                len = ctx->blob.comp_size - ctx->offset;
+            }
+            if (ctx->blob.data) {
+                memcpy(data, ctx->blob.data->data() + ctx->blob.data_offset + ctx->offset, len);
+                ctx->offset += len;
+                return static_cast<zip_int64_t>(len);
+            }
+            ssize_t n;
+            auto start = JobStats::Clock::now();
+            do {
+                n = pread(ctx->fd, data, len, static_cast<off_t>(ctx->blob.data_offset + ctx->offset));
+            } while (n < 0 && errno == EINTR);
+            if (n < 0) {
+                zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+                return -1;
+            }
+            if (n == 0) {
+                // блоб обрезан; zip_close сообщит о несовпадении размера
+                zip_error_set(&ctx->error, ZIP_ER_READ, EIO);
+                return -1;
+            }
+            if (ctx->reads) {
+                ctx->reads->add(JobStats::nanos_since(start), static_cast<uint64_t>(n));
+            }
+            ctx->offset += static_cast<zip_uint64_t>(n);
+            return n;
+        }
+
+        case ZIP_SOURCE_CLOSE:
+            if (ctx->fd >= 0) {
+                close(ctx->fd);
+                ctx->fd = -1;
+            }
+            return 0;
+
+        case ZIP_SOURCE_STAT: {
+            // Метод и сжатый размер говорят zip_close, что данные уже сжаты
+            auto* st = static_cast<zip_stat_t*>(data);
+            zip_stat_init(st);
+            st->size = ctx->blob.size;
+            st->comp_size = ctx->blob.comp_size;
+            st->comp_method = ctx->blob.method;
+            st->crc = ctx->blob.crc;
+            st->encryption_method = ZIP_EM_NONE;
+            st->mtime = ctx->mtime;
+            st->valid |= ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_CRC | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_MTIME;
+            return sizeof(*st);
+        }
+
+        case ZIP_SOURCE_ERROR:
+            return zip_error_to_data(&ctx->error, data, len);
+
+        case ZIP_SOURCE_FREE:
+            if (ctx->fd >= 0) {
+                close(ctx->fd);
+            }
+            if (!ctx->blob.data) {
+                BlobCache::instance().release(ctx->blob);
+            }
+            zip_error_fini(&ctx->error);
+            delete ctx;
+            return 0;
+
+        case ZIP_SOURCE_SUPPORTS:
+            return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+
+        default:
+            zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+            return -1;
+    }
+}
+
+} // namespace
+
+BlobCache& BlobCache::instance() {
+    static BlobCache cache;
+    return cache;
+}
+
+void BlobCache::configure(const std::string& directory, uint64_t max_size) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Каталог уже прочитан: блобы, закрепленные идущими заданиями, и
+    // временные файлы недописанных store трогать нельзя, меняется только предел
+    if (loaded && directory == dir) {
+        max_bytes = max_size;
+        evict_locked();
+        return;
+    }
+
+    dir = directory;
+    max_bytes = max_size;
+    loaded = false;
+    total_bytes = 0;
+    lru.clear();
+    items.clear();
+    if (max_bytes == 0) {
+        return;
+    }
+
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+        LOGE("Failed to create blob cache directory %s", dir.c_str());
+        max_bytes = 0;
+        return;
+    }
+    DIR* listing = opendir(dir.c_str());
+    if (!listing) {
+        LOGE("Failed to read blob cache directory %s", dir.c_str());
+        max_bytes = 0;
+        return;
+    }
+
+    // Блобы по времени последнего использования; недописанные файлы
+    // прерванных заданий удаляются
+    struct Found {
+        std::string name;
+        uint64_t bytes;
+        int64_t used_ns;
+    };
+    std::vector<Found> found;
+    while (dirent* entry = readdir(listing)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (name.size() != BLOB_NAME_LENGTH || name.compare(name.size() - 4, 4, BLOB_SUFFIX) != 0) {
+            unlink(path.c_str());
+            continue;
+        }
+        found.push_back(Found{name, static_cast<uint64_t>(st.st_size),
+                              static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec});
+    }
+    closedir(listing);
+    loaded = true;
+
+    std::sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.used_ns > b.used_ns; });
+    for (const auto& blob : found) {
+        lru.push_back(blob.name);
+        items[blob.name] = Item{blob.bytes, 0, std::prev(lru.end())};
+        total_bytes += blob.bytes;
+    }
+    evict_locked();
+
+    LOGI("Blob cache %s: %zu blobs, %llu of %llu bytes", dir.c_str(), items.size(),
+         static_cast<unsigned long long>(total_bytes), static_cast<unsigned long long>(max_bytes));
+}
+
+bool BlobCache::wants(uint64_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return max_bytes > 0 && size >= MIN_FILE_SIZE && size <= max_bytes / 4;
+}
+
+bool BlobCache::key_for_fd(int fd, BlobKey& key) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key.device = static_cast<uint64_t>(st.st_dev);
+    key.inode = static_cast<uint64_t>(st.st_ino);
+    key.size = static_cast<uint64_t>(st.st_size);
+    key.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+std::string BlobCache::name_for(const BlobKey& key) {
+    char name[BLOB_NAME_LENGTH + 1];
+    snprintf(name, sizeof(name), "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%s", key.device, key.inode, key.size,
+             static_cast<uint64_t>(key.mtime_ns), BLOB_SUFFIX);
+    return name;
+}
+
+bool BlobCache::lookup(const BlobKey& key, Blob& blob) {
+    std::string name = name_for(key);
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = items.find(name);
+        if (it == items.end()) {
+            return false;
+        }
+        lru.splice(lru.begin(), lru, it->second.position);
+        it->second.pins++;
+        path = dir + "/" + name;
+    }
+
+    // время использования сохраняется в mtime блоба
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+
+    if (!read_blob(path, blob) || blob.size != key.size) {
+        LOGE("Dropping broken blob %s", path.c_str());
+        std::lock_guard<std::mutex> lock(mutex);
+        remove_locked(name);
+        return false;
+    }
+    return true;
+}
+
+bool BlobCache::store(const BlobKey& key, int fd, Blob& blob, const std::atomic<bool>& cancelled, StageCounters* reads) {
+    std::string name = name_for(key);
+    std::string directory;
+    std::string temp;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (max_bytes == 0) {
+            return false;
+        }
+        directory = dir;
+        temp = dir + "/" + name + "." + std::to_string(next_temp++) + ".tmp";
+    }
+
+    int err = 0;
+    zip_t* zip = zip_open(temp.c_str(), ZIP_CREATE | ZIP_TRUNCATE, &err);
+    if (!zip) {
+        LOGE("Failed to create blob %s: error %d", temp.c_str(), err);
+        return false;
+    }
+    if (!add_data_entry(zip, fd, cancelled, reads)) {
+        zip_discard(zip);
+        return false;
+    }
+    if (zip_close(zip) < 0) {
+        LOGE("Failed to write blob %s: %s", temp.c_str(), zip_strerror(zip));
+        zip_discard(zip);
+        unlink(temp.c_str());
+        return false;
+    }
+
+    Blob written;
+    struct stat st;
+    if (!read_blob(temp, written) || written.size != key.size || stat(temp.c_str(), &st) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string path = dir + "/" + name;
+    // кэш выключили или перенесли, пока файл сжимался; или тот же файл
+    // уже сохранила другая сессия
+    if (max_bytes == 0 || dir != directory || items.count(name) > 0 || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    insert_locked(name, static_cast<uint64_t>(st.st_size));
+    items[name].pins++;
+    evict_locked();
+
+    blob = written;
+    blob.path = path;
+    return true;
+}
+
+void BlobCache::retain(const Blob& blob) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = items.find(base_name(blob.path));
+    if (it != items.end()) {
+        it->second.pins++;
+    }
+}
+
+void BlobCache::release(const Blob& blob) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = items.find(base_name(blob.path));
+    if (it != items.end() && it->second.pins > 0) {
+        it->second.pins--;
+    }
+    evict_locked();
+}
+
+void BlobCache::insert_locked(const std::string& name, uint64_t bytes) {
+    lru.push_front(name);
+    items[name] = Item{bytes, 0, lru.begin()};
+    total_bytes += bytes;
+}
+
+void BlobCache::evict_locked() {
+    // выключенный кэш блобы не удаляет
+    if (max_bytes == 0) {
+        return;
+    }
+    auto it = lru.end();
+    while (total_bytes > max_bytes && it != lru.begin()) {
+        --it;
+        auto item = items.find(*it);
+        if (item->second.pins > 0) {
+            continue;
+        }
+        std::string path = dir + "/" + *it;
+        total_bytes -= item->second.bytes;
+        items.erase(item);
+        it = lru.erase(it);
+        unlink(path.c_str());
+    }
+}
+
+void BlobCache::remove_locked(const std::string& name) {
+    auto it = items.find(name);
+    if (it == items.end()) {
+        return;
+    }
+    std::string path = dir + "/" + name;
+    total_bytes -= it->second.bytes;
+    lru.erase(it->second.position);
+    items.erase(it);
+    unlink(path.c_str());
+}
+
+bool compress_to_memory(int fd, uint64_t size, Blob& blob, const std::atomic<bool>& cancelled, StageCounters* reads) {
+    zip_error_t error;
+    zip_error_init(&error);
+    zip_source_t* buffer = zip_source_buffer_create(nullptr, 0, 0, &error);
+    zip_t* zip = buffer ? zip_open_from_source(buffer, ZIP_TRUNCATE, &error) : nullptr;
+    zip_error_fini(&error);
+    if (!zip) {
+        zip_source_free(buffer);
+        return false;
+    }
+
+    // zip_close и zip_discard освобождают источник архива; готовый архив
+    // читается из него после закрытия
+    zip_source_keep(buffer);
+    if (!add_data_entry(zip, fd, cancelled, reads) || zip_close(zip) < 0) {
+        zip_discard(zip);
+        zip_source_free(buffer);
+        return false;
+    }
+
+    Blob written;
+    zip_uint64_t header_offset = 0;
+    zip_error_init(&error);
+    zip_source_keep(buffer);
+    zip = zip_open_from_source(buffer, ZIP_RDONLY, &error);
+    zip_error_fini(&error);
+    bool ok = false;
+    if (zip) {
+        ok = stat_blob(zip, written, header_offset);
+        zip_discard(zip);
+    } else {
+        zip_source_free(buffer);
+    }
+
+    auto archive = std::make_shared<std::vector<char>>();
+    zip_stat_t st;
+    if (ok && zip_source_stat(buffer, &st) == 0 && (st.valid & ZIP_STAT_SIZE) && zip_source_open(buffer) == 0) {
+        archive->resize(static_cast<size_t>(st.size));
+        ok = zip_source_read(buffer, archive->data(), st.size) == static_cast<zip_int64_t>(st.size);
+        zip_source_close(buffer);
+    } else {
+        ok = false;
+    }
+    zip_source_free(buffer);
+
+    ok = ok && written.size == size && header_offset + LOCAL_HEADER_SIZE <= archive->size() &&
+         parse_local_header(reinterpret_cast<const unsigned char*>(archive->data()) + header_offset, header_offset, written) &&
+         written.data_offset + written.comp_size <= archive->size();
+    if (!ok) {
+        return false;
+    }
+    written.data = std::move(archive);
+    blob = std::move(written);
+    return true;
+}
+
+zip_source_t* blob_source_create(zip_t* zip, const Blob& blob, time_t mtime, StageCounters* reads) {
+    auto* ctx = new BlobSource{blob, mtime, -1, 0, reads, {}};
+    zip_error_init(&ctx->error);
+    zip_source_t* source = zip_source_function(zip, blob_source_callback, ctx);
+    if (!source) {
+        if (!blob.data) {
+            BlobCache::instance().release(blob);
+        }
+        zip_error_fini(&ctx->error);
+        delete ctx;
+    }
+    return source;
+}
@@ -0,0 +1,121 @@
+#ifndef ARCHIVER_BLOB_CACHE_H
+#define ARCHIVER_BLOB_CACHE_H
+
+#include <zip.h>
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "job_stats.h"
+
+// Файл, по которому ищется блоб: устройство, inode, размер и mtime.
+// Содержимое не читается, поэтому поиск ничего не стоит.
+struct BlobKey {
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+};
+
+// Сжатые данные файла внутри блоба: файла в кэше или, если задан data,
+// архива в памяти
+struct Blob {
+    std::string path;
+    std::shared_ptr<const std::vector<char>> data;
+    uint64_t data_offset = 0;
+    uint64_t size = 0;
+    uint64_t comp_size = 0;
+    uint32_t crc = 0;
+    uint16_t method = ZIP_CM_STORE;
+};
+
+// Постоянный кэш сжатых данных файлов в каталоге кэша приложения. Блоб -
+// архив из одной записи, которую libzip сжал так же, как при обычной
+// архивации (ZIP_AFL_ADAPTIVE_COMPRESSION); при попадании сжатые данные
+// переносятся в новый архив как есть. Объем кэша ограничен: при
+// переполнении удаляются блобы, которые дольше всего не использовались.
+// mtime файла блоба - время последнего использования, поэтому порядок
+// переживает перезапуск. Общий для всех сессий, методы потокобезопасны.
+class BlobCache {
+public:
+    // Файлы меньше этого размера сжимаются быстрее, чем ищутся в кэше
+    static constexpr uint64_t MIN_FILE_SIZE = 64 * 1024;
+
+    static BlobCache& instance();
+
+    BlobCache(const BlobCache&) = delete;
+    BlobCache& operator=(const BlobCache&) = delete;
+
+    // Включает кэш в каталоге dir с пределом max_bytes и читает уже
+    // записанные блобы; max_bytes == 0 выключает кэш. Повторный вызов с тем
+    // же каталогом не перечитывает его и не трогает закрепленные блобы.
+    void configure(const std::string& dir, uint64_t max_bytes);
+
+    // Стоит ли кэшировать файл такого размера. Файлы больше четверти
+    // объема кэша не кэшируются, чтобы один файл не вытеснял все остальные.
+    bool wants(uint64_t size);
+
+    // Ключ обычного файла по fstat; false для каналов и при ошибке
+    static bool key_for_fd(int fd, BlobKey& key);
+
+    // Находит блоб файла. Найденный блоб закреплен и не удаляется до
+    // release(blob), даже если кэш переполнится.
+    bool lookup(const BlobKey& key, Blob& blob);
+
+    // Сжимает первые key.size байт fd в новый блоб и закрепляет его, как
+    // lookup. fd читается через pread и остается открытым; сжатие
+    // прерывается, когда выставлен cancelled.
+    bool store(const BlobKey& key, int fd, Blob& blob, const std::atomic<bool>& cancelled, StageCounters* reads);
+
+    // Еще одно закрепление найденного или сохраненного блоба: у каждого
+    // источника, который его читает, свое
+    void retain(const Blob& blob);
+    void release(const Blob& blob);
+
+private:
+    BlobCache() = default;
+
+    struct Item {
+        uint64_t bytes = 0;
+        unsigned pins = 0;
+        std::list<std::string>::iterator position; // в lru
+    };
+
+    static std::string name_for(const BlobKey& key);
+    // Добавляет новый блоб в начало lru; mutex захвачен
+    void insert_locked(const std::string& name, uint64_t bytes);
+    // Удаляет старые незакрепленные блобы, пока кэш не влезет в предел
+    void evict_locked();
+    void remove_locked(const std::string& name);
+
+    std::mutex mutex;
+    std::string dir;
+    uint64_t max_bytes = 0;
+    bool loaded = false; // items соответствуют содержимому dir
+    uint64_t total_bytes = 0;
+    uint64_t next_temp = 0;
+    std::list<std::string> lru; // в начале - использованные последними
+    std::unordered_map<std::string, Item> items;
+};
+
+// Сжимает первые size байт fd так же, как store, но в архив в памяти;
+// кэш при этом не нужен. Закреплять такой блоб не требуется.
+bool compress_to_memory(int fd, uint64_t size, Blob& blob, const std::atomic<bool>& cancelled, StageCounters* reads);
+
+// Источник libzip, отдающий сжатые данные блоба: zip_close копирует их в
+// архив без пересжатия. Файл блоба открывается только на время чтения,
+// поэтому тысячи таких источников не держат дескрипторы. Источник
+// забирает закрепление блоба и снимает его при освобождении, а при ошибке
+// создания - сразу. Блоб в памяти читается без системных вызовов и может
+// быть общим у нескольких источников. Если reads задан, каждый системный
+// вызов чтения добавляется к нему.
+zip_source_t* blob_source_create(zip_t* zip, const Blob& blob, time_t mtime, StageCounters* reads = nullptr);
+
+#endif // ARCHIVER_BLOB_CACHE_H
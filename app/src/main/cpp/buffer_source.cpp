@@ -0,0 +1,139 @@
+#include "buffer_source.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Сколько свободных буферов держим в пуле, независимо от их размера
+constexpr size_t MAX_POOLED_BUFFERS = 64;
+
+struct BufferSource {
+    FileBuffer data;
+    zip_uint64_t offset = 0;
+    time_t mtime;
+    BufferPool* pool;
+    zip_error_t error;
+};
+
+zip_int64_t buffer_source_callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    auto* ctx = static_cast<BufferSource*>(userdata);
+
+    switch (cmd) {
+        case ZIP_SOURCE_OPEN:
+            ctx->offset = 0;
+            return 0;
+
+        case ZIP_SOURCE_READ: {
+            zip_uint64_t n = std::min<zip_uint64_t>(len, ctx->data.size() - ctx->offset);
+            if (n > 0) {
+                memcpy(data, ctx->data.data() + ctx->offset, n);
+                ctx->offset += n;
+            }
+            return static_cast<zip_int64_t>(n);
+        }
+
+        case ZIP_SOURCE_CLOSE:
+            return 0;
+
+        case ZIP_SOURCE_STAT: {
+            auto* st = static_cast<zip_stat_t*>(data);
+            zip_stat_init(st);
+            st->size = ctx->data.size();
+            st->comp_size = ctx->data.size();
+            st->comp_method = ZIP_CM_STORE;
+            st->encryption_method = ZIP_EM_NONE;
+            st->mtime = ctx->mtime;
+            st->valid = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_MTIME;
+            return sizeof(*st);
+        }
+
+        case ZIP_SOURCE_SEEK: {
+            zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->data.size(), data, len, &ctx->error);
+            if (new_offset < 0) {
+                return -1;
+            }
+            ctx->offset = static_cast<zip_uint64_t>(new_offset);
+            return 0;
+        }
+
+        case ZIP_SOURCE_TELL:
+            return static_cast<zip_int64_t>(ctx->offset);
+
+        case ZIP_SOURCE_ERROR:
+            return zip_error_to_data(&ctx->error, data, len);
+
+        case ZIP_SOURCE_FREE:
+            if (ctx->pool) {
+                ctx->pool->recycle(std::move(ctx->data));
+            }
+            zip_error_fini(&ctx->error);
+            delete ctx;
+            return 0;
+
+        case ZIP_SOURCE_SUPPORTS:
+            return ZIP_SOURCE_SUPPORTS_SEEKABLE;
+
+        default:
+            zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+            return -1;
+    }
+}
+
+} // namespace
+
+BufferPool& BufferPool::instance() {
+    static BufferPool pool(32 * 1024 * 1024);
+    return pool;
+}
+
+FileBuffer BufferPool::acquire(size_t size) {
+    FileBuffer buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // самый маленький из подходящих буферов, чтобы крупные оставались для крупных файлов
+        auto best = free_buffers.end();
+        for (auto it = free_buffers.begin(); it != free_buffers.end(); ++it) {
+            if (it->capacity() >= size && (best == free_buffers.end() || it->capacity() < best->capacity())) {
+                best = it;
+            }
+        }
+        if (best != free_buffers.end()) {
+            retained -= best->capacity();
+            buffer = std::move(*best);
+            if (best != free_buffers.end() - 1) {
+                *best = std::move(free_buffers.back());
+            }
+            free_buffers.pop_back();
+        }
+    }
+    buffer.resize(size);
+    return buffer;
+}
+
+void BufferPool::recycle(FileBuffer&& buffer) {
+    FileBuffer victim(std::move(buffer));
+    victim.clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (victim.capacity() == 0 || free_buffers.size() >= MAX_POOLED_BUFFERS || retained + victim.capacity() > max_retained) {
+        return;
+    }
+    retained += victim.capacity();
+    free_buffers.push_back(std::move(victim));
+}
+
+zip_source_t* buffer_source_create(zip_t* zip, FileBuffer&& data, time_t mtime, BufferPool* pool) {
+    auto* ctx = new BufferSource{std::move(data), 0, mtime, pool, {}};
+    zip_error_init(&ctx->error);
+
+    zip_source_t* source = zip_source_function(zip, buffer_source_callback, ctx);
+    if (!source) {
+        // libzip не забрал контекст, возвращаем буфер вызывающему
+        data = std::move(ctx->data);
+        zip_error_fini(&ctx->error);
+        delete ctx;
+    }
+    return source;
+}
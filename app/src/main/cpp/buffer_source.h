@@ -0,0 +1,71 @@
+#ifndef ARCHIVER_BUFFER_SOURCE_H
+#define ARCHIVER_BUFFER_SOURCE_H
+
+#include <zip.h>
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Аллокатор, который не обнуляет новые элементы при resize(): буфер
+// сразу перезаписывается данными файла, и лишний проход по памяти не нужен
+template <typename T>
+struct DefaultInitAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = DefaultInitAllocator<U>;
+    };
+
+    DefaultInitAllocator() = default;
+    template <typename U>
+    DefaultInitAllocator(const DefaultInitAllocator<U>&) noexcept {}
+
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+        ::new (static_cast<void*>(p)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+// Содержимое файла в памяти
+using FileBuffer = std::vector<char, DefaultInitAllocator<char>>;
+
+// Пул буферов для содержимого файлов. Буферы, которые libzip освобождает
+// после записи архива, возвращаются сюда и переиспользуются в следующих
+// файлах и вызовах createZip вместо новых выделений памяти.
+class BufferPool {
+public:
+    explicit BufferPool(uint64_t max_retained_bytes) : max_retained(max_retained_bytes) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Общий пул процесса
+    static BufferPool& instance();
+
+    // Буфер размера size; по возможности берётся из пула. Содержимое не
+    // инициализируется
+    FileBuffer acquire(size_t size);
+    // Возвращает буфер в пул (или освобождает, если пул полон)
+    void recycle(FileBuffer&& buffer);
+
+private:
+    const uint64_t max_retained;
+    uint64_t retained = 0;
+    std::vector<FileBuffer> free_buffers;
+    std::mutex mutex;
+};
+
+// Источник libzip, который забирает вектор во владение без копирования.
+// При освобождении источника буфер уходит в pool (если он задан).
+zip_source_t* buffer_source_create(zip_t* zip, FileBuffer&& data, time_t mtime, BufferPool* pool);
+
+#endif // ARCHIVER_BUFFER_SOURCE_H
@@ -0,0 +1,284 @@
+#include "dedupe.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/stat.h>
+#include <tuple>
+#include <unistd.h>
+#include <zip.h>
+
+#include "thread_pool.h"
+
+namespace {
+
+struct Identity {
+    bool known = false;
+    uint64_t device = 0;
+    uint64_t inode = 0;
+};
+
+struct Digest {
+    bool known = false;
+    uint32_t crc = 0;
+    uint64_t hash = 0;
+};
+
+Identity identity_of(const InputFile& input) {
+    struct stat st;
+    int result = input.fd >= 0 ? fstat(input.fd, &st) : stat(input.path.c_str(), &st);
+    Identity identity;
+    if (result == 0 && S_ISREG(st.st_mode)) {
+        identity.known = true;
+        identity.device = static_cast<uint64_t>(st.st_dev);
+        identity.inode = static_cast<uint64_t>(st.st_ino);
+    }
+    return identity;
+}
+
+// Перемешивание по 8 байт. Хэш только отсеивает разные файлы: он
+// обратим, и вместе с CRC-32 совпадение легко подобрать нарочно, поэтому
+// совпавшие файлы потом сравниваются побайтно
+uint64_t mix(uint64_t hash, uint64_t word) {
+    hash ^= word * 0x9e3779b97f4a7c15ULL;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0xbf58476d1ce4e5b9ULL;
+}
+
+uint64_t hash_block(uint64_t hash, const unsigned char* data, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = mix(hash, word);
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, length - i);
+        hash = mix(hash, word ^ (static_cast<uint64_t>(length - i) << 56));
+    }
+    return hash;
+}
+
+constexpr size_t CHUNK_SIZE = 256 * 1024;
+
+int open_input(const InputFile& input) {
+    return input.fd >= 0 ? input.fd : open(input.path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+void close_input(const InputFile& input, int fd) {
+    if (fd >= 0 && fd != input.fd) {
+        close(fd);
+    }
+}
+
+// Читает length байт с offset; pread может вернуть меньше
+bool read_at(int fd, unsigned char* data, size_t length, uint64_t offset, StageCounters& reads) {
+    size_t done = 0;
+    while (done < length) {
+        auto start = JobStats::Clock::now();
+        ssize_t n = pread(fd, data + done, length - done, static_cast<off_t>(offset + done));
+        reads.add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Хэш первых length байт файла
+Digest digest_of(const InputFile& input, uint64_t length, StageCounters& reads) {
+    Digest digest;
+    int fd = open_input(input);
+    if (fd < 0) {
+        return digest;
+    }
+
+    // размер входит в хэш, чтобы файлы, отличающиеся только длиной, не совпали
+    std::vector<unsigned char> buffer(static_cast<size_t>(std::min<uint64_t>(length, CHUNK_SIZE)));
+    uint32_t crc = 0;
+    uint64_t hash = mix(0, input.size);
+    uint64_t done = 0;
+    bool ok = true;
+    while (done < length) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(length - done, buffer.size()));
+        auto start = JobStats::Clock::now();
+        ssize_t n = pread(fd, buffer.data(), chunk, static_cast<off_t>(done));
+        reads.add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        crc = zip_crc32(crc, buffer.data(), static_cast<uint64_t>(n));
+        // pread может вернуть меньше; хэш считается по блокам независимо от этого
+        hash = hash_block(hash, buffer.data(), static_cast<size_t>(n));
+        done += static_cast<uint64_t>(n);
+    }
+    close_input(input, fd);
+    if (ok) {
+        digest.known = true;
+        digest.crc = crc;
+        digest.hash = hash;
+    }
+    return digest;
+}
+
+// Хэши candidates на общем пуле; digests индексируются номером входа
+void compute_digests(const std::vector<InputFile>& inputs, const std::vector<size_t>& candidates, uint64_t limit, unsigned threads,
+                     std::vector<Digest>& digests, StageCounters& reads) {
+    TaskGroup group;
+    ThreadPool::instance().set_limit(group, threads);
+    std::vector<Task> tasks;
+    tasks.reserve(candidates.size());
+    for (size_t i : candidates) {
+        uint64_t length = std::min(inputs[i].size, limit);
+        tasks.push_back(Task{[&inputs, &digests, &reads, i, length] { digests[i] = digest_of(inputs[i], length, reads); }, length});
+    }
+    ThreadPool::instance().submit(std::move(tasks), group);
+    group.wait();
+}
+
+// Побайтное сравнение двух файлов одного размера
+bool same_content(const InputFile& a, const InputFile& b, StageCounters& reads) {
+    int fd_a = open_input(a);
+    int fd_b = open_input(b);
+    bool same = fd_a >= 0 && fd_b >= 0;
+    if (same) {
+        std::vector<unsigned char> buffer_a(static_cast<size_t>(std::min<uint64_t>(a.size, CHUNK_SIZE)));
+        std::vector<unsigned char> buffer_b(buffer_a.size());
+        for (uint64_t done = 0; same && done < a.size; done += buffer_a.size()) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(a.size - done, buffer_a.size()));
+            same = read_at(fd_a, buffer_a.data(), chunk, done, reads) && read_at(fd_b, buffer_b.data(), chunk, done, reads) &&
+                   memcmp(buffer_a.data(), buffer_b.data(), chunk) == 0;
+        }
+    }
+    close_input(a, fd_a);
+    close_input(b, fd_b);
+    return same;
+}
+
+// Делит группу входов с одинаковым размером и хэшем на файлы с
+// действительно одинаковым содержимым: каждый вход сравнивается с
+// основными входами уже найденных частей по порядку. При случайном
+// совпадении хэша это одно сравнение, подобранное же совпадение
+// просто дает отдельную часть
+void split_by_content(const std::vector<InputFile>& inputs, const std::vector<size_t>& group, std::vector<size_t>& primary,
+                      StageCounters& reads) {
+    std::vector<size_t> heads;
+    for (size_t i : group) {
+        auto head = std::find_if(heads.begin(), heads.end(), [&](size_t h) { return same_content(inputs[h], inputs[i], reads); });
+        if (head == heads.end()) {
+            heads.push_back(i);
+        } else {
+            primary[i] = *head;
+        }
+    }
+}
+
+// Оставляет в candidates только входы, у которых есть пара с тем же
+// размером и хэшем; порядок сохраняется
+void keep_collisions(const std::vector<InputFile>& inputs, const std::vector<Digest>& digests, std::vector<size_t>& candidates) {
+    std::map<std::tuple<uint64_t, uint32_t, uint64_t>, size_t> seen;
+    for (size_t i : candidates) {
+        if (digests[i].known) {
+            seen[std::make_tuple(inputs[i].size, digests[i].crc, digests[i].hash)]++;
+        }
+    }
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](size_t i) {
+        return !digests[i].known || seen[std::make_tuple(inputs[i].size, digests[i].crc, digests[i].hash)] < 2;
+    }), candidates.end());
+}
+
+} // namespace
+
+std::vector<size_t> find_duplicates(const std::vector<InputFile>& inputs, unsigned threads, StageCounters& reads) {
+    std::vector<size_t> primary(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        primary[i] = i;
+    }
+
+    // Один и тот же файл
+    std::map<std::pair<uint64_t, uint64_t>, size_t> by_identity;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (inputs[i].size == UINT64_MAX) {
+            continue;
+        }
+        Identity identity = identity_of(inputs[i]);
+        if (!identity.known) {
+            continue;
+        }
+        auto inserted = by_identity.emplace(std::make_pair(identity.device, identity.inode), i);
+        if (!inserted.second) {
+            primary[i] = inserted.first->second;
+        }
+    }
+
+    // Разные файлы одного размера; читаются только такие
+    std::map<uint64_t, std::vector<size_t>> by_size;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (primary[i] == i && inputs[i].size != UINT64_MAX && inputs[i].size >= DEDUPE_HASH_MIN_SIZE) {
+            by_size[inputs[i].size].push_back(i);
+        }
+    }
+    std::vector<size_t> candidates;
+    for (const auto& group : by_size) {
+        if (group.second.size() > 1) {
+            candidates.insert(candidates.end(), group.second.begin(), group.second.end());
+        }
+    }
+    if (candidates.empty()) {
+        return primary;
+    }
+
+    // Сначала хэш начала файла: разные файлы одного размера обычно
+    // различаются уже в нем, и целиком читаются только совпавшие
+    std::vector<Digest> digests(inputs.size());
+    compute_digests(inputs, candidates, DEDUPE_PREFIX_SIZE, threads, digests, reads);
+    keep_collisions(inputs, digests, candidates);
+    std::vector<size_t> longer;
+    for (size_t i : candidates) {
+        if (inputs[i].size > DEDUPE_PREFIX_SIZE) {
+            longer.push_back(i);
+        }
+    }
+    compute_digests(inputs, longer, UINT64_MAX, threads, digests, reads);
+
+    // candidates идут по возрастанию индекса внутри размера, поэтому
+    // основным становится первый из одинаковых
+    std::map<std::tuple<uint64_t, uint32_t, uint64_t>, std::vector<size_t>> by_digest;
+    for (size_t i : candidates) {
+        if (digests[i].known) {
+            by_digest[std::make_tuple(inputs[i].size, digests[i].crc, digests[i].hash)].push_back(i);
+        }
+    }
+
+    // Совпадение хэшей проверяется побайтно, группы - параллельно; каждая
+    // задача меняет primary только у входов своей группы
+    TaskGroup group;
+    ThreadPool::instance().set_limit(group, threads);
+    std::vector<Task> tasks;
+    for (const auto& entry : by_digest) {
+        const std::vector<size_t>& members = entry.second;
+        if (members.size() > 1) {
+            uint64_t cost = std::get<0>(entry.first) * members.size();
+            tasks.push_back(Task{[&inputs, &primary, &reads, &members] { split_by_content(inputs, members, primary, reads); }, cost});
+        }
+    }
+    ThreadPool::instance().submit(std::move(tasks), group);
+    group.wait();
+
+    // жесткие ссылки на дубликат указывают на его основной вход
+    for (size_t i = 0; i < inputs.size(); i++) {
+        primary[i] = primary[primary[i]];
+    }
+    return primary;
+}
@@ -0,0 +1,26 @@
+#ifndef ARCHIVER_DEDUPE_H
+#define ARCHIVER_DEDUPE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "archive_session.h"
+#include "job_stats.h"
+
+// Файлы меньше этого размера сравниваются только по (устройство, inode):
+// читать их ради хэша дороже, чем сжать еще раз
+constexpr uint64_t DEDUPE_HASH_MIN_SIZE = 4 * 1024;
+// Сколько байт с начала файла читается, чтобы отсеять несовпадающие
+constexpr uint64_t DEDUPE_PREFIX_SIZE = 64 * 1024;
+
+// Находит входные файлы с одинаковым содержимым: сначала один и тот же
+// файл - жесткие ссылки или файл, выбранный дважды, по (устройство,
+// inode); затем разные файлы одного размера по CRC-32 и 64-битному хэшу
+// содержимого: сначала начала файла, потом, если оно совпало, целиком.
+// Файлы с совпавшим хэшем считаются одинаковыми, только если совпали и
+// побайтно. Хэши и сравнения выполняются на общем пуле не больше чем в
+// threads задачах; чтение учитывается в reads. Возвращает для каждого входа индекс
+// первого входа с тем же содержимым, у уникальных - собственный индекс.
+std::vector<size_t> find_duplicates(const std::vector<InputFile>& inputs, unsigned threads, StageCounters& reads);
+
+#endif // ARCHIVER_DEDUPE_H
@@ -0,0 +1,100 @@
+#include "dir_walker.h"
+
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "archiver_log.h"
+
+namespace {
+
+std::string join_path(const std::string& dir, const char* name) {
+    if (!dir.empty() && dir.back() == '/') {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+} // namespace
+
+DirWalker::DirWalker(DirectoryCallback on_directory, FilesCallback on_files, const std::atomic<bool>& cancelled, StageCounters& walks)
+    : on_directory(std::move(on_directory)), on_files(std::move(on_files)), cancelled(cancelled), walks(walks) {}
+
+bool DirWalker::start(const std::string& root, TaskGroup& group) {
+    struct stat st;
+    if (stat(root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        LOGE("Not a directory: %s", root.c_str());
+        return false;
+    }
+    submit_walk(root, "", group);
+    return true;
+}
+
+void DirWalker::submit_walk(std::string path, std::string prefix, TaskGroup& group) {
+    // Вес каталога больше любого файла: в пакете обход идет первым
+    std::vector<Task> tasks;
+    tasks.push_back(Task{[this, path = std::move(path), prefix = std::move(prefix), &group] { walk(path, prefix, group); }, UINT64_MAX});
+    ThreadPool::instance().submit(std::move(tasks), group);
+}
+
+void DirWalker::walk(const std::string& path, const std::string& prefix, TaskGroup& group) {
+    if (cancelled) {
+        return;
+    }
+    auto start = JobStats::Clock::now();
+
+    // O_NOFOLLOW: каталог могли заменить ссылкой после чтения родителя
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        LOGE("Failed to read directory: %s", path.c_str());
+        if (fd >= 0) {
+            close(fd);
+        }
+        failures++;
+        return;
+    }
+
+    std::vector<InputFile> files;
+    std::vector<std::pair<std::string, std::string>> subdirs;
+    while (dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        // По d_type ссылки и специальные файлы отсеиваются без stat;
+        // размер и mtime берутся из fstatat относительно каталога
+        if (entry->d_type != DT_REG && entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            std::string child = prefix + name + "/";
+            on_directory(child, st.st_mtime);
+            subdirs.emplace_back(join_path(path, name), std::move(child));
+        } else if (S_ISREG(st.st_mode)) {
+            InputFile input;
+            input.path = join_path(path, name);
+            input.name = prefix + name;
+            input.size = static_cast<uint64_t>(st.st_size);
+            input.mtime = st.st_mtime;
+            files.push_back(std::move(input));
+        }
+    }
+    closedir(dir);
+    walks.add(JobStats::nanos_since(start), 0);
+
+    // Подкаталоги ставятся раньше файлов, чтобы обход шел впереди чтения
+    for (auto& subdir : subdirs) {
+        submit_walk(std::move(subdir.first), std::move(subdir.second), group);
+    }
+    if (!files.empty()) {
+        on_files(std::move(files));
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef ARCHIVER_DIR_WALKER_H
+#define ARCHIVER_DIR_WALKER_H
+
+#include <atomic>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "archive_session.h"
+#include "job_stats.h"
+#include "thread_pool.h"
+
+// Параллельный обход дерева каталогов на общем пуле потоков. Каждый
+// каталог читается отдельной задачей группы, поэтому поддеревья
+// обходятся одновременно, а найденные файлы отдаются в on_files, пока
+// обход еще идет. Символические ссылки не разыменовываются, сокеты,
+// каналы и устройства пропускаются. Имена - пути от корня через '/'.
+// Обратные вызовы приходят из разных потоков пула одновременно.
+class DirWalker {
+public:
+    // name - путь каталога от корня с '/' в конце; корень не сообщается
+    using DirectoryCallback = std::function<void(const std::string& name, time_t mtime)>;
+    // Обычные файлы одного каталога: path, name, size и mtime заполнены
+    using FilesCallback = std::function<void(std::vector<InputFile>&& files)>;
+
+    DirWalker(DirectoryCallback on_directory, FilesCallback on_files, const std::atomic<bool>& cancelled, StageCounters& walks);
+
+    DirWalker(const DirWalker&) = delete;
+    DirWalker& operator=(const DirWalker&) = delete;
+
+    // Ставит обход root в group; конец обхода - group.wait(), объект
+    // должен жить до него. false, если root не каталог.
+    bool start(const std::string& root, TaskGroup& group);
+
+    // Каталоги, которые не удалось прочитать
+    uint64_t failed() const { return failures.load(); }
+
+private:
+    void walk(const std::string& path, const std::string& prefix, TaskGroup& group);
+    void submit_walk(std::string path, std::string prefix, TaskGroup& group);
+
+    DirectoryCallback on_directory;
+    FilesCallback on_files;
+    const std::atomic<bool>& cancelled;
+    StageCounters& walks;
+    std::atomic<uint64_t> failures{0};
+};
+
+#endif // ARCHIVER_DIR_WALKER_H
@@ -0,0 +1,423 @@
+#include "extractor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "archiver_log.h"
+
+namespace {
+
+constexpr size_t IO_BUFFER_SIZE = 256 * 1024;
+
+// Локальный заголовок записи: сигнатура и длины имени и extra-полей,
+// данные идут сразу за ними
+constexpr size_t LOCAL_HEADER_SIZE = 30;
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+
+constexpr zip_uint64_t REQUIRED_STAT = ZIP_STAT_NAME | ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_CRC |
+                                       ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+
+// Буферы потоков пула, живут между записями
+thread_local std::vector<unsigned char> read_buffer;
+thread_local std::vector<unsigned char> write_buffer;
+
+uint16_t read_le16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+uint32_t read_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+bool pread_fully(int fd, unsigned char* buffer, size_t length, uint64_t offset, StageCounters& reads) {
+    size_t done = 0;
+    while (done < length) {
+        auto start = JobStats::Clock::now();
+        ssize_t n = pread(fd, buffer + done, length - done, static_cast<off_t>(offset + done));
+        reads.add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool write_fully(int fd, const unsigned char* data, size_t length, StageCounters& writes) {
+    while (length > 0) {
+        auto start = JobStats::Clock::now();
+        ssize_t n = write(fd, data, length);
+        writes.add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Последовательное чтение диапазона архива через pread. Позиция хранится
+// здесь, а не в дескрипторе, поэтому читатели в разных потоках не мешают
+// друг другу.
+class PreadReader {
+public:
+    PreadReader(int fd, uint64_t offset, uint64_t length, StageCounters& reads)
+        : fd(fd), offset(offset), remaining(length), reads(reads) {
+        if (read_buffer.size() < IO_BUFFER_SIZE) {
+            read_buffer.resize(IO_BUFFER_SIZE);
+        }
+    }
+
+    bool done() const { return remaining == 0; }
+
+    // Следующий кусок диапазона; false при ошибке чтения или если архив короче
+    bool next(const unsigned char*& data, size_t& length) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, read_buffer.size()));
+        ssize_t n;
+        do {
+            auto start = JobStats::Clock::now();
+            n = pread(fd, read_buffer.data(), want, static_cast<off_t>(offset));
+            reads.add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            return false;
+        }
+        data = read_buffer.data();
+        length = static_cast<size_t>(n);
+        offset += length;
+        remaining -= length;
+        return true;
+    }
+
+private:
+    int fd;
+    uint64_t offset;
+    uint64_t remaining;
+    StageCounters& reads;
+};
+
+// Файл распаковки: считает CRC и размер записанного, удаляется при неудаче
+class OutputFile {
+public:
+    OutputFile(const ExtractEntry& entry, StageCounters& writes) : entry(entry), writes(writes) {
+        fd = open(entry.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOGE("Failed to create %s: %s", entry.path.c_str(), strerror(errno));
+            return;
+        }
+        // место под файл целиком сразу: меньше фрагментации и ранний ENOSPC;
+        // файловые системы без fallocate просто пропускаем
+        if (entry.size > 0) {
+            int err = posix_fallocate(fd, 0, static_cast<off_t>(entry.size));
+            if (err == ENOSPC) {
+                LOGE("No space for %s (%llu bytes)", entry.path.c_str(), static_cast<unsigned long long>(entry.size));
+                close(fd);
+                unlink(entry.path.c_str());
+                fd = -1;
+            }
+        }
+    }
+
+    ~OutputFile() {
+        if (fd >= 0) {
+            close(fd);
+            unlink(entry.path.c_str());
+        }
+    }
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool is_open() const { return fd >= 0; }
+
+    bool write(const unsigned char* data, size_t length, std::atomic<uint64_t>& bytes_done) {
+        if (written + length > entry.size) {
+            LOGE("Entry %s is larger than its directory record", entry.path.c_str());
+            return false;
+        }
+        if (!write_fully(fd, data, length, writes)) {
+            LOGE("Failed to write %s: %s", entry.path.c_str(), strerror(errno));
+            return false;
+        }
+        crc = zip_crc32(crc, data, length);
+        written += length;
+        bytes_done += length;
+        return true;
+    }
+
+    // Сверяет размер и CRC (если check_crc), ставит время изменения и закрывает файл
+    bool commit(bool check_crc) {
+        if (written != entry.size || (check_crc && crc != entry.crc)) {
+            LOGE("Data of %s is corrupted", entry.path.c_str());
+            return false;
+        }
+        if (entry.mtime > 0) {
+            struct timespec times[2] = {{entry.mtime, 0}, {entry.mtime, 0}};
+            futimens(fd, times);
+        }
+        int err = close(fd);
+        fd = -1;
+        if (err != 0) {
+            LOGE("Failed to close %s: %s", entry.path.c_str(), strerror(errno));
+            unlink(entry.path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const ExtractEntry& entry;
+    StageCounters& writes;
+    int fd = -1;
+    uint32_t crc = 0;
+    uint64_t written = 0;
+};
+
+bool copy_stored(PreadReader& reader, OutputFile& output, const std::atomic<bool>& cancelled, std::atomic<uint64_t>& bytes_done) {
+    while (!reader.done()) {
+        const unsigned char* data;
+        size_t length;
+        if (cancelled || !reader.next(data, length) || !output.write(data, length, bytes_done)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool inflate_raw(PreadReader& reader, OutputFile& output, const std::atomic<bool>& cancelled, std::atomic<uint64_t>& bytes_done) {
+    if (write_buffer.size() < IO_BUFFER_SIZE) {
+        write_buffer.resize(IO_BUFFER_SIZE);
+    }
+
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        return false;
+    }
+
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END && !reader.done()) {
+        const unsigned char* data;
+        size_t length;
+        if (cancelled || !reader.next(data, length)) {
+            break;
+        }
+        stream.next_in = const_cast<Bytef*>(data);
+        stream.avail_in = static_cast<uInt>(length);
+
+        do {
+            stream.next_out = write_buffer.data();
+            stream.avail_out = static_cast<uInt>(write_buffer.size());
+            ret = inflate(&stream, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                break;
+            }
+            size_t produced = write_buffer.size() - stream.avail_out;
+            if (produced > 0 && !output.write(write_buffer.data(), produced, bytes_done)) {
+                ret = Z_ERRNO;
+                break;
+            }
+        } while (ret != Z_STREAM_END && stream.avail_out == 0);
+
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            break;
+        }
+    }
+
+    inflateEnd(&stream);
+    return ret == Z_STREAM_END;
+}
+
+// Смещение данных записи: локальный заголовок плюс имя и extra-поля,
+// длины которых могут отличаться от центрального каталога
+bool data_offset(int archive_fd, const ExtractEntry& entry, uint64_t& offset, StageCounters& reads) {
+    unsigned char header[LOCAL_HEADER_SIZE];
+    if (!pread_fully(archive_fd, header, sizeof(header), entry.header_offset, reads) || read_le32(header) != LOCAL_HEADER_SIGNATURE) {
+        return false;
+    }
+    offset = entry.header_offset + LOCAL_HEADER_SIZE + read_le16(header + 26) + read_le16(header + 28);
+    return true;
+}
+
+// Создает каталог и все недостающие родительские
+bool make_directories(const std::string& path) {
+    for (size_t pos = 1; pos <= path.size(); pos++) {
+        if (pos != path.size() && path[pos] != '/') {
+            continue;
+        }
+        std::string prefix = path.substr(0, pos);
+        if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+            struct stat st;
+            if (stat(prefix.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                LOGE("Failed to create directory %s: %s", prefix.c_str(), strerror(errno));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Нормализует имя записи в относительный путь без "." и пустых частей.
+// false, если имя выводит за пределы каталога распаковки.
+bool relative_path(const char* name, std::string& path) {
+    path.clear();
+    std::string part;
+    for (const char* p = name;; p++) {
+        if (*p != '/' && *p != '\0') {
+            part += *p;
+            continue;
+        }
+        if (part == "..") {
+            return false;
+        }
+        if (!part.empty() && part != ".") {
+            if (!path.empty()) {
+                path += '/';
+            }
+            path += part;
+        }
+        part.clear();
+        if (*p == '\0') {
+            return true;
+        }
+    }
+}
+
+} // namespace
+
+bool plan_extraction(zip_t* zip, const std::string& output_dir, std::vector<ExtractEntry>& files) {
+    if (!make_directories(output_dir)) {
+        return false;
+    }
+
+    zip_int64_t count = zip_get_num_entries(zip, 0);
+    std::unordered_map<std::string, size_t> by_path;
+    files.reserve(static_cast<size_t>(count));
+
+    for (zip_int64_t i = 0; i < count; i++) {
+        zip_stat_t st;
+        if (zip_stat_index(zip, static_cast<zip_uint64_t>(i), 0, &st) < 0 || (st.valid & ZIP_STAT_NAME) == 0) {
+            LOGE("Failed to stat entry %lld: %s", static_cast<long long>(i), zip_strerror(zip));
+            return false;
+        }
+
+        std::string relative;
+        if (!relative_path(st.name, relative)) {
+            LOGE("Entry name leaves output directory: %s", st.name);
+            return false;
+        }
+        if (relative.empty()) {
+            continue;
+        }
+
+        std::string path = output_dir + "/" + relative;
+        size_t name_length = strlen(st.name);
+        if (st.name[name_length - 1] == '/') {
+            if (!make_directories(path)) {
+                return false;
+            }
+            continue;
+        }
+        if (!make_directories(path.substr(0, path.find_last_of('/')))) {
+            return false;
+        }
+
+        ExtractEntry entry;
+        entry.index = static_cast<zip_uint64_t>(i);
+        entry.path = std::move(path);
+        entry.size = (st.valid & ZIP_STAT_SIZE) ? st.size : 0;
+        entry.comp_size = (st.valid & ZIP_STAT_COMP_SIZE) ? st.comp_size : 0;
+        entry.crc = (st.valid & ZIP_STAT_CRC) ? st.crc : 0;
+        entry.method = (st.valid & ZIP_STAT_COMP_METHOD) ? st.comp_method : ZIP_CM_STORE;
+        entry.mtime = (st.valid & ZIP_STAT_MTIME) ? st.mtime : 0;
+        entry.parallel = (st.valid & REQUIRED_STAT) == REQUIRED_STAT && st.encryption_method == ZIP_EM_NONE &&
+                         (st.comp_method == ZIP_CM_STORE || st.comp_method == ZIP_CM_DEFLATE);
+        if (entry.parallel) {
+            zip_int64_t offset = zip_file_get_local_header_offset(zip, entry.index, 0);
+            if (offset < 0) {
+                LOGE("No local header offset for %s: %s", st.name, zip_strerror(zip));
+                return false;
+            }
+            entry.header_offset = static_cast<uint64_t>(offset);
+        }
+
+        auto it = by_path.find(entry.path);
+        if (it != by_path.end()) {
+            files[it->second] = std::move(entry);
+        } else {
+            by_path.emplace(entry.path, files.size());
+            files.push_back(std::move(entry));
+        }
+    }
+    return true;
+}
+
+bool extract_entry(int archive_fd, const ExtractEntry& entry, const std::atomic<bool>& cancelled, std::atomic<uint64_t>& bytes_done, JobStats& stats) {
+    StageCounters& reads = stats.stage(Stage::Read);
+    uint64_t offset;
+    if (!data_offset(archive_fd, entry, offset, reads)) {
+        LOGE("Bad local header for %s", entry.path.c_str());
+        return false;
+    }
+
+    OutputFile output(entry, stats.stage(Stage::Write));
+    if (!output.is_open()) {
+        return false;
+    }
+
+    PreadReader reader(archive_fd, offset, entry.comp_size, reads);
+    bool ok = entry.method == ZIP_CM_STORE ? copy_stored(reader, output, cancelled, bytes_done)
+                                           : inflate_raw(reader, output, cancelled, bytes_done);
+    if (!ok) {
+        if (!cancelled) {
+            LOGE("Failed to extract %s", entry.path.c_str());
+        }
+        return false;
+    }
+
+    LOGD("Extracted: %s", entry.path.c_str());
+    return output.commit(true);
+}
+
+bool extract_entry_with_libzip(zip_t* zip, const ExtractEntry& entry, const std::atomic<bool>& cancelled, std::atomic<uint64_t>& bytes_done, JobStats& stats) {
+    if (write_buffer.size() < IO_BUFFER_SIZE) {
+        write_buffer.resize(IO_BUFFER_SIZE);
+    }
+
+    zip_file_t* file = zip_fopen_index(zip, entry.index, 0);
+    if (!file) {
+        LOGE("Failed to open entry %s: %s", entry.path.c_str(), zip_strerror(zip));
+        return false;
+    }
+
+    OutputFile output(entry, stats.stage(Stage::Write));
+    bool ok = output.is_open();
+    while (ok && !cancelled) {
+        // CRC проверяет сам libzip при чтении последнего блока
+        zip_int64_t n = zip_fread(file, write_buffer.data(), write_buffer.size());
+        if (n < 0) {
+            LOGE("Failed to read entry %s: %s", entry.path.c_str(), zip_file_strerror(file));
+            ok = false;
+        } else if (n == 0) {
+            break;
+        } else {
+            ok = output.write(write_buffer.data(), static_cast<size_t>(n), bytes_done);
+        }
+    }
+    zip_fclose(file);
+
+    return ok && !cancelled && output.commit(false);
+}
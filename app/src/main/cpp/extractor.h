@@ -0,0 +1,44 @@
+#ifndef ARCHIVER_EXTRACTOR_H
+#define ARCHIVER_EXTRACTOR_H
+
+#include <zip.h>
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "job_stats.h"
+
+// Запись архива для распаковки. Все, что нужно потоку распаковки, берется
+// из центрального каталога заранее, поэтому потоки не обращаются к zip_t.
+struct ExtractEntry {
+    zip_uint64_t index = 0;
+    std::string path;            // куда писать файл
+    uint64_t header_offset = 0;  // локальный заголовок в архиве
+    uint64_t comp_size = 0;
+    uint64_t size = 0;
+    uint32_t crc = 0;
+    uint16_t method = ZIP_CM_STORE;
+    time_t mtime = 0;
+    bool parallel = false;       // store или deflate без шифрования, читается через pread
+};
+
+// Читает центральный каталог открытого архива, создает каталоги внутри
+// output_dir и возвращает файлы для распаковки. Имена с абсолютным путем
+// или с ".." отклоняются; при повторе имени остается последняя запись.
+bool plan_extraction(zip_t* zip, const std::string& output_dir, std::vector<ExtractEntry>& files);
+
+// Распаковывает запись, читая сжатые данные через pread из archive_fd:
+// у каждого потока свой буфер и своя позиция, общей позиции дескриптора
+// нет. Файл заранее выделяется на полный размер. Можно вызывать из
+// нескольких потоков одновременно; при ошибке или отмене файл удаляется.
+// Системные вызовы чтения и записи учитываются в стадиях Read и Write.
+bool extract_entry(int archive_fd, const ExtractEntry& entry, const std::atomic<bool>& cancelled, std::atomic<uint64_t>& bytes_done, JobStats& stats);
+
+// То же через zip_fopen_index для шифрованных записей и прочих методов
+// сжатия; только из потока, которому принадлежит zip.
+bool extract_entry_with_libzip(zip_t* zip, const ExtractEntry& entry, const std::atomic<bool>& cancelled, std::atomic<uint64_t>& bytes_done, JobStats& stats);
+
+#endif // ARCHIVER_EXTRACTOR_H
@@ -0,0 +1,300 @@
+#include "fd_source.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct FdSource {
+    int fd;
+    bool seekable;       // обычный файл, читаем через pread
+    zip_uint64_t size;   // только для seekable
+    time_t mtime;
+    zip_uint64_t offset = 0;
+    StageCounters* reads = nullptr;
+    zip_error_t error;
+};
+
+zip_int64_t fd_source_callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    auto* ctx = static_cast<FdSource*>(userdata);
+
+    switch (cmd) {
+        case ZIP_SOURCE_OPEN:
+            ctx->offset = 0;
+            return 0;
+
+        case ZIP_SOURCE_READ: {
+            ssize_t n;
+            auto start = JobStats::Clock::now();
+            if (ctx->seekable) {
+                if (ctx->offset >= ctx->size) {
+                    return 0;
+                }
+                if (len > ctx->size - ctx->offset) {
+                    len = ctx->size - ctx->offset;
+                }
+                do {
+                    n = pread(ctx->fd, data, len, static_cast<off_t>(ctx->offset));
+                } while (n < 0 && errno == EINTR);
+            } else {
+                do {
+                    n = read(ctx->fd, data, len);
+                } while (n < 0 && errno == EINTR);
+            }
+            if (n < 0) {
+                zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+                return -1;
+            }
+            if (ctx->reads) {
+                ctx->reads->add(JobStats::nanos_since(start), static_cast<uint64_t>(n));
+            }
+            ctx->offset += static_cast<zip_uint64_t>(n);
+            return n;
+        }
+
+        case ZIP_SOURCE_CLOSE:
+            return 0;
+
+        case ZIP_SOURCE_STAT: {
+            auto* st = static_cast<zip_stat_t*>(data);
+            zip_stat_init(st);
+            st->mtime = ctx->mtime;
+            st->valid |= ZIP_STAT_MTIME;
+            if (ctx->seekable) {
+                st->size = ctx->size;
+                st->valid |= ZIP_STAT_SIZE;
+            }
+            return sizeof(*st);
+        }
+
+        case ZIP_SOURCE_SEEK: {
+            zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->size, data, len, &ctx->error);
+            if (new_offset < 0) {
+                return -1;
+            }
+            ctx->offset = static_cast<zip_uint64_t>(new_offset);
+            return 0;
+        }
+
+        case ZIP_SOURCE_TELL:
+            return static_cast<zip_int64_t>(ctx->offset);
+
+        case ZIP_SOURCE_ERROR:
+            return zip_error_to_data(&ctx->error, data, len);
+
+        case ZIP_SOURCE_FREE:
+            close(ctx->fd);
+            zip_error_fini(&ctx->error);
+            delete ctx;
+            return 0;
+
+        case ZIP_SOURCE_SUPPORTS:
+            if (ctx->seekable) {
+                return ZIP_SOURCE_SUPPORTS_SEEKABLE;
+            }
+            return zip_source_make_command_bitmap(ZIP_SOURCE_OPEN, ZIP_SOURCE_READ, ZIP_SOURCE_CLOSE, ZIP_SOURCE_STAT, ZIP_SOURCE_ERROR, ZIP_SOURCE_FREE, -1);
+
+        default:
+            zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+            return -1;
+    }
+}
+
+struct FdOutput {
+    int fd;
+    bool seekable;          // обычный файл, пишем через pwrite
+    zip_uint64_t offset = 0;
+    zip_uint64_t end = 0;   // сколько байт архива записано
+    StageCounters* writes = nullptr;
+    zip_error_t error;
+};
+
+bool write_fully(FdOutput* ctx, const char* data, zip_uint64_t len) {
+    while (len > 0) {
+        ssize_t n;
+        auto start = JobStats::Clock::now();
+        if (ctx->seekable) {
+            n = pwrite(ctx->fd, data, len, static_cast<off_t>(ctx->offset));
+        } else {
+            n = write(ctx->fd, data, len);
+        }
+        if (ctx->writes) {
+            ctx->writes->add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, n < 0 ? errno : EIO);
+            return false;
+        }
+        data += n;
+        len -= static_cast<zip_uint64_t>(n);
+        ctx->offset += static_cast<zip_uint64_t>(n);
+    }
+    if (ctx->offset > ctx->end) {
+        ctx->end = ctx->offset;
+    }
+    return true;
+}
+
+zip_int64_t fd_output_callback(void* userdata, void* data, zip_uint64_t len, zip_source_cmd_t cmd) {
+    auto* ctx = static_cast<FdOutput*>(userdata);
+
+    switch (cmd) {
+        case ZIP_SOURCE_BEGIN_WRITE:
+            // "wt" уже обрезает файл, но не все провайдеры это соблюдают
+            if (ctx->seekable && ftruncate(ctx->fd, 0) < 0) {
+                zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+                return -1;
+            }
+            ctx->offset = 0;
+            ctx->end = 0;
+            return 0;
+
+        case ZIP_SOURCE_WRITE:
+            if (len > ZIP_INT64_MAX) {
+                zip_error_set(&ctx->error, ZIP_ER_INVAL, 0);
+                return -1;
+            }
+            if (!write_fully(ctx, static_cast<const char*>(data), len)) {
+                return -1;
+            }
+            return static_cast<zip_int64_t>(len);
+
+        case ZIP_SOURCE_SEEK_WRITE: {
+            zip_int64_t new_offset = zip_source_seek_compute_offset(ctx->offset, ctx->end, data, len, &ctx->error);
+            if (new_offset < 0) {
+                return -1;
+            }
+            ctx->offset = static_cast<zip_uint64_t>(new_offset);
+            return 0;
+        }
+
+        case ZIP_SOURCE_TELL_WRITE:
+            return static_cast<zip_int64_t>(ctx->offset);
+
+        case ZIP_SOURCE_COMMIT_WRITE:
+            if (ctx->seekable && fsync(ctx->fd) < 0) {
+                zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+                return -1;
+            }
+            return 0;
+
+        case ZIP_SOURCE_ROLLBACK_WRITE:
+            // недописанный архив не оставляем; из канала записанное не вернуть
+            if (ctx->seekable) {
+                (void)ftruncate(ctx->fd, 0);
+            }
+            return 0;
+
+        case ZIP_SOURCE_ERROR:
+            return zip_error_to_data(&ctx->error, data, len);
+
+        case ZIP_SOURCE_FREE:
+            close(ctx->fd);
+            zip_error_fini(&ctx->error);
+            delete ctx;
+            return 0;
+
+        case ZIP_SOURCE_SUPPORTS:
+            if (ctx->seekable) {
+                return ZIP_SOURCE_SUPPORTS_STREAM_WRITABLE | zip_source_make_command_bitmap(ZIP_SOURCE_SEEK_WRITE, -1);
+            }
+            return ZIP_SOURCE_SUPPORTS_STREAM_WRITABLE;
+
+        default:
+            zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+            return -1;
+    }
+}
+
+} // namespace
+
+zip_source_t* fd_output_source_create(int fd, zip_error_t* error, StageCounters* writes) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        zip_error_set(error, ZIP_ER_OPEN, errno);
+        return nullptr;
+    }
+
+    // pwrite годится только для обычных файлов, в которых работает lseek
+    bool seekable = S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) >= 0;
+    auto* ctx = new FdOutput{fd, seekable, 0, 0, writes, {}};
+    zip_error_init(&ctx->error);
+
+    zip_source_t* source = zip_source_function_create(fd_output_callback, ctx, error);
+    if (!source) {
+        zip_error_fini(&ctx->error);
+        delete ctx;
+    }
+    return source;
+}
+
+zip_source_t* fd_source_create(zip_t* zip, int fd, StageCounters* reads) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        zip_error_set(zip_get_error(zip), ZIP_ER_READ, errno);
+        return nullptr;
+    }
+
+    auto* ctx = new FdSource{fd, S_ISREG(st.st_mode), 0, st.st_mtime, 0, reads, {}};
+    if (ctx->seekable) {
+        ctx->size = static_cast<zip_uint64_t>(st.st_size);
+    }
+    zip_error_init(&ctx->error);
+
+    zip_source_t* source = zip_source_function(zip, fd_source_callback, ctx);
+    if (!source) {
+        zip_error_fini(&ctx->error);
+        delete ctx;
+    }
+    return source;
+}
+
+bool fd_read_fully(int fd, char* buffer, uint64_t size, StageCounters* reads) {
+    uint64_t done = 0;
+    while (done < size) {
+        auto start = JobStats::Clock::now();
+        ssize_t n = pread(fd, buffer + done, size - done, static_cast<off_t>(done));
+        if (reads) {
+            reads->add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool fd_crc32(int fd, uint64_t size, uint32_t& crc, StageCounters* reads) {
+    constexpr size_t CHUNK_SIZE = 256 * 1024;
+    std::vector<unsigned char> buffer(static_cast<size_t>(std::min<uint64_t>(size, CHUNK_SIZE)));
+    uint32_t value = 0;
+    uint64_t done = 0;
+    while (done < size) {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(size - done, buffer.size()));
+        auto start = JobStats::Clock::now();
+        ssize_t n = pread(fd, buffer.data(), length, static_cast<off_t>(done));
+        if (reads) {
+            reads->add(JobStats::nanos_since(start), n > 0 ? static_cast<uint64_t>(n) : 0);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        value = zip_crc32(value, buffer.data(), static_cast<uint64_t>(n));
+        done += static_cast<uint64_t>(n);
+    }
+    crc = value;
+    return true;
+}
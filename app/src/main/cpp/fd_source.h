@@ -0,0 +1,39 @@
+#ifndef ARCHIVER_FD_SOURCE_H
+#define ARCHIVER_FD_SOURCE_H
+
+#include <zip.h>
+
+#include <cstdint>
+#include <ctime>
+
+#include "job_stats.h"
+
+// Источник libzip поверх файлового дескриптора (например, из
+// ParcelFileDescriptor.detachFd()). Обычные файлы читаются через pread,
+// поэтому источник не зависит от позиции дескриптора и его можно читать
+// из потока сжатия; для каналов и сокетов используется read() без
+// известного размера. Источник владеет fd и закрывает его при освобождении.
+// При ошибке создания fd остается у вызывающего. Если reads задан, каждый
+// системный вызов чтения добавляется к нему.
+zip_source_t* fd_source_create(zip_t* zip, int fd, StageCounters* reads = nullptr);
+
+// Источник libzip для записи архива в дескриптор (например, файл SAF из
+// openFileDescriptor(uri, "wt")). Если fd - обычный файл, источник
+// поддерживает seek_write и libzip дописывает размеры в локальные
+// заголовки; в канал или сокет архив пишется потоком, а размеры и CRC
+// идут в дескрипторы данных после каждого файла. Архив открывается через
+// zip_open_from_source(source, ZIP_TRUNCATE, ...). Источник владеет fd и
+// закрывает его при освобождении; при ошибке создания fd остается у
+// вызывающего. Если writes задан, каждый системный вызов записи
+// добавляется к нему.
+zip_source_t* fd_output_source_create(int fd, zip_error_t* error, StageCounters* writes = nullptr);
+
+// Читает весь обычный файл из fd в buffer начиная со смещения 0.
+// Возвращает false при ошибке чтения или если файл оказался короче size.
+bool fd_read_fully(int fd, char* buffer, uint64_t size, StageCounters* reads = nullptr);
+
+// Считает CRC-32 первых size байт обычного файла через pread, не сдвигая
+// позицию fd. Возвращает false при ошибке чтения или если файл короче size.
+bool fd_crc32(int fd, uint64_t size, uint32_t& crc, StageCounters* reads = nullptr);
+
+#endif // ARCHIVER_FD_SOURCE_H
@@ -0,0 +1,66 @@
+#include "job_stats.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr size_t HEADER_FIELDS = 4;
+constexpr size_t STAGE_FIELDS = 3;
+constexpr size_t ENTRY_FIELDS = 5;
+
+} // namespace
+
+void JobStats::reset() {
+    for (auto& counters : stages) {
+        counters.nanos = 0;
+        counters.bytes = 0;
+        counters.calls = 0;
+    }
+    queue_high_water = 0;
+
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    entries.clear();
+}
+
+void JobStats::add_entry(const EntryStats& entry) {
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    entries.push_back(entry);
+}
+
+void JobStats::note_queue_depth(uint64_t depth) {
+    uint64_t current = queue_high_water.load(std::memory_order_relaxed);
+    while (depth > current && !queue_high_water.compare_exchange_weak(current, depth, std::memory_order_relaxed)) {
+    }
+}
+
+size_t JobStats::serialize(void* out, size_t capacity) {
+    std::lock_guard<std::mutex> lock(entries_mutex);
+
+    constexpr size_t stage_count = static_cast<size_t>(Stage::Count);
+    size_t fields = HEADER_FIELDS + stage_count * STAGE_FIELDS + entries.size() * ENTRY_FIELDS;
+    size_t size = fields * sizeof(int64_t);
+    if (capacity < size) {
+        return size;
+    }
+
+    std::vector<int64_t> values;
+    values.reserve(fields);
+    values.push_back(FORMAT_VERSION);
+    values.push_back(static_cast<int64_t>(stage_count));
+    values.push_back(static_cast<int64_t>(entries.size()));
+    values.push_back(static_cast<int64_t>(queue_high_water.load()));
+    for (const auto& counters : stages) {
+        values.push_back(static_cast<int64_t>(counters.nanos.load()));
+        values.push_back(static_cast<int64_t>(counters.bytes.load()));
+        values.push_back(static_cast<int64_t>(counters.calls.load()));
+    }
+    for (const auto& entry : entries) {
+        values.push_back(static_cast<int64_t>(entry.index));
+        values.push_back(static_cast<int64_t>(entry.size));
+        values.push_back(static_cast<int64_t>(entry.comp_size));
+        values.push_back(static_cast<int64_t>(entry.method));
+        values.push_back(static_cast<int64_t>(entry.nanos));
+    }
+    memcpy(out, values.data(), size);
+    return size;
+}
@@ -0,0 +1,116 @@
+#ifndef ARCHIVER_JOB_STATS_H
+#define ARCHIVER_JOB_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Стадии конвейера. Порядок и номера совпадают с JobStats.Stage в Kotlin,
+// новые стадии добавляются только в конец.
+enum class Stage : uint32_t {
+    Job,         // задание целиком; bytes - данные файлов, calls - файлы
+    Read,        // чтение входных данных: файлов в память или архива при распаковке; calls - системные вызовы
+    QueueWait,   // ожидание файлов в очереди до writer; bytes - данные в памяти, calls - файлы
+    Add,         // создание источников и zip_file_add в writer
+    Close,       // zip_close целиком: сжатие, чтение потоковых файлов и запись
+    StreamRead,  // чтение потоковых файлов из дескрипторов внутри zip_close; calls - системные вызовы.
+                 // Файлы по пути читает сам libzip, они здесь не учитываются
+    Write,       // запись архива в дескриптор (createZipFromFds) или распакованных файлов; calls - системные вызовы
+    Plan,        // распаковка: центральный каталог и создание каталогов; обновление: сравнение файлов с архивом;
+                 // архивация: поиск одинаковых файлов
+    Extract,     // распаковка записей, сумма по потокам; calls - записи
+    Cache,       // поиск файлов в кэше сжатых данных и сжатие новых в кэш; calls - файлы
+    Dedupe,      // сжатие в память файлов, у которых в архиве есть копии; calls - файлы
+    Walk,        // обход дерева каталогов, сумма по потокам; calls - каталоги
+    Compress,    // сжатие в память на задачах пула во время обхода дерева каталогов; calls - файлы
+    Count
+};
+
+// Время, объем и число операций одной стадии. Обновляется из любых
+// потоков, в том числе из потоков сжатия libzip.
+struct StageCounters {
+    std::atomic<uint64_t> nanos{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> calls{0};
+
+    void add(uint64_t elapsed_nanos, uint64_t byte_count, uint64_t call_count = 1) {
+        nanos.fetch_add(elapsed_nanos, std::memory_order_relaxed);
+        bytes.fetch_add(byte_count, std::memory_order_relaxed);
+        calls.fetch_add(call_count, std::memory_order_relaxed);
+    }
+};
+
+// Запись архива: размер до и после сжатия и время от предыдущей записи.
+// При параллельном zip_close время включает ожидание сжатия этой записи.
+struct EntryStats {
+    uint64_t index = 0;
+    uint64_t size = 0;
+    uint64_t comp_size = 0;
+    uint32_t method = 0;
+    uint64_t nanos = 0;
+};
+
+// Подробная статистика последнего задания сессии
+class JobStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Версия формата serialize(); меняется при изменении заголовка или полей записи
+    static constexpr int64_t FORMAT_VERSION = 1;
+
+    JobStats() = default;
+
+    JobStats(const JobStats&) = delete;
+    JobStats& operator=(const JobStats&) = delete;
+
+    void reset();
+
+    StageCounters& stage(Stage stage) { return stages[static_cast<size_t>(stage)]; }
+
+    void add_entry(const EntryStats& entry);
+    void note_queue_depth(uint64_t depth);
+
+    static uint64_t nanos_since(Clock::time_point start) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    // Записывает статистику в out массивом int64 в порядке байт платформы:
+    // версия, число стадий, число записей, пик очереди; затем по стадиям
+    // nanos, bytes, calls; затем по записям index, size, comp_size, method,
+    // nanos. Возвращает нужный размер в байтах; если capacity меньше,
+    // ничего не пишет.
+    size_t serialize(void* out, size_t capacity);
+
+private:
+    StageCounters stages[static_cast<size_t>(Stage::Count)];
+    std::atomic<uint64_t> queue_high_water{0};
+
+    std::mutex entries_mutex;
+    std::vector<EntryStats> entries;
+};
+
+// Добавляет время своей жизни к стадии
+class StageTimer {
+public:
+    StageTimer(JobStats& stats, Stage stage, uint64_t bytes = 0, uint64_t calls = 1)
+        : counters(stats.stage(stage)), bytes(bytes), calls(calls), start(JobStats::Clock::now()) {}
+
+    ~StageTimer() { counters.add(JobStats::nanos_since(start), bytes, calls); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    void set_bytes(uint64_t byte_count) { bytes = byte_count; }
+    void set_calls(uint64_t call_count) { calls = call_count; }
+
+private:
+    StageCounters& counters;
+    uint64_t bytes;
+    uint64_t calls;
+    JobStats::Clock::time_point start;
+};
+
+#endif // ARCHIVER_JOB_STATS_H
@@ -0,0 +1,867 @@
+/*
+  microbench.c -- microbenchmarks for libzip internals
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Times hot internal code paths of libzip in isolation: CRC computation
+   in zip_source_crc and _zip_write(), the name hash table, central
+   directory entry parsing, finding and reading the central directory in
+   zip_open(), and the BUFSIZE copy loops of zip_close().
+
+   Each benchmark runs over a range of input sizes or entry counts and
+   prints nanoseconds per operation, bytes per CPU cycle (where bytes are
+   meaningful and a cycle counter is available) and allocations per
+   operation. The program links a private static copy of libzip, so it
+   can call functions that are not exported from the shared library. */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef HAVE_GETOPT
+#include "getopt.h"
+#endif
+
+#include "zipint.h"
+
+#include "alloc_count.h"
+
+#define DEFAULT_MAX_ENTRIES 1000000
+#define DEFAULT_MAX_SIZE (16 * 1024 * 1024)
+#define DEFAULT_MIN_TIME 0.2
+
+static const char *usage = "usage: %s [-h] [-n max-entries] [-s max-size] [-t seconds] [benchmark ...]\n";
+
+static const char *help = "\n"
+                          "  -h       display this help message\n"
+                          "  -n N     largest entry count (default 1000000)\n"
+                          "  -s N     largest input size in bytes (default 16777216)\n"
+                          "  -t SECS  minimum measuring time per case (default 0.2)\n";
+
+static const char *progname;
+static zip_uint64_t max_entries = DEFAULT_MAX_ENTRIES;
+static zip_uint64_t max_size = DEFAULT_MAX_SIZE;
+static double min_time = DEFAULT_MIN_TIME;
+
+
+/* cycle counter: hardware cycles via perf where permitted, else the time stamp counter */
+
+static const char *cycle_source = "none";
+#ifdef __linux__
+static int cycle_fd = -1;
+#endif
+
+static void
+cycles_init(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    cycle_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (cycle_fd >= 0) {
+        cycle_source = "perf cpu-cycles";
+        return;
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    cycle_source = "tsc";
+#endif
+}
+
+
+static zip_uint64_t
+cycles_now(void) {
+#ifdef __linux__
+    if (cycle_fd >= 0) {
+        zip_uint64_t count;
+        if (read(cycle_fd, &count, sizeof(count)) == sizeof(count)) {
+            return count;
+        }
+    }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static double
+seconds_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+
+/* One call of a benchmark body performs ops operations on bytes bytes of input. */
+typedef int (*body_fn)(void *ud);
+
+static int
+measure(const char *name, zip_uint64_t param, zip_uint64_t ops, zip_uint64_t bytes, body_fn body, void *ud) {
+    zip_uint64_t calls, cycles_start, cycles;
+    size_t allocs_start;
+    double start, elapsed;
+
+    /* warm up caches and lazily allocated state */
+    if (body(ud) < 0) {
+        fprintf(stderr, "%s: %s %" PRIu64 " failed\n", progname, name, param);
+        return -1;
+    }
+
+    calls = 0;
+    allocs_start = alloc_count;
+    cycles_start = cycles_now();
+    start = seconds_now();
+    do {
+        if (body(ud) < 0) {
+            fprintf(stderr, "%s: %s %" PRIu64 " failed\n", progname, name, param);
+            return -1;
+        }
+        calls++;
+        elapsed = seconds_now() - start;
+    } while (elapsed < min_time);
+    cycles = cycles_now() - cycles_start;
+
+    printf("%-14s %10" PRIu64 " %12.1f", name, param, elapsed * 1e9 / (double)(calls * ops));
+    if (bytes > 0 && cycles > 0) {
+        printf(" %12.3f", (double)(calls * bytes) / (double)cycles);
+    }
+    else {
+        printf(" %12s", "-");
+    }
+    printf(" %12.3f\n", (double)(alloc_count - allocs_start) / (double)(calls * ops));
+    fflush(stdout);
+    return 0;
+}
+
+
+static zip_uint8_t *
+make_data(zip_uint64_t size) {
+    zip_uint8_t *data;
+    zip_uint64_t i;
+    zip_uint32_t x = 2463534242u;
+
+    if ((data = (zip_uint8_t *)malloc(size > 0 ? size : 1)) == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[i] = (zip_uint8_t)x;
+    }
+    return data;
+}
+
+
+static char **
+make_names(zip_uint64_t n, const char *prefix) {
+    char **names;
+    zip_uint64_t i;
+
+    if ((names = (char **)malloc(sizeof(names[0]) * (n > 0 ? n : 1))) == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < n; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%sdir%04" PRIu64 "/file%07" PRIu64 ".txt", prefix, i / 1000, i);
+        if ((names[i] = strdup(name)) == NULL) {
+            return NULL;
+        }
+    }
+    return names;
+}
+
+
+static void
+free_names(char **names, zip_uint64_t n) {
+    zip_uint64_t i;
+
+    if (names == NULL) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+
+/* Builds an archive of n empty stored entries directly, so that a million
+   entries don't need a million sources; uses Zip64 end of central
+   directory records above 0xffff entries. */
+
+typedef struct {
+    zip_uint8_t *data;
+    zip_uint64_t size;
+    zip_uint64_t cdir_offset;
+    zip_uint64_t cdir_size;
+} archive_t;
+
+static zip_uint8_t *
+put16(zip_uint8_t *p, zip_uint16_t v) {
+    p[0] = (zip_uint8_t)v;
+    p[1] = (zip_uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static zip_uint8_t *
+put32(zip_uint8_t *p, zip_uint32_t v) {
+    p = put16(p, (zip_uint16_t)v);
+    return put16(p, (zip_uint16_t)(v >> 16));
+}
+
+static zip_uint8_t *
+put64(zip_uint8_t *p, zip_uint64_t v) {
+    p = put32(p, (zip_uint32_t)v);
+    return put32(p, (zip_uint32_t)(v >> 32));
+}
+
+static zip_uint8_t *
+put_header(zip_uint8_t *p, bool central, const char *name, zip_uint64_t offset) {
+    zip_uint16_t name_length = (zip_uint16_t)strlen(name);
+
+    p = put32(p, central ? 0x02014b50 : 0x04034b50);
+    if (central) {
+        p = put16(p, 20); /* version made by */
+    }
+    p = put16(p, 20); /* version needed */
+    p = put16(p, 0);  /* flags */
+    p = put16(p, ZIP_CM_STORE);
+    p = put16(p, 0);      /* time */
+    p = put16(p, 0x21);   /* date: 1980-01-01 */
+    p = put32(p, 0);      /* crc */
+    p = put32(p, 0);      /* compressed size */
+    p = put32(p, 0);      /* size */
+    p = put16(p, name_length);
+    p = put16(p, 0); /* extra field length */
+    if (central) {
+        p = put16(p, 0); /* comment length */
+        p = put16(p, 0); /* disk */
+        p = put16(p, 0); /* internal attributes */
+        p = put32(p, 0); /* external attributes */
+        p = put32(p, (zip_uint32_t)offset);
+    }
+    memcpy(p, name, name_length);
+    return p + name_length;
+}
+
+static int
+make_archive(archive_t *archive, char **names, zip_uint64_t n) {
+    zip_uint64_t i, names_size = 0, *offsets;
+    zip_uint8_t *p;
+    bool zip64 = n > ZIP_UINT16_MAX;
+
+    for (i = 0; i < n; i++) {
+        names_size += strlen(names[i]);
+    }
+    archive->size = n * (LENTRYSIZE + CDENTRYSIZE) + 2 * names_size + EOCDLEN + (zip64 ? EOCD64LEN + EOCD64LOCLEN : 0);
+    if ((archive->data = (zip_uint8_t *)malloc(archive->size)) == NULL || (offsets = (zip_uint64_t *)malloc(sizeof(offsets[0]) * (n > 0 ? n : 1))) == NULL) {
+        return -1;
+    }
+
+    p = archive->data;
+    for (i = 0; i < n; i++) {
+        offsets[i] = (zip_uint64_t)(p - archive->data);
+        p = put_header(p, false, names[i], 0);
+    }
+    archive->cdir_offset = (zip_uint64_t)(p - archive->data);
+    for (i = 0; i < n; i++) {
+        p = put_header(p, true, names[i], offsets[i]);
+    }
+    archive->cdir_size = (zip_uint64_t)(p - archive->data) - archive->cdir_offset;
+    free(offsets);
+
+    if (zip64) {
+        zip_uint64_t eocd64_offset = (zip_uint64_t)(p - archive->data);
+
+        p = put32(p, 0x06064b50);
+        p = put64(p, EOCD64LEN - 12);
+        p = put16(p, 45);
+        p = put16(p, 45);
+        p = put32(p, 0);
+        p = put32(p, 0);
+        p = put64(p, n);
+        p = put64(p, n);
+        p = put64(p, archive->cdir_size);
+        p = put64(p, archive->cdir_offset);
+
+        p = put32(p, 0x07064b50);
+        p = put32(p, 0);
+        p = put64(p, eocd64_offset);
+        p = put32(p, 1);
+    }
+    p = put32(p, 0x06054b50);
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, zip64 ? ZIP_UINT16_MAX : (zip_uint16_t)n);
+    p = put16(p, zip64 ? ZIP_UINT16_MAX : (zip_uint16_t)n);
+    p = put32(p, (zip_uint32_t)archive->cdir_size);
+    p = put32(p, (zip_uint32_t)archive->cdir_offset);
+    p = put16(p, 0);
+
+    return 0;
+}
+
+
+/* crc32: plain zlib crc32(), the floor for everything else below */
+
+typedef struct {
+    zip_uint8_t *data;
+    zip_uint64_t size;
+    zip_uint32_t crc;
+} data_ud_t;
+
+static int
+body_crc32(void *ud) {
+    data_ud_t *d = (data_ud_t *)ud;
+
+    d->crc = (zip_uint32_t)crc32(d->crc, d->data, (uInt)d->size);
+    return 0;
+}
+
+
+/* source_crc: read a buffer through zip_source_crc in BUFSIZE chunks */
+
+static int
+body_source_crc(void *ud) {
+    data_ud_t *d = (data_ud_t *)ud;
+    zip_source_t *src, *crc;
+    zip_error_t error;
+    zip_uint8_t buf[BUFSIZE];
+    zip_int64_t n;
+
+    zip_error_init(&error);
+    if ((src = zip_source_buffer_create(d->data, d->size, 0, &error)) == NULL) {
+        return -1;
+    }
+    if ((crc = zip_source_crc_create(src, 1, &error)) == NULL) {
+        zip_source_free(src);
+        return -1;
+    }
+    if (zip_source_open(crc) < 0) {
+        zip_source_free(crc);
+        return -1;
+    }
+    while ((n = zip_source_read(crc, buf, sizeof(buf))) > 0) {
+    }
+    zip_source_close(crc);
+    zip_source_free(crc);
+    return n < 0 ? -1 : 0;
+}
+
+
+/* write_crc: _zip_write() with CRC computation into a sink, in BUFSIZE chunks like copy_data() */
+
+static zip_int64_t
+sink_callback(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t cmd) {
+    switch (cmd) {
+    case ZIP_SOURCE_BEGIN_WRITE:
+    case ZIP_SOURCE_COMMIT_WRITE:
+    case ZIP_SOURCE_ROLLBACK_WRITE:
+    case ZIP_SOURCE_FREE:
+        return 0;
+
+    case ZIP_SOURCE_WRITE:
+        return (zip_int64_t)length;
+
+    case ZIP_SOURCE_SUPPORTS:
+        return zip_source_make_command_bitmap(ZIP_SOURCE_BEGIN_WRITE, ZIP_SOURCE_COMMIT_WRITE, ZIP_SOURCE_ROLLBACK_WRITE, ZIP_SOURCE_WRITE, ZIP_SOURCE_FREE, ZIP_SOURCE_SUPPORTS, -1);
+
+    default:
+        return -1;
+    }
+}
+
+typedef struct {
+    data_ud_t data;
+    zip_t *za;
+    zip_uint32_t crc;
+} write_ud_t;
+
+static int
+body_write_crc(void *ud) {
+    write_ud_t *w = (write_ud_t *)ud;
+    zip_uint64_t offset;
+
+    w->crc = (zip_uint32_t)crc32(0, NULL, 0);
+    for (offset = 0; offset < w->data.size; offset += BUFSIZE) {
+        if (_zip_write(w->za, w->data.data + offset, ZIP_MIN(BUFSIZE, w->data.size - offset)) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/* close_store: zip_close() of a new stored entry, copy_source() loop */
+
+static int
+body_close_store(void *ud) {
+    data_ud_t *d = (data_ud_t *)ud;
+    zip_source_t *archive, *src;
+    zip_error_t error;
+    zip_t *za;
+
+    zip_error_init(&error);
+    if ((archive = zip_source_buffer_create(NULL, 0, 0, &error)) == NULL) {
+        return -1;
+    }
+    if ((za = zip_open_from_source(archive, ZIP_TRUNCATE, &error)) == NULL) {
+        zip_source_free(archive);
+        return -1;
+    }
+    if ((src = zip_source_buffer(za, d->data, d->size, 0)) == NULL || zip_file_add(za, "data", src, 0) < 0) {
+        zip_source_free(src);
+        zip_discard(za);
+        return -1;
+    }
+    zip_set_file_compression(za, 0, ZIP_CM_STORE, 0);
+    if (zip_close(za) < 0) {
+        zip_discard(za);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* close_copy: zip_close() after renaming the entry, copy_data() loop; a
+   change of the archive comment alone would let cloning skip the copy */
+
+typedef struct {
+    zip_source_t *archive;
+    int flip;
+} archive_ud_t;
+
+static int
+body_close_copy(void *ud) {
+    archive_ud_t *a = (archive_ud_t *)ud;
+    zip_error_t error;
+    zip_t *za;
+
+    zip_error_init(&error);
+    zip_source_keep(a->archive);
+    if ((za = zip_open_from_source(a->archive, 0, &error)) == NULL) {
+        zip_source_free(a->archive);
+        return -1;
+    }
+    a->flip = !a->flip;
+    if (zip_file_rename(za, 0, a->flip ? "a" : "b", 0) < 0 || zip_close(za) < 0) {
+        zip_discard(za);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* hash_add: build the name table the way zip_open() does */
+
+typedef struct {
+    char **names;
+    char **missing;
+    zip_uint64_t n;
+    zip_hash_t *hash;
+} hash_ud_t;
+
+static int
+body_hash_add(void *ud) {
+    hash_ud_t *h = (hash_ud_t *)ud;
+    zip_error_t error;
+    zip_hash_t *hash;
+    zip_uint64_t i;
+
+    zip_error_init(&error);
+    if ((hash = _zip_hash_new(&error)) == NULL) {
+        return -1;
+    }
+    _zip_hash_reserve_capacity(hash, h->n, &error);
+    for (i = 0; i < h->n; i++) {
+        if (!_zip_hash_add(hash, (const zip_uint8_t *)h->names[i], i, 0, &error)) {
+            _zip_hash_free(hash);
+            return -1;
+        }
+    }
+    _zip_hash_free(hash);
+    return 0;
+}
+
+
+/* hash_lookup, hash_miss: look up every name present or absent */
+
+static int
+body_hash_lookup(void *ud) {
+    hash_ud_t *h = (hash_ud_t *)ud;
+    zip_uint64_t i;
+
+    for (i = 0; i < h->n; i++) {
+        if (_zip_hash_lookup(h->hash, (const zip_uint8_t *)h->names[i], 0, NULL) != (zip_int64_t)i) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int
+body_hash_miss(void *ud) {
+    hash_ud_t *h = (hash_ud_t *)ud;
+    zip_uint64_t i;
+
+    for (i = 0; i < h->n; i++) {
+        if (_zip_hash_lookup(h->hash, (const zip_uint8_t *)h->missing[i], 0, NULL) != -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/* dirent_read: parse central directory entries from memory */
+
+typedef struct {
+    archive_t archive;
+    zip_uint64_t n;
+} cdir_ud_t;
+
+static int
+body_dirent_read(void *ud) {
+    cdir_ud_t *c = (cdir_ud_t *)ud;
+    zip_buffer_t *buffer;
+    zip_dirent_t de;
+    zip_error_t error;
+    zip_uint64_t i;
+
+    zip_error_init(&error);
+    if ((buffer = _zip_buffer_new(c->archive.data + c->archive.cdir_offset, c->archive.cdir_size)) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < c->n; i++) {
+        _zip_dirent_init(&de);
+        if (_zip_dirent_read(&de, NULL, buffer, false, 0, false, &error) < 0) {
+            _zip_dirent_finalize(&de);
+            _zip_buffer_free(buffer);
+            return -1;
+        }
+        _zip_dirent_finalize(&de);
+    }
+    _zip_buffer_free(buffer);
+    return 0;
+}
+
+
+/* open: zip_open() of an archive in memory, _zip_find_central_dir() and _zip_read_cdir() */
+
+static int
+body_open(void *ud) {
+    cdir_ud_t *c = (cdir_ud_t *)ud;
+    zip_source_t *src;
+    zip_error_t error;
+    zip_t *za;
+
+    zip_error_init(&error);
+    if ((src = zip_source_buffer_create(c->archive.data, c->archive.size, 0, &error)) == NULL) {
+        return -1;
+    }
+    if ((za = zip_open_from_source(src, ZIP_RDONLY, &error)) == NULL) {
+        zip_source_free(src);
+        return -1;
+    }
+    if ((zip_uint64_t)zip_get_num_entries(za, 0) != c->n) {
+        zip_discard(za);
+        return -1;
+    }
+    zip_discard(za);
+    return 0;
+}
+
+
+static int
+run_size(const char *name, zip_uint64_t size, body_fn body) {
+    data_ud_t d;
+    int ret;
+
+    if ((d.data = make_data(size)) == NULL) {
+        return -1;
+    }
+    d.size = size;
+    d.crc = 0;
+    ret = measure(name, size, 1, size, body, &d);
+    free(d.data);
+    return ret;
+}
+
+static int
+run_write_crc(const char *name, zip_uint64_t size, body_fn body) {
+    write_ud_t w;
+    zip_error_t error;
+    zip_source_t *sink;
+    int ret = -1;
+
+    zip_error_init(&error);
+    if ((w.data.data = make_data(size)) == NULL) {
+        return -1;
+    }
+    w.data.size = size;
+    if ((w.za = _zip_new(&error)) == NULL) {
+        free(w.data.data);
+        return -1;
+    }
+    if ((sink = zip_source_function_create(sink_callback, NULL, &error)) != NULL && zip_source_begin_write(sink) == 0) {
+        w.za->src = sink;
+        w.za->write_crc = &w.crc;
+        ret = measure(name, size, 1, size, body, &w);
+        zip_source_rollback_write(sink);
+    }
+    w.za->write_crc = NULL;
+    zip_discard(w.za);
+    free(w.data.data);
+    return ret;
+}
+
+static int
+run_close_copy(const char *name, zip_uint64_t size, body_fn body) {
+    archive_ud_t a;
+    zip_error_t error;
+    zip_source_t *src;
+    zip_uint8_t *data;
+    zip_t *za;
+    int ret = -1;
+
+    zip_error_init(&error);
+    if ((data = make_data(size)) == NULL) {
+        return -1;
+    }
+    a.flip = 0;
+    if ((a.archive = zip_source_buffer_create(NULL, 0, 0, &error)) != NULL) {
+        zip_source_keep(a.archive);
+        if ((za = zip_open_from_source(a.archive, ZIP_TRUNCATE, &error)) != NULL) {
+            if ((src = zip_source_buffer(za, data, size, 0)) != NULL && zip_file_add(za, "b", src, 0) == 0 && zip_set_file_compression(za, 0, ZIP_CM_STORE, 0) == 0 && zip_close(za) == 0) {
+                ret = measure(name, size, 1, size, body, &a);
+            }
+            else {
+                zip_discard(za);
+            }
+        }
+        zip_source_free(a.archive);
+    }
+    free(data);
+    return ret;
+}
+
+static int
+run_hash(const char *name, zip_uint64_t n, body_fn body) {
+    hash_ud_t h;
+    zip_error_t error;
+    zip_uint64_t i;
+    int ret = -1;
+
+    zip_error_init(&error);
+    h.n = n;
+    h.hash = NULL;
+    h.names = make_names(n, "");
+    h.missing = make_names(n, "x/");
+    if (h.names != NULL && h.missing != NULL && (h.hash = _zip_hash_new(&error)) != NULL) {
+        _zip_hash_reserve_capacity(h.hash, n, &error);
+        for (i = 0; i < n; i++) {
+            if (!_zip_hash_add(h.hash, (const zip_uint8_t *)h.names[i], i, 0, &error)) {
+                break;
+            }
+        }
+        if (i == n) {
+            ret = measure(name, n, n > 0 ? n : 1, 0, body, &h);
+        }
+    }
+    _zip_hash_free(h.hash);
+    free_names(h.names, n);
+    free_names(h.missing, n);
+    return ret;
+}
+
+static int
+run_cdir(const char *name, zip_uint64_t n, body_fn body) {
+    cdir_ud_t c;
+    char **names;
+    int ret = -1;
+
+    c.n = n;
+    c.archive.data = NULL;
+    if ((names = make_names(n, "")) != NULL && make_archive(&c.archive, names, n) == 0) {
+        if (body == body_dirent_read) {
+            ret = measure(name, n, n > 0 ? n : 1, c.archive.cdir_size, body, &c);
+        }
+        else {
+            ret = measure(name, n, 1, c.archive.size, body, &c);
+        }
+    }
+    free(c.archive.data);
+    free_names(names, n);
+    return ret;
+}
+
+
+typedef struct {
+    const char *name;
+    bool by_count; /* parameter is an entry count, else an input size */
+    int (*run)(const char *name, zip_uint64_t param, body_fn body);
+    body_fn body;
+    const char *description;
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+    {"crc32", false, run_size, body_crc32, "zlib crc32() over a buffer"},
+    {"source_crc", false, run_size, body_source_crc, "read through zip_source_crc in BUFSIZE chunks"},
+    {"write_crc", false, run_write_crc, body_write_crc, "_zip_write() with CRC in BUFSIZE chunks"},
+    {"close_store", false, run_size, body_close_store, "zip_close() of a new stored entry (copy_source)"},
+    {"close_copy", false, run_close_copy, body_close_copy, "zip_close() copying the data of a renamed entry (copy_data)"},
+    {"hash_add", true, run_hash, body_hash_add, "_zip_hash_add() of all names, ns per name"},
+    {"hash_lookup", true, run_hash, body_hash_lookup, "_zip_hash_lookup() of present names, ns per lookup"},
+    {"hash_miss", true, run_hash, body_hash_miss, "_zip_hash_lookup() of absent names, ns per lookup"},
+    {"dirent_read", true, run_cdir, body_dirent_read, "_zip_dirent_read() of central entries, ns per entry"},
+    {"open", true, run_cdir, body_open, "zip_open() finding and reading the central directory"},
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+
+static bool
+selected(const benchmark_t *benchmark, int argc, char *argv[]) {
+    int i;
+
+    if (argc == 0) {
+        return true;
+    }
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], benchmark->name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int
+main(int argc, char *argv[]) {
+    size_t i;
+    int c, j, ret = 0;
+
+    progname = argv[0];
+
+    while ((c = getopt(argc, argv, "hn:s:t:")) != -1) {
+        switch (c) {
+        case 'h':
+            fprintf(stdout, usage, progname);
+            fprintf(stdout, "%s", help);
+            fprintf(stdout, "\nbenchmarks:\n");
+            for (i = 0; i < NUM_BENCHMARKS; i++) {
+                fprintf(stdout, "  %-12s %s\n", benchmarks[i].name, benchmarks[i].description);
+            }
+            exit(0);
+        case 'n':
+            max_entries = strtoull(optarg, NULL, 10);
+            break;
+        case 's':
+            max_size = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            min_time = strtod(optarg, NULL);
+            break;
+        default:
+            fprintf(stderr, usage, progname);
+            exit(2);
+        }
+    }
+
+    for (j = optind; j < argc; j++) {
+        for (i = 0; i < NUM_BENCHMARKS; i++) {
+            if (strcmp(argv[j], benchmarks[i].name) == 0) {
+                break;
+            }
+        }
+        if (i == NUM_BENCHMARKS) {
+            fprintf(stderr, "%s: unknown benchmark '%s'\n", progname, argv[j]);
+            exit(2);
+        }
+    }
+
+    cycles_init();
+    printf("# cycles: %s\n", cycle_source);
+    printf("%-14s %10s %12s %12s %12s\n", "benchmark", "size/count", "ns/op", "bytes/cycle", "allocs/op");
+
+    for (i = 0; i < NUM_BENCHMARKS; i++) {
+        const benchmark_t *benchmark = &benchmarks[i];
+        zip_uint64_t param;
+
+        if (!selected(benchmark, argc - optind, argv + optind)) {
+            continue;
+        }
+        if (benchmark->by_count) {
+            /* 1, 10, ..., max_entries */
+            for (param = 1; param <= max_entries; param *= 10) {
+                if (benchmark->run(benchmark->name, param, benchmark->body) < 0) {
+                    ret = 1;
+                }
+            }
+        }
+        else {
+            /* 64 bytes, 1k, 16k, ..., max_size */
+            for (param = 64; param <= max_size; param *= 16) {
+                if (benchmark->run(benchmark->name, param, benchmark->body) < 0) {
+                    ret = 1;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
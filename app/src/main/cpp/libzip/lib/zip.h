@@ -88,6 +88,7 @@ extern "C" {
 #define ZIP_CHECKCONS 4
 #define ZIP_TRUNCATE 8
 #define ZIP_RDONLY 16
+#define ZIP_LAZY_CDIR 32
 
 
 /* flags for zip_name_locate, zip_fopen, zip_stat, ... */
@@ -107,6 +108,7 @@ extern "C" {
 #define ZIP_FL_ENC_UTF_8 2048u /* string is UTF-8 encoded */
 #define ZIP_FL_ENC_CP437 4096u /* string is CP437 encoded */
 #define ZIP_FL_OVERWRITE 8192u /* zip_file_add: if file with name exists, overwrite (replace) it */
+#define ZIP_FL_CHECK_CRC 16384u /* zip_file_get_mapped_data: verify CRC of data */
 
 /* archive global flags flags */
 
@@ -114,6 +116,8 @@ extern "C" {
 #define ZIP_AFL_IS_TORRENTZIP	4u /* current archive is torrentzipped */
 #define ZIP_AFL_WANT_TORRENTZIP	8u /* write archive in torrentzip format */
 #define ZIP_AFL_CREATE_OR_KEEP_FILE_FOR_EMPTY_ARCHIVE 16u /* don't remove file if archive is empty */
+#define ZIP_AFL_PARALLEL_CLOSE 32u /* compress changed entries concurrently in zip_close() */
+#define ZIP_AFL_ADAPTIVE_COMPRESSION 64u /* store or deflate fast entries that sample as incompressible */
 
 
 /* create a new extra field */
@@ -267,7 +271,9 @@ enum zip_source_cmd {
     ZIP_SOURCE_ACCEPT_EMPTY,        /* whether empty files are valid archives */
     ZIP_SOURCE_GET_FILE_ATTRIBUTES, /* get additional file attributes */
     ZIP_SOURCE_SUPPORTS_REOPEN,     /* allow reading from changed entry */
-    ZIP_SOURCE_GET_DOS_TIME         /* get last modification time in DOS format */
+    ZIP_SOURCE_GET_DOS_TIME,        /* get last modification time in DOS format */
+    ZIP_SOURCE_BORROW,              /* read data in place, without copying */
+    ZIP_SOURCE_MAP                  /* read data in place, valid until close */
 };
 typedef enum zip_source_cmd zip_source_cmd_t;
 
@@ -298,6 +304,15 @@ typedef enum zip_source_cmd zip_source_cmd_t;
                                          | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_TELL_WRITE) \
                                          | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_REMOVE))
 
+#define ZIP_SOURCE_SUPPORTS_STREAM_WRITABLE (ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE) \
+                                         | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_COMMIT_WRITE) \
+                                         | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_ROLLBACK_WRITE) \
+                                         | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_WRITE) \
+                                         | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_TELL_WRITE) \
+                                         | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_ERROR) \
+                                         | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_FREE) \
+                                         | ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_SUPPORTS))
+
 /* clang-format on */
 
 /* for use by sources */
@@ -381,6 +396,7 @@ typedef zip_int64_t (*zip_source_callback)(void *_Nullable, void *_Nullable, zip
 typedef zip_int64_t (*zip_source_layered_callback)(zip_source_t *_Nonnull, void *_Nullable, void *_Nullable, zip_uint64_t, enum zip_source_cmd);
 typedef void (*zip_progress_callback)(zip_t *_Nonnull, double, void *_Nullable);
 typedef int (*zip_cancel_callback)(zip_t *_Nonnull, void *_Nullable);
+typedef void (*zip_entry_written_callback)(zip_t *_Nonnull, zip_uint64_t, const zip_stat_t *_Nonnull, void *_Nullable);
 
 #ifndef ZIP_DISABLE_DEPRECATED
 #define ZIP_FL_RECOMPRESS 16u  /* force recompression of data */
@@ -404,6 +420,8 @@ ZIP_DEPRECATED("use 'zip_source_zip_file_create' instead") ZIP_EXTERN zip_source
 #endif
 
 ZIP_EXTERN int zip_close(zip_t *_Nonnull);
+ZIP_EXTERN zip_uint32_t zip_crc32(zip_uint32_t, const void *_Nullable, zip_uint64_t);
+ZIP_EXTERN zip_uint32_t zip_crc32_combine(zip_uint32_t, zip_uint32_t, zip_uint64_t);
 ZIP_EXTERN int zip_delete(zip_t *_Nonnull, zip_uint64_t);
 ZIP_EXTERN zip_int64_t zip_dir_add(zip_t *_Nonnull, const char *_Nonnull, zip_flags_t);
 ZIP_EXTERN void zip_discard(zip_t *_Nonnull);
@@ -436,6 +454,8 @@ ZIP_EXTERN const zip_uint8_t *_Nullable zip_file_extra_field_get_by_id(zip_t *_N
 ZIP_EXTERN const char *_Nullable zip_file_get_comment(zip_t *_Nonnull, zip_uint64_t, zip_uint32_t *_Nullable, zip_flags_t);
 ZIP_EXTERN zip_error_t *_Nonnull zip_file_get_error(zip_file_t *_Nonnull);
 ZIP_EXTERN int zip_file_get_external_attributes(zip_t *_Nonnull, zip_uint64_t, zip_flags_t, zip_uint8_t *_Nullable, zip_uint32_t *_Nullable);
+ZIP_EXTERN zip_int64_t zip_file_get_local_header_offset(zip_t *_Nonnull, zip_uint64_t, zip_flags_t);
+ZIP_EXTERN int zip_file_get_mapped_data(zip_t *_Nonnull, zip_uint64_t, zip_flags_t, const zip_uint8_t *_Nullable *_Nonnull, zip_uint64_t *_Nonnull);
 ZIP_EXTERN int zip_file_is_seekable(zip_file_t *_Nonnull);
 ZIP_EXTERN int zip_file_rename(zip_t *_Nonnull, zip_uint64_t, const char *_Nonnull, zip_flags_t);
 ZIP_EXTERN int zip_file_replace(zip_t *_Nonnull, zip_uint64_t, zip_source_t *_Nonnull, zip_flags_t);
@@ -462,10 +482,13 @@ ZIP_EXTERN zip_t *_Nullable zip_open(const char *_Nonnull, int, int *_Nullable);
 ZIP_EXTERN zip_t *_Nullable zip_open_from_source(zip_source_t *_Nonnull, int, zip_error_t *_Nullable);
 ZIP_EXTERN int zip_register_progress_callback_with_state(zip_t *_Nonnull, double, zip_progress_callback _Nullable, void (*_Nullable)(void *_Nullable), void *_Nullable);
 ZIP_EXTERN int zip_register_cancel_callback_with_state(zip_t *_Nonnull, zip_cancel_callback _Nullable, void (*_Nullable)(void *_Nullable), void *_Nullable);
+ZIP_EXTERN int zip_register_entry_written_callback_with_state(zip_t *_Nonnull, zip_entry_written_callback _Nullable, void (*_Nullable)(void *_Nullable), void *_Nullable);
 ZIP_EXTERN int zip_set_archive_comment(zip_t *_Nonnull, const char *_Nullable, zip_uint16_t);
 ZIP_EXTERN int zip_set_archive_flag(zip_t *_Nonnull, zip_flags_t, int);
 ZIP_EXTERN int zip_set_default_password(zip_t *_Nonnull, const char *_Nullable);
 ZIP_EXTERN int zip_set_file_compression(zip_t *_Nonnull, zip_uint64_t, zip_int32_t, zip_uint32_t);
+ZIP_EXTERN int zip_set_parallel_close_limits(zip_t *_Nonnull, zip_uint32_t, zip_uint64_t);
+ZIP_EXTERN int zip_set_parallel_deflate_threshold(zip_t *_Nonnull, zip_uint64_t);
 ZIP_EXTERN int zip_source_begin_write(zip_source_t *_Nonnull);
 ZIP_EXTERN int zip_source_begin_write_cloning(zip_source_t *_Nonnull, zip_uint64_t);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_buffer(zip_t *_Nonnull, const void *_Nullable, zip_uint64_t, int);
@@ -489,6 +512,8 @@ ZIP_EXTERN void zip_source_keep(zip_source_t *_Nonnull);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_layered(zip_t *_Nullable, zip_source_t *_Nonnull, zip_source_layered_callback _Nonnull, void *_Nullable);
 ZIP_EXTERN zip_source_t *_Nullable zip_source_layered_create(zip_source_t *_Nonnull, zip_source_layered_callback _Nonnull, void *_Nullable, zip_error_t *_Nullable);
 ZIP_EXTERN zip_int64_t zip_source_make_command_bitmap(zip_source_cmd_t, ...);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_mmap(zip_t *_Nonnull, const char *_Nonnull, zip_uint64_t, zip_int64_t);
+ZIP_EXTERN zip_source_t *_Nullable zip_source_mmap_create(const char *_Nonnull, zip_uint64_t, zip_int64_t, zip_error_t *_Nullable);
 ZIP_EXTERN int zip_source_open(zip_source_t *_Nonnull);
 ZIP_EXTERN zip_int64_t zip_source_pass_to_lower_layer(zip_source_t *_Nonnull, void *_Nullable, zip_uint64_t, zip_source_cmd_t);
 ZIP_EXTERN zip_int64_t zip_source_read(zip_source_t *_Nonnull, void *_Nonnull, zip_uint64_t);
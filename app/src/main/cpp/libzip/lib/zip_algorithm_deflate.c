@@ -44,6 +44,16 @@ struct ctx {
     int mem_level;
     bool end_of_input;
     z_stream zstr;
+
+    /* large input is deflated in blocks on several threads, see zip_algorithm_deflate_parallel.c */
+    zip_uint32_t parallel_threads;
+    zip_uint64_t parallel_threshold;
+    zip_deflate_parallel_t *parallel;
+
+    /* whether CRC and size of the uncompressed data are computed here */
+    bool has_result;
+    zip_uint32_t crc;
+    zip_uint64_t size;
 };
 
 
@@ -79,6 +89,10 @@ allocate(bool compress, zip_uint32_t compression_flags, zip_error_t *error) {
     }
     ctx->mem_level = compression_flags == TORRENTZIP_COMPRESSION_FLAGS ? TORRENTZIP_MEM_LEVEL : MAX_MEM_LEVEL;
     ctx->end_of_input = false;
+    ctx->parallel_threads = 0;
+    ctx->parallel_threshold = 0;
+    ctx->parallel = NULL;
+    ctx->has_result = false;
 
     ctx->zstr.zalloc = Z_NULL;
     ctx->zstr.zfree = Z_NULL;
@@ -106,10 +120,33 @@ static void
 deallocate(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
 
+    _zip_deflate_parallel_free(ctx->parallel);
     free(ctx);
 }
 
 
+void
+_zip_deflate_set_parallel(void *ud, zip_uint32_t threads, zip_uint64_t min_size) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    ctx->parallel_threads = threads;
+    ctx->parallel_threshold = min_size;
+}
+
+
+bool
+_zip_deflate_get_result(void *ud, zip_uint32_t *crc, zip_uint64_t *size) {
+    struct ctx *ctx = (struct ctx *)ud;
+
+    if (!ctx->has_result) {
+        return false;
+    }
+    *crc = ctx->crc;
+    *size = ctx->size;
+    return true;
+}
+
+
 static zip_uint16_t
 general_purpose_bit_flags(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
@@ -133,9 +170,24 @@ start(void *ud, zip_stat_t *st, zip_file_attributes_t *attributes) {
     struct ctx *ctx = (struct ctx *)ud;
     int ret;
 
-    (void)st;
     (void)attributes;
 
+    ctx->has_result = false;
+
+    if (ctx->compress && ctx->parallel_threads > 1 && (st->valid & ZIP_STAT_SIZE) && st->size >= ctx->parallel_threshold) {
+        /* zip_close() relies on us for the CRC, even if we can't go parallel */
+        ctx->has_result = true;
+        ctx->crc = 0;
+        ctx->size = 0;
+
+        if ((ctx->parallel = _zip_deflate_parallel_new(ctx->level, ctx->mem_level, ctx->parallel_threads, ctx->error)) != NULL) {
+            return true;
+        }
+        /* fall back to a single stream */
+        zip_error_fini(ctx->error);
+        zip_error_init(ctx->error);
+    }
+
     ctx->zstr.avail_in = 0;
     ctx->zstr.next_in = NULL;
     ctx->zstr.avail_out = 0;
@@ -164,6 +216,13 @@ end(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
     int err;
 
+    if (ctx->parallel != NULL) {
+        _zip_deflate_parallel_result(ctx->parallel, &ctx->crc, &ctx->size);
+        _zip_deflate_parallel_free(ctx->parallel);
+        ctx->parallel = NULL;
+        return true;
+    }
+
     if (ctx->compress) {
         err = deflateEnd(&ctx->zstr);
     }
@@ -184,6 +243,10 @@ static bool
 input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
     struct ctx *ctx = (struct ctx *)ud;
 
+    if (ctx->parallel != NULL) {
+        return _zip_deflate_parallel_input(ctx->parallel, data, length);
+    }
+
     if (length > UINT_MAX || ctx->zstr.avail_in > 0) {
         zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
         return false;
@@ -192,6 +255,11 @@ input(void *ud, zip_uint8_t *data, zip_uint64_t length) {
     ctx->zstr.avail_in = (uInt)length;
     ctx->zstr.next_in = (Bytef *)data;
 
+    if (ctx->has_result) {
+        ctx->crc = zip_crc32(ctx->crc, data, length);
+        ctx->size += length;
+    }
+
     return true;
 }
 
@@ -200,6 +268,9 @@ static bool end_of_input(void *ud) {
     struct ctx *ctx = (struct ctx *)ud;
 
     ctx->end_of_input = true;
+    if (ctx->parallel != NULL) {
+        return _zip_deflate_parallel_end_of_input(ctx->parallel);
+    }
     return ctx->zstr.avail_in != 0;
 }
 
@@ -211,6 +282,10 @@ process(void *ud, zip_uint8_t *data, zip_uint64_t *length) {
 
     int ret;
 
+    if (ctx->parallel != NULL) {
+        return _zip_deflate_parallel_process(ctx->parallel, data, length);
+    }
+
     avail_out = (uInt)ZIP_MIN(UINT_MAX, *length);
     ctx->zstr.avail_out = avail_out;
     ctx->zstr.next_out = (Bytef *)data;
@@ -0,0 +1,543 @@
+/*
+  zip_algorithm_deflate_parallel.c -- deflate one large entry in blocks on several threads
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+  The input is cut into blocks that are deflated independently on
+  worker threads, pigz style.  Each block is primed with the last 32k of
+  the previous block as dictionary, so matches across block boundaries
+  are not lost.  All blocks but the last end with a sync flush, which
+  byte-aligns them without ending the stream; concatenated in order they
+  form one valid deflate stream.  The CRC of each block is computed by
+  its worker and merged with zip_crc32_combine().
+*/
+
+#include "zipint.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+
+/* whether zip_close() deflates data of this size in blocks */
+bool
+_zip_deflate_parallel_wanted(const zip_t *za, zip_int32_t method, zip_uint64_t size) {
+#ifdef HAVE_PTHREAD
+    if ((za->ch_flags & ZIP_AFL_PARALLEL_CLOSE) == 0 || ZIP_WANT_TORRENTZIP(za) || ZIP_CM_ACTUAL(method) != ZIP_CM_DEFLATE) {
+        return false;
+    }
+    return size >= za->deflate_block_threshold && _zip_parallel_threads(za) > 1;
+#else
+    (void)za;
+    (void)method;
+    (void)size;
+    return false;
+#endif
+}
+
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+#define BLOCK_SIZE (128 * 1024)
+#define DICTIONARY_SIZE (32 * 1024)
+
+typedef enum { BLOCK_FREE, BLOCK_FILLING, BLOCK_QUEUED, BLOCK_RUNNING, BLOCK_DONE, BLOCK_FAILED } block_state_t;
+
+struct block {
+    block_state_t state;
+    bool last;
+    zip_uint8_t *in;
+    zip_uint64_t in_length;
+    zip_uint8_t dictionary[DICTIONARY_SIZE];
+    zip_uint64_t dictionary_length;
+    zip_uint8_t *out;
+    zip_uint64_t out_length;
+    zip_uint64_t out_offset; /* bytes already returned by process */
+    zip_uint32_t crc;
+    int zerr;
+};
+
+typedef struct block block_t;
+
+struct worker {
+    zip_deflate_parallel_t *ctx;
+    z_stream zstr;
+    bool initialized;
+    pthread_t thread;
+};
+
+struct zip_deflate_parallel {
+    zip_error_t *error;
+
+    block_t *blocks;
+    zip_uint64_t nblocks;
+    zip_uint64_t out_size; /* room for compressed data of one block */
+
+    /* sequence numbers of blocks, slot is sequence % nblocks */
+    zip_uint64_t next_fill; /* block currently filled from input, all before it are queued */
+    zip_uint64_t next_run;  /* next queued block to hand to a worker */
+    zip_uint64_t next_emit; /* next block to return from process */
+
+    zip_uint8_t tail[DICTIONARY_SIZE]; /* end of data queued so far */
+    zip_uint64_t tail_length;
+
+    zip_uint8_t *input;
+    zip_uint64_t input_length;
+    bool end_of_input;
+    bool last_queued;
+
+    zip_uint32_t crc;
+    zip_uint64_t size;
+
+    bool stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;  /* block queued or stop requested */
+    pthread_cond_t done;  /* block finished */
+
+    struct worker *workers;
+    zip_uint32_t nstreams; /* size of workers */
+    zip_uint32_t nworkers; /* threads started */
+};
+
+static void compress_block(struct worker *w, block_t *block, zip_uint64_t out_size);
+static block_t *fill_block(zip_deflate_parallel_t *ctx);
+static void queue_block(zip_deflate_parallel_t *ctx, bool last);
+static void wait_for_emit(zip_deflate_parallel_t *ctx);
+static void *worker_main(void *ud);
+
+
+zip_deflate_parallel_t *
+_zip_deflate_parallel_new(int level, int mem_level, zip_uint32_t threads, zip_error_t *error) {
+    zip_deflate_parallel_t *ctx;
+    zip_uint64_t i;
+    zip_uint32_t j;
+    int ret;
+
+    if ((ctx = (zip_deflate_parallel_t *)calloc(1, sizeof(*ctx))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->error = error;
+    ctx->crc = 0;
+
+    if (pthread_mutex_init(&ctx->mutex, NULL) != 0) {
+        free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if (pthread_cond_init(&ctx->work, NULL) != 0) {
+        pthread_mutex_destroy(&ctx->mutex);
+        free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    if (pthread_cond_init(&ctx->done, NULL) != 0) {
+        pthread_cond_destroy(&ctx->work);
+        pthread_mutex_destroy(&ctx->mutex);
+        free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if ((ctx->workers = (struct worker *)calloc(threads, sizeof(ctx->workers[0]))) == NULL) {
+        _zip_deflate_parallel_free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    ctx->nstreams = threads;
+    for (j = 0; j < threads; j++) {
+        struct worker *w = ctx->workers + j;
+
+        w->ctx = ctx;
+        w->zstr.zalloc = Z_NULL;
+        w->zstr.zfree = Z_NULL;
+        w->zstr.opaque = NULL;
+        /* negative value to tell zlib not to write a header */
+        if ((ret = deflateInit2(&w->zstr, level, Z_DEFLATED, -MAX_WBITS, mem_level, Z_DEFAULT_STRATEGY)) != Z_OK) {
+            _zip_deflate_parallel_free(ctx);
+            zip_error_set(error, ZIP_ER_ZLIB, ret);
+            return NULL;
+        }
+        w->initialized = true;
+    }
+
+    /* sync flush adds an empty stored block */
+    ctx->out_size = deflateBound(&ctx->workers[0].zstr, BLOCK_SIZE) + 16;
+
+    /* two blocks per worker: one being compressed, one waiting */
+    ctx->nblocks = (zip_uint64_t)threads * 2;
+    if ((ctx->blocks = (block_t *)calloc((size_t)ctx->nblocks, sizeof(ctx->blocks[0]))) == NULL) {
+        _zip_deflate_parallel_free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    for (i = 0; i < ctx->nblocks; i++) {
+        if ((ctx->blocks[i].in = (zip_uint8_t *)malloc(BLOCK_SIZE)) == NULL || (ctx->blocks[i].out = (zip_uint8_t *)malloc((size_t)ctx->out_size)) == NULL) {
+            _zip_deflate_parallel_free(ctx);
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return NULL;
+        }
+    }
+
+    for (j = 0; j < threads; j++) {
+        if (pthread_create(&ctx->workers[j].thread, NULL, worker_main, ctx->workers + j) != 0) {
+            break;
+        }
+        ctx->nworkers++;
+    }
+    if (ctx->nworkers == 0) {
+        _zip_deflate_parallel_free(ctx);
+        zip_error_set(error, ZIP_ER_INTERNAL, 0);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+
+void
+_zip_deflate_parallel_free(zip_deflate_parallel_t *ctx) {
+    zip_uint64_t i;
+    zip_uint32_t j;
+
+    if (ctx == NULL) {
+        return;
+    }
+
+    if (ctx->nworkers > 0) {
+        pthread_mutex_lock(&ctx->mutex);
+        ctx->stop = true;
+        pthread_cond_broadcast(&ctx->work);
+        pthread_mutex_unlock(&ctx->mutex);
+
+        for (j = 0; j < ctx->nworkers; j++) {
+            pthread_join(ctx->workers[j].thread, NULL);
+        }
+    }
+
+    if (ctx->workers != NULL) {
+        for (j = 0; j < ctx->nstreams; j++) {
+            if (ctx->workers[j].initialized) {
+                deflateEnd(&ctx->workers[j].zstr);
+            }
+        }
+        free(ctx->workers);
+    }
+
+    if (ctx->blocks != NULL) {
+        for (i = 0; i < ctx->nblocks; i++) {
+            free(ctx->blocks[i].in);
+            free(ctx->blocks[i].out);
+        }
+        free(ctx->blocks);
+    }
+
+    pthread_cond_destroy(&ctx->done);
+    pthread_cond_destroy(&ctx->work);
+    pthread_mutex_destroy(&ctx->mutex);
+    free(ctx);
+}
+
+
+bool
+_zip_deflate_parallel_input(zip_deflate_parallel_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    if (ctx->input_length > 0) {
+        zip_error_set(ctx->error, ZIP_ER_INVAL, 0);
+        return false;
+    }
+
+    ctx->input = data;
+    ctx->input_length = length;
+
+    return true;
+}
+
+
+bool
+_zip_deflate_parallel_end_of_input(zip_deflate_parallel_t *ctx) {
+    ctx->end_of_input = true;
+    return ctx->input_length != 0;
+}
+
+
+zip_compression_status_t
+_zip_deflate_parallel_process(zip_deflate_parallel_t *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    block_t *block;
+    block_state_t state;
+    zip_uint64_t n;
+
+    while (true) {
+        /* hand out compressed data in block order as soon as it is ready */
+        if (ctx->next_emit < ctx->next_fill) {
+            block = ctx->blocks + ctx->next_emit % ctx->nblocks;
+
+            pthread_mutex_lock(&ctx->mutex);
+            state = block->state;
+            pthread_mutex_unlock(&ctx->mutex);
+
+            if (state == BLOCK_FAILED) {
+                zip_error_set(ctx->error, ZIP_ER_ZLIB, block->zerr);
+                *length = 0;
+                return ZIP_COMPRESSION_ERROR;
+            }
+            if (state == BLOCK_DONE) {
+                if (block->out_offset == 0) {
+                    ctx->crc = zip_crc32_combine(ctx->crc, block->crc, block->in_length);
+                    ctx->size += block->in_length;
+                }
+                n = ZIP_MIN(*length, block->out_length - block->out_offset);
+                (void)memcpy_s(data, (size_t)*length, block->out + block->out_offset, (size_t)n);
+                block->out_offset += n;
+                if (block->out_offset == block->out_length) {
+                    pthread_mutex_lock(&ctx->mutex);
+                    block->state = BLOCK_FREE;
+                    pthread_mutex_unlock(&ctx->mutex);
+                    ctx->next_emit++;
+                }
+                if (n > 0) {
+                    *length = n;
+                    return ZIP_COMPRESSION_OK;
+                }
+                continue;
+            }
+        }
+
+        if (ctx->input_length == 0 && !ctx->end_of_input) {
+            *length = 0;
+            return ZIP_COMPRESSION_NEED_DATA;
+        }
+
+        if (ctx->input_length == 0 && ctx->last_queued) {
+            if (ctx->next_emit == ctx->next_fill) {
+                *length = 0;
+                return ZIP_COMPRESSION_END;
+            }
+            wait_for_emit(ctx);
+            continue;
+        }
+
+        if (ctx->next_fill - ctx->next_emit >= ctx->nblocks) {
+            /* all blocks busy, wait until the oldest one can be returned */
+            wait_for_emit(ctx);
+            continue;
+        }
+
+        block = fill_block(ctx);
+        if (ctx->input_length > 0) {
+            n = ZIP_MIN(ctx->input_length, BLOCK_SIZE - block->in_length);
+            (void)memcpy_s(block->in + block->in_length, (size_t)(BLOCK_SIZE - block->in_length), ctx->input, (size_t)n);
+            block->in_length += n;
+            ctx->input += n;
+            ctx->input_length -= n;
+            if (block->in_length == BLOCK_SIZE) {
+                queue_block(ctx, false);
+            }
+        }
+        else {
+            /* the last block ends the stream, even if it is empty */
+            queue_block(ctx, true);
+            ctx->last_queued = true;
+        }
+    }
+}
+
+
+void
+_zip_deflate_parallel_result(const zip_deflate_parallel_t *ctx, zip_uint32_t *crc, zip_uint64_t *size) {
+    *crc = ctx->crc;
+    *size = ctx->size;
+}
+
+
+static void
+queue_block(zip_deflate_parallel_t *ctx, bool last) {
+    block_t *block = ctx->blocks + ctx->next_fill % ctx->nblocks;
+
+    /* the next block uses the end of the data seen so far as dictionary */
+    if (block->in_length >= DICTIONARY_SIZE) {
+        (void)memcpy_s(ctx->tail, sizeof(ctx->tail), block->in + block->in_length - DICTIONARY_SIZE, DICTIONARY_SIZE);
+        ctx->tail_length = DICTIONARY_SIZE;
+    }
+    else if (block->in_length > 0) {
+        zip_uint64_t keep = ZIP_MIN(ctx->tail_length, DICTIONARY_SIZE - block->in_length);
+        memmove(ctx->tail, ctx->tail + ctx->tail_length - keep, (size_t)keep);
+        (void)memcpy_s(ctx->tail + keep, (size_t)(sizeof(ctx->tail) - keep), block->in, (size_t)block->in_length);
+        ctx->tail_length = keep + block->in_length;
+    }
+
+    pthread_mutex_lock(&ctx->mutex);
+    block->last = last;
+    block->state = BLOCK_QUEUED;
+    ctx->next_fill++;
+    pthread_cond_signal(&ctx->work);
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+
+static block_t *
+fill_block(zip_deflate_parallel_t *ctx) {
+    block_t *block = ctx->blocks + ctx->next_fill % ctx->nblocks;
+
+    if (block->state == BLOCK_FREE) {
+        block->state = BLOCK_FILLING;
+        block->in_length = 0;
+        block->out_length = 0;
+        block->out_offset = 0;
+        block->dictionary_length = ctx->tail_length;
+        (void)memcpy_s(block->dictionary, sizeof(block->dictionary), ctx->tail, (size_t)ctx->tail_length);
+    }
+
+    return block;
+}
+
+
+static void
+wait_for_emit(zip_deflate_parallel_t *ctx) {
+    block_t *block = ctx->blocks + ctx->next_emit % ctx->nblocks;
+
+    pthread_mutex_lock(&ctx->mutex);
+    while (block->state == BLOCK_QUEUED || block->state == BLOCK_RUNNING) {
+        pthread_cond_wait(&ctx->done, &ctx->mutex);
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+}
+
+
+static void *
+worker_main(void *ud) {
+    struct worker *w = (struct worker *)ud;
+    zip_deflate_parallel_t *ctx = w->ctx;
+    block_t *block;
+
+    pthread_mutex_lock(&ctx->mutex);
+    while (!ctx->stop) {
+        if (ctx->next_run < ctx->next_fill) {
+            block = ctx->blocks + ctx->next_run % ctx->nblocks;
+            ctx->next_run++;
+            block->state = BLOCK_RUNNING;
+            pthread_mutex_unlock(&ctx->mutex);
+
+            compress_block(w, block, ctx->out_size);
+
+            pthread_mutex_lock(&ctx->mutex);
+            block->state = block->zerr == Z_OK ? BLOCK_DONE : BLOCK_FAILED;
+            pthread_cond_broadcast(&ctx->done);
+            continue;
+        }
+        pthread_cond_wait(&ctx->work, &ctx->mutex);
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return NULL;
+}
+
+
+static void
+compress_block(struct worker *w, block_t *block, zip_uint64_t out_size) {
+    int ret;
+
+    block->crc = zip_crc32(0, block->in, block->in_length);
+
+    if ((ret = deflateReset(&w->zstr)) != Z_OK || (block->dictionary_length > 0 && (ret = deflateSetDictionary(&w->zstr, block->dictionary, (uInt)block->dictionary_length)) != Z_OK)) {
+        block->zerr = ret;
+        return;
+    }
+
+    w->zstr.next_in = block->in;
+    w->zstr.avail_in = (uInt)block->in_length;
+    w->zstr.next_out = block->out;
+    w->zstr.avail_out = (uInt)out_size;
+
+    ret = deflate(&w->zstr, block->last ? Z_FINISH : Z_SYNC_FLUSH);
+    block->out_length = out_size - w->zstr.avail_out;
+
+    if (block->last) {
+        block->zerr = ret == Z_STREAM_END ? Z_OK : (ret == Z_OK ? Z_BUF_ERROR : ret);
+    }
+    else {
+        /* output space left means the flush is complete */
+        block->zerr = (ret == Z_OK && w->zstr.avail_in == 0 && w->zstr.avail_out > 0) ? Z_OK : (ret == Z_OK ? Z_BUF_ERROR : ret);
+    }
+}
+
+#else /* HAVE_PTHREAD */
+
+zip_deflate_parallel_t *
+_zip_deflate_parallel_new(int level, int mem_level, zip_uint32_t threads, zip_error_t *error) {
+    (void)level;
+    (void)mem_level;
+    (void)threads;
+    zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+    return NULL;
+}
+
+
+void
+_zip_deflate_parallel_free(zip_deflate_parallel_t *ctx) {
+    (void)ctx;
+}
+
+
+bool
+_zip_deflate_parallel_input(zip_deflate_parallel_t *ctx, zip_uint8_t *data, zip_uint64_t length) {
+    (void)ctx;
+    (void)data;
+    (void)length;
+    return false;
+}
+
+
+bool
+_zip_deflate_parallel_end_of_input(zip_deflate_parallel_t *ctx) {
+    (void)ctx;
+    return false;
+}
+
+
+zip_compression_status_t
+_zip_deflate_parallel_process(zip_deflate_parallel_t *ctx, zip_uint8_t *data, zip_uint64_t *length) {
+    (void)ctx;
+    (void)data;
+    *length = 0;
+    return ZIP_COMPRESSION_ERROR;
+}
+
+
+void
+_zip_deflate_parallel_result(const zip_deflate_parallel_t *ctx, zip_uint32_t *crc, zip_uint64_t *size) {
+    (void)ctx;
+    *crc = 0;
+    *size = 0;
+}
+
+#endif /* HAVE_PTHREAD */
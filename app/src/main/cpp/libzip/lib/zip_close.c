@@ -42,7 +42,6 @@
 #endif
 
 
-static int add_data(zip_t *, zip_source_t *, zip_dirent_t *, zip_uint32_t);
 static int copy_data(zip_t *, zip_uint64_t);
 static int copy_source(zip_t *, zip_source_t *, zip_source_t *, zip_int64_t);
 static int torrentzip_compare_names(const void *a, const void *b);
@@ -55,6 +54,7 @@ zip_close(zip_t *za) {
     zip_int64_t off;
     int error;
     zip_filelist_t *filelist;
+    zip_close_parallel_t *parallel;
     int changed;
 
     if (za == NULL)
@@ -64,7 +64,7 @@ zip_close(zip_t *za) {
 
     if (survivors == 0 && !(za->ch_flags & ZIP_AFL_CREATE_OR_KEEP_FILE_FOR_EMPTY_ARCHIVE)) {
         /* don't create zip files with no entries */
-        if ((za->open_flags & ZIP_TRUNCATE) || changed) {
+        if (((za->open_flags & ZIP_TRUNCATE) || changed) && ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(za->src), ZIP_SOURCE_REMOVE)) {
             if (zip_source_remove(za->src) < 0) {
                 if (!((zip_error_code_zip(zip_source_error(za->src)) == ZIP_ER_REMOVE) && (zip_error_code_system(zip_source_error(za->src)) == ENOENT))) {
                     zip_error_set_from_source(&za->error, za->src);
@@ -165,6 +165,12 @@ zip_close(zip_t *za) {
         free(filelist);
         return -1;
     }
+    /* without seek_write local headers can't be patched after the data, use data descriptors instead */
+    za->write_data_descriptors = !ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(za->src), ZIP_SOURCE_SEEK_WRITE);
+
+    /* compress new data on worker threads; entries not handled there are written below as usual */
+    parallel = _zip_close_parallel_new(za, filelist, survivors, unchanged_offset);
+
     error = 0;
     for (j = 0; j < survivors; j++) {
         int new_data;
@@ -185,6 +191,15 @@ zip_close(zip_t *za) {
             continue;
         }
 
+        if (_zip_close_parallel_has_entry(parallel, j)) {
+            if (_zip_close_parallel_write(parallel, j) < 0) {
+                error = 1;
+                break;
+            }
+            _zip_entry_written(za, i);
+            continue;
+        }
+
         new_data = (ZIP_ENTRY_DATA_CHANGED(entry) || ZIP_ENTRY_CHANGED(entry, ZIP_DIRENT_COMP_METHOD) || ZIP_ENTRY_CHANGED(entry, ZIP_DIRENT_ENCRYPTION_METHOD)) || (ZIP_WANT_TORRENTZIP(za) && !ZIP_IS_TORRENTZIP(za));
 
         /* create new local directory entry */
@@ -224,8 +239,8 @@ zip_close(zip_t *za) {
                 }
             }
 
-            /* add_data writes dirent */
-            if (add_data(za, zs ? zs : entry->source, de, entry->changes ? entry->changes->changed : 0) < 0) {
+            /* _zip_close_add_data writes dirent */
+            if (_zip_close_add_data(za, zs ? zs : entry->source, de, entry->changes ? entry->changes->changed : 0) < 0) {
                 error = 1;
                 if (zs)
                     zip_source_free(zs);
@@ -267,8 +282,12 @@ zip_close(zip_t *za) {
                 }
             }
         }
+
+        _zip_entry_written(za, i);
     }
 
+    _zip_close_parallel_free(parallel);
+
     if (!error) {
         if (write_cdir(za, filelist, survivors) < 0)
             error = 1;
@@ -295,7 +314,8 @@ zip_close(zip_t *za) {
 }
 
 
-static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed) {
+int
+_zip_close_add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed) {
     zip_int64_t offstart, offdata, offend, data_length;
     zip_stat_t st;
     zip_file_attributes_t attributes;
@@ -319,6 +339,11 @@ static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t
         st.comp_method = ZIP_CM_STORE;
     }
 
+    /* with ZIP_AFL_ADAPTIVE_COMPRESSION, pick method and level before compressing all of it */
+    if (_zip_close_sample(za, src, &st, de) < 0) {
+        return -1;
+    }
+
     if (ZIP_CM_IS_DEFAULT(de->comp_method) && st.comp_method != ZIP_CM_STORE) {
         de->comp_method = st.comp_method;
     }
@@ -405,9 +430,9 @@ static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t
 
     needs_recompress = ZIP_WANT_TORRENTZIP(za) || st.comp_method != ZIP_CM_ACTUAL(de->comp_method);
     needs_decompress = needs_recompress && (st.comp_method != ZIP_CM_STORE);
-    /* in these cases we can compute the CRC ourselves, so we do */
-    needs_crc = (st.comp_method == ZIP_CM_STORE) || needs_decompress;
     needs_compress = needs_recompress && (de->comp_method != ZIP_CM_STORE);
+    /* in these cases we can compute the CRC ourselves, so we do, unless block-parallel deflate does it on its threads */
+    needs_crc = (st.comp_method == ZIP_CM_STORE && !(needs_compress && (st.valid & ZIP_STAT_SIZE) && _zip_deflate_parallel_wanted(za, de->comp_method, st.size))) || needs_decompress;
 
     needs_reencrypt = needs_recompress || (de->changed & ZIP_DIRENT_PASSWORD) || (de->encryption_method != st.encryption_method);
     needs_decrypt = needs_reencrypt && (st.encryption_method != ZIP_EM_NONE);
@@ -447,7 +472,8 @@ static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t
         src_final = src_tmp;
     }
 
-    if (needs_crc) {
+    /* when compressing, the compression layer computes the CRC in the same pass over the data */
+    if (needs_crc && !needs_compress) {
         if ((src_tmp = zip_source_crc_create(src_final, 0, &za->error)) == NULL) {
             zip_source_free(src_final);
             return -1;
@@ -457,7 +483,16 @@ static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t
     }
 
     if (needs_compress) {
-        if ((src_tmp = zip_source_compress(za, src_final, de->comp_method, de->compression_level)) == NULL) {
+        /* falling back to stored data would contradict the local header when it can't be rewritten */
+        zip_int32_t method = za->write_data_descriptors ? (zip_int32_t)ZIP_CM_ACTUAL(de->comp_method) : de->comp_method;
+
+        if (needs_crc) {
+            src_tmp = _zip_source_compress_crc(za, src_final, method, de->compression_level);
+        }
+        else {
+            src_tmp = zip_source_compress(za, src_final, method, de->compression_level);
+        }
+        if (src_tmp == NULL) {
             zip_source_free(src_final);
             return -1;
         }
@@ -514,7 +549,17 @@ static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t
         _zip_dirent_apply_attributes(de, &attributes, (flags & ZIP_FL_FORCE_ZIP64) != 0, changed);
     }
 
-    /* as long as we don't support non-seekable output, clear data descriptor bit */
+    if (za->write_data_descriptors) {
+        /* local header can't be rewritten: sizes and CRC go into the data descriptor, the header gets zeros */
+        if (data_length < 0 || de->uncomp_size > 0xffffffffu || de->comp_size > 0xffffffffu) {
+            flags |= ZIP_FL_FORCE_ZIP64;
+        }
+        de->bitflags |= ZIP_GPBF_DATA_DESCRIPTOR;
+        de->crc = 0;
+        de->comp_size = 0;
+        de->uncomp_size = 0;
+    }
+
     if ((is_zip64 = _zip_dirent_write(za, de, flags)) < 0) {
         zip_source_free(src_final);
         return -1;
@@ -565,7 +610,7 @@ static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t
     if (!ZIP_WANT_TORRENTZIP(za)) {
         dirent_changed |= _zip_dirent_apply_attributes(de, &attributes, (flags & ZIP_FL_FORCE_ZIP64) != 0, changed);
 
-        if ((de->changed & ZIP_DIRENT_LAST_MOD) == 0 && !have_dos_time) {
+        if ((de->changed & ZIP_DIRENT_LAST_MOD) == 0 && !have_dos_time && !za->write_data_descriptors) {
             if (st.valid & ZIP_STAT_MTIME) {
                 if (st.mtime != mtime_before_copy) {
                     if (_zip_u2d_time(st.mtime, &de->last_mod, &za->error) < 0) {
@@ -577,7 +622,11 @@ static int add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t
         }
     }
 
-    if (dirent_changed) {
+    if (za->write_data_descriptors) {
+        /* attributes from the source may have cleared the bit, but the local header already announced the descriptor */
+        de->bitflags |= ZIP_GPBF_DATA_DESCRIPTOR;
+    }
+    else if (dirent_changed) {
         if (zip_source_seek_write(za->src, offstart, SEEK_SET) < 0) {
             zip_error_set_from_source(&za->error, za->src);
             return -1;
@@ -647,7 +696,9 @@ copy_data(zip_t *za, zip_uint64_t len) {
 static int
 copy_source(zip_t *za, zip_source_t *src, zip_source_t *src_for_length, zip_int64_t data_length) {
     DEFINE_BYTE_ARRAY(buf, BUFSIZE);
+    const zip_uint8_t *data = NULL;
     zip_int64_t n, current;
+    bool borrow;
     int ret;
 
     if (zip_source_open(src) < 0) {
@@ -660,10 +711,13 @@ copy_source(zip_t *za, zip_source_t *src, zip_source_t *src_for_length, zip_int6
         return -1;
     }
 
+    /* stored data from a mapped file is written straight from the mapping */
+    borrow = ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(src), ZIP_SOURCE_BORROW);
+
     ret = 0;
     current = 0;
-    while ((n = zip_source_read(src, buf, BUFSIZE)) > 0) {
-        if (_zip_write(za, buf, (zip_uint64_t)n) < 0) {
+    while ((n = borrow ? _zip_source_borrow(src, &data, BUFSIZE) : zip_source_read(src, buf, BUFSIZE)) > 0) {
+        if (_zip_write(za, borrow ? data : buf, (zip_uint64_t)n) < 0) {
             ret = -1;
             break;
         }
@@ -0,0 +1,567 @@
+/*
+  zip_close_parallel.c -- compress new entry data concurrently in zip_close
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+  Each job runs _zip_close_add_data() for one entry on a worker thread,
+  with a private copy of the archive structure whose output is an
+  in-memory buffer source.  The buffer thus holds exactly the bytes the
+  serial code would have written (local header, data, data descriptor);
+  zip_close() copies it to the archive in the original entry order.
+
+  Only entries whose data comes from a user supplied source that does
+  not read from an archive are handled here, since those are the only
+  sources that are not shared with the archive being written or with
+  other entries.  Encrypted entries and entries whose size is unknown or
+  exceeds the memory limit are left to the serial code, as are entries
+  large enough to be deflated in blocks on all threads.
+*/
+
+#include "zipint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <time.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#define WAIT_INTERVAL_MS 10
+
+struct zip_close_job {
+    zip_uint64_t position; /* index into filelist */
+    zip_uint64_t index;    /* index of entry in archive */
+    zip_uint64_t estimate; /* memory reserved before compression */
+    zip_uint64_t size;     /* size of data in spill buffer */
+    zip_t za;              /* private archive state, src is spill buffer */
+    bool done;
+    int ret;
+};
+
+typedef struct zip_close_job zip_close_job_t;
+
+struct zip_close_parallel {
+    zip_t *za;
+
+    zip_close_job_t *jobs;
+    zip_uint64_t njobs;
+    zip_uint64_t next_job;   /* next job to hand to a worker */
+    zip_uint64_t next_write; /* next job to write to archive */
+
+    zip_uint64_t memory_limit;
+    zip_uint64_t memory_used;
+
+    bool abort;
+
+    bool synchronized; /* mutex and cond are initialized */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t *threads;
+    zip_uint32_t nthreads;
+};
+
+static bool entry_is_eligible(zip_t *za, zip_uint64_t index, zip_uint64_t unchanged_offset, zip_uint64_t memory_limit, zip_uint64_t *estimate);
+static bool job_init(zip_close_parallel_t *ctx, zip_close_job_t *job, zip_uint64_t position, zip_uint64_t index, zip_uint64_t estimate);
+static void job_fini(zip_close_job_t *job);
+static int job_cancel_callback(zip_t *za, void *ud);
+static void job_run(zip_close_parallel_t *ctx, zip_close_job_t *job);
+static bool source_reads_archive(zip_source_t *src);
+static void *worker(void *ud);
+
+
+zip_close_parallel_t *
+_zip_close_parallel_new(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_uint64_t unchanged_offset) {
+    zip_close_parallel_t *ctx;
+    zip_uint64_t j, estimate;
+    zip_uint32_t nthreads, i;
+
+    if ((za->ch_flags & ZIP_AFL_PARALLEL_CLOSE) == 0 || (nthreads = _zip_parallel_threads(za)) < 2) {
+        return NULL;
+    }
+
+    if ((ctx = (zip_close_parallel_t *)malloc(sizeof(*ctx))) == NULL) {
+        return NULL;
+    }
+    ctx->za = za;
+    ctx->njobs = ctx->next_job = ctx->next_write = 0;
+    ctx->memory_limit = za->close_memory_limit;
+    ctx->memory_used = 0;
+    ctx->abort = false;
+    ctx->synchronized = false;
+    ctx->threads = NULL;
+    ctx->nthreads = 0;
+
+    if ((ctx->jobs = (zip_close_job_t *)malloc(sizeof(ctx->jobs[0]) * (size_t)survivors)) == NULL) {
+        free(ctx);
+        return NULL;
+    }
+
+    for (j = 0; j < survivors; j++) {
+        if (!entry_is_eligible(za, filelist[j].idx, unchanged_offset, ctx->memory_limit, &estimate)) {
+            continue;
+        }
+        if (!job_init(ctx, ctx->jobs + ctx->njobs, j, filelist[j].idx, estimate)) {
+            break;
+        }
+        ctx->njobs++;
+    }
+
+    if (ctx->njobs < 2) {
+        /* nothing to gain, let zip_close() do everything */
+        _zip_close_parallel_free(ctx);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&ctx->mutex, NULL) != 0) {
+        _zip_close_parallel_free(ctx);
+        return NULL;
+    }
+    if (pthread_cond_init(&ctx->cond, NULL) != 0) {
+        pthread_mutex_destroy(&ctx->mutex);
+        _zip_close_parallel_free(ctx);
+        return NULL;
+    }
+    ctx->synchronized = true;
+
+    nthreads = (zip_uint32_t)ZIP_MIN(nthreads, ctx->njobs);
+    if ((ctx->threads = (pthread_t *)malloc(sizeof(ctx->threads[0]) * nthreads)) != NULL) {
+        for (i = 0; i < nthreads; i++) {
+            if (pthread_create(ctx->threads + ctx->nthreads, NULL, worker, ctx) != 0) {
+                break;
+            }
+            ctx->nthreads++;
+        }
+    }
+
+    if (ctx->nthreads == 0) {
+        /* jobs prepared so far have not touched their sources, serial code can handle them */
+        _zip_close_parallel_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+
+void
+_zip_close_parallel_free(zip_close_parallel_t *ctx) {
+    zip_uint64_t j;
+    zip_uint32_t i;
+
+    if (ctx == NULL) {
+        return;
+    }
+
+    if (ctx->nthreads > 0) {
+        pthread_mutex_lock(&ctx->mutex);
+        ctx->abort = true;
+        pthread_cond_broadcast(&ctx->cond);
+        pthread_mutex_unlock(&ctx->mutex);
+
+        for (i = 0; i < ctx->nthreads; i++) {
+            pthread_join(ctx->threads[i], NULL);
+        }
+    }
+    free(ctx->threads);
+    if (ctx->synchronized) {
+        pthread_cond_destroy(&ctx->cond);
+        pthread_mutex_destroy(&ctx->mutex);
+    }
+
+    for (j = 0; j < ctx->njobs; j++) {
+        job_fini(ctx->jobs + j);
+    }
+    free(ctx->jobs);
+    free(ctx);
+}
+
+
+bool
+_zip_close_parallel_has_entry(const zip_close_parallel_t *ctx, zip_uint64_t position) {
+    if (ctx == NULL || ctx->next_write >= ctx->njobs) {
+        return false;
+    }
+    return ctx->jobs[ctx->next_write].position == position;
+}
+
+
+int
+_zip_close_parallel_write(zip_close_parallel_t *ctx, zip_uint64_t position) {
+    DEFINE_BYTE_ARRAY(buf, BUFSIZE);
+    zip_t *za = ctx->za;
+    zip_close_job_t *job = ctx->jobs + ctx->next_write;
+    zip_source_t *spill = job->za.src;
+    zip_uint64_t len;
+    zip_int64_t off;
+    double total;
+    int ret;
+
+    if (job->position != position) {
+        zip_error_set(&za->error, ZIP_ER_INTERNAL, 0);
+        return -1;
+    }
+
+    pthread_mutex_lock(&ctx->mutex);
+    while (!job->done) {
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += WAIT_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&ctx->cond, &ctx->mutex, &deadline);
+
+        if (!job->done) {
+            /* keep cancel callback responsive while workers compress */
+            pthread_mutex_unlock(&ctx->mutex);
+            if (_zip_progress_update(za->progress, 0.0) != 0) {
+                zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+                return -1;
+            }
+            pthread_mutex_lock(&ctx->mutex);
+        }
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+
+    if (job->ret < 0) {
+        _zip_error_copy(&za->error, &job->za.error);
+        return -1;
+    }
+
+    if ((off = zip_source_tell_write(za->src)) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        return -1;
+    }
+    za->entry[job->index].changes->offset = (zip_uint64_t)off;
+
+    if (zip_source_open(spill) < 0) {
+        zip_error_set_from_source(&za->error, spill);
+        return -1;
+    }
+
+    if (!byte_array_init(buf, BUFSIZE)) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        zip_source_close(spill);
+        return -1;
+    }
+
+    ret = 0;
+    len = job->size;
+    total = (double)len;
+    while (len > 0) {
+        zip_uint64_t n = ZIP_MIN(len, BUFSIZE);
+
+        if (_zip_read(spill, buf, n, &za->error) < 0 || _zip_write(za, buf, n) < 0) {
+            ret = -1;
+            break;
+        }
+
+        len -= n;
+
+        if (_zip_progress_update(za->progress, (total - (double)len) / total) != 0) {
+            zip_error_set(&za->error, ZIP_ER_CANCELLED, 0);
+            ret = -1;
+            break;
+        }
+    }
+
+    byte_array_fini(buf);
+    zip_source_close(spill);
+
+    if (ret < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&ctx->mutex);
+    ctx->memory_used -= job->size;
+    ctx->next_write++;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->mutex);
+
+    /* release memory early, the central directory is written from the dirent */
+    job_fini(job);
+
+    return 0;
+}
+
+
+static bool
+entry_is_eligible(zip_t *za, zip_uint64_t index, zip_uint64_t unchanged_offset, zip_uint64_t memory_limit, zip_uint64_t *estimate) {
+    zip_entry_t *entry = za->entry + index;
+    zip_dirent_t *de;
+    zip_stat_t st;
+    zip_uint64_t size;
+    zip_compression_algorithm_t *algorithm;
+
+    if (entry->orig != NULL && entry->orig->offset < unchanged_offset) {
+        return false;
+    }
+    if (!ZIP_ENTRY_DATA_CHANGED(entry) || source_reads_archive(entry->source)) {
+        return false;
+    }
+
+    de = entry->changes ? entry->changes : entry->orig;
+    if (de == NULL || de->encryption_method != ZIP_EM_NONE) {
+        return false;
+    }
+
+    if (zip_source_stat(entry->source, &st) < 0) {
+        /* zip_close() will report the error when it gets to this entry */
+        return false;
+    }
+    if ((st.valid & ZIP_STAT_SIZE) == 0) {
+        return false;
+    }
+
+    if (_zip_deflate_parallel_wanted(za, de->comp_method, st.size)) {
+        /* zip_close() deflates it in blocks using all threads */
+        return false;
+    }
+
+    size = st.size;
+    if (ZIP_CM_ACTUAL(de->comp_method) != ZIP_CM_STORE || ZIP_WANT_TORRENTZIP(za)) {
+        if ((algorithm = _zip_get_compression_algorithm(ZIP_CM_ACTUAL(de->comp_method), true)) == NULL) {
+            return false;
+        }
+        size = ZIP_MAX(size, algorithm->maximum_compressed_size(st.size));
+    }
+    if (size > memory_limit) {
+        return false;
+    }
+
+    /* same preparation zip_close() does, it needs the archive source */
+    if (entry->changes == NULL) {
+        if ((entry->changes = _zip_dirent_clone(entry->orig)) == NULL) {
+            return false;
+        }
+    }
+    if (_zip_read_local_ef(za, index) < 0) {
+        zip_error_clear(za);
+        return false;
+    }
+    if (ZIP_WANT_TORRENTZIP(za)) {
+        zip_dirent_torrentzip_normalize(entry->changes);
+    }
+
+    *estimate = size;
+    return true;
+}
+
+
+static bool
+job_init(zip_close_parallel_t *ctx, zip_close_job_t *job, zip_uint64_t position, zip_uint64_t index, zip_uint64_t estimate) {
+    job->position = position;
+    job->index = index;
+    job->estimate = estimate;
+    job->size = 0;
+    job->done = false;
+    job->ret = 0;
+
+    /* the copy shares everything _zip_close_add_data() reads, but writes to its own buffer */
+    job->za = *ctx->za;
+    job->za.progress = NULL;
+    job->za.write_crc = NULL;
+    zip_error_init(&job->za.error);
+
+    if ((job->za.src = zip_source_buffer_create(NULL, 0, 0, &job->za.error)) == NULL) {
+        return false;
+    }
+    if (zip_register_cancel_callback_with_state(&job->za, job_cancel_callback, NULL, ctx) < 0) {
+        zip_source_free(job->za.src);
+        job->za.src = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+
+static void
+job_fini(zip_close_job_t *job) {
+    if (job->za.src != NULL) {
+        zip_source_free(job->za.src);
+        job->za.src = NULL;
+    }
+    _zip_progress_free(job->za.progress);
+    job->za.progress = NULL;
+    zip_error_fini(&job->za.error);
+}
+
+
+static int
+job_cancel_callback(zip_t *za, void *ud) {
+    zip_close_parallel_t *ctx = (zip_close_parallel_t *)ud;
+    bool abort;
+
+    (void)za;
+
+    pthread_mutex_lock(&ctx->mutex);
+    abort = ctx->abort;
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return abort ? 1 : 0;
+}
+
+
+static void
+job_run(zip_close_parallel_t *ctx, zip_close_job_t *job) {
+    zip_t *za = &job->za;
+    zip_entry_t *entry = ctx->za->entry + job->index;
+    zip_int64_t size;
+
+    if (zip_source_begin_write(za->src) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        job->ret = -1;
+        return;
+    }
+
+    if (_zip_close_add_data(za, entry->source, entry->changes, entry->changes->changed) < 0) {
+        zip_source_rollback_write(za->src);
+        job->ret = -1;
+        return;
+    }
+
+    if ((size = zip_source_tell_write(za->src)) < 0 || zip_source_commit_write(za->src) < 0) {
+        zip_error_set_from_source(&za->error, za->src);
+        job->ret = -1;
+        return;
+    }
+
+    job->size = (zip_uint64_t)size;
+}
+
+
+zip_uint32_t
+_zip_parallel_threads(const zip_t *za) {
+    if (za->close_threads > 0) {
+        return za->close_threads;
+    }
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n > 0) {
+            return (zip_uint32_t)ZIP_MIN(n, ZIP_UINT16_MAX);
+        }
+    }
+#endif
+    return 1;
+}
+
+
+static bool
+source_reads_archive(zip_source_t *src) {
+    for (; src != NULL; src = src->src) {
+        if (src->source_archive != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void *
+worker(void *ud) {
+    zip_close_parallel_t *ctx = (zip_close_parallel_t *)ud;
+    zip_close_job_t *job;
+
+    pthread_mutex_lock(&ctx->mutex);
+    while (!ctx->abort && ctx->next_job < ctx->njobs) {
+        job = ctx->jobs + ctx->next_job;
+
+        /* the oldest unwritten job may always run, so the writer can't starve */
+        if (ctx->next_job != ctx->next_write && ctx->memory_used + job->estimate > ctx->memory_limit) {
+            pthread_cond_wait(&ctx->cond, &ctx->mutex);
+            continue;
+        }
+
+        ctx->next_job++;
+        ctx->memory_used += job->estimate;
+        pthread_mutex_unlock(&ctx->mutex);
+
+        job_run(ctx, job);
+
+        pthread_mutex_lock(&ctx->mutex);
+        ctx->memory_used = ctx->memory_used - job->estimate + job->size;
+        job->done = true;
+        pthread_cond_broadcast(&ctx->cond);
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return NULL;
+}
+
+#else /* HAVE_PTHREAD */
+
+zip_close_parallel_t *
+_zip_close_parallel_new(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_uint64_t unchanged_offset) {
+    (void)za;
+    (void)filelist;
+    (void)survivors;
+    (void)unchanged_offset;
+    return NULL;
+}
+
+
+void
+_zip_close_parallel_free(zip_close_parallel_t *ctx) {
+    (void)ctx;
+}
+
+
+bool
+_zip_close_parallel_has_entry(const zip_close_parallel_t *ctx, zip_uint64_t position) {
+    (void)ctx;
+    (void)position;
+    return false;
+}
+
+
+int
+_zip_close_parallel_write(zip_close_parallel_t *ctx, zip_uint64_t position) {
+    (void)ctx;
+    (void)position;
+    return -1;
+}
+
+
+zip_uint32_t
+_zip_parallel_threads(const zip_t *za) {
+    (void)za;
+    return 1;
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,255 @@
+/*
+  zip_close_sample.c -- choose compression for an entry from samples of its data
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include <stdlib.h>
+
+#include "zipint.h"
+
+/* Entries smaller than this are compressed anyway, zip_source_compress() stores them if that doesn't help. */
+#define SAMPLE_MIN_SIZE (64 * 1024)
+#define SAMPLE_COUNT 4
+#define SAMPLE_SIZE (32 * 1024)
+
+/* byte entropy in bits per byte, 16.16 fixed point; below this the data is compressible without trying */
+#define ENTROPY_TRIAL_THRESHOLD (6u << 16)
+/* compressed to uncompressed ratio in percent of a trial at level 1 */
+#define STORE_RATIO 95
+#define FAST_RATIO 80
+#define FAST_LEVEL 1
+
+static int read_samples(zip_t *za, zip_source_t *src, zip_uint64_t size, zip_uint8_t *buffer, zip_uint64_t *sample_size, zip_uint64_t *length);
+static zip_uint32_t entropy(const zip_uint8_t *data, zip_uint64_t length);
+static zip_uint32_t log2_fixed(zip_uint64_t x);
+static int trial_ratio(zip_t *za, zip_uint8_t *data, zip_uint64_t length, zip_uint64_t sample_size, zip_uint64_t *ratio);
+
+
+/* Decide between storing and a deflate level for data that would otherwise be deflated at the default level, before it is compressed in full. */
+
+int
+_zip_close_sample(zip_t *za, zip_source_t *src, const zip_stat_t *st, zip_dirent_t *de) {
+    zip_uint8_t *buffer;
+    zip_uint64_t length, sample_size, ratio;
+    int ret;
+
+    if ((za->ch_flags & ZIP_AFL_ADAPTIVE_COMPRESSION) == 0 || ZIP_WANT_TORRENTZIP(za)) {
+        return 0;
+    }
+    if (!ZIP_CM_IS_DEFAULT(de->comp_method) || de->compression_level != 0) {
+        return 0;
+    }
+    if (st->comp_method != ZIP_CM_STORE || ((st->valid & ZIP_STAT_ENCRYPTION_METHOD) && st->encryption_method != ZIP_EM_NONE) || (st->valid & ZIP_STAT_SIZE) == 0 || st->size < SAMPLE_MIN_SIZE) {
+        return 0;
+    }
+    if (!ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(src), ZIP_SOURCE_SEEK)) {
+        return 0;
+    }
+
+    if ((buffer = (zip_uint8_t *)malloc(SAMPLE_COUNT * SAMPLE_SIZE)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
+        return -1;
+    }
+
+    if ((ret = read_samples(za, src, st->size, buffer, &sample_size, &length)) == 0) {
+        if (entropy(buffer, length) >= ENTROPY_TRIAL_THRESHOLD) {
+            if ((ret = trial_ratio(za, buffer, length, sample_size, &ratio)) == 0) {
+                if (ratio >= STORE_RATIO) {
+                    de->comp_method = ZIP_CM_STORE;
+                }
+                else if (ratio >= FAST_RATIO) {
+                    de->compression_level = FAST_LEVEL;
+                }
+            }
+        }
+    }
+
+    free(buffer);
+    return ret;
+}
+
+
+/* Read SAMPLE_COUNT blocks spread evenly over the data, or all of it if it is shorter. */
+
+static int
+read_samples(zip_t *za, zip_source_t *src, zip_uint64_t size, zip_uint8_t *buffer, zip_uint64_t *sample_size, zip_uint64_t *length) {
+    zip_uint64_t i, count, offset, done;
+    zip_int64_t n;
+
+    if (size <= SAMPLE_COUNT * SAMPLE_SIZE) {
+        count = 1;
+        *sample_size = size;
+    }
+    else {
+        count = SAMPLE_COUNT;
+        *sample_size = SAMPLE_SIZE;
+    }
+
+    if (zip_source_open(src) < 0) {
+        zip_error_set_from_source(&za->error, src);
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        offset = count == 1 ? 0 : (size - SAMPLE_SIZE) / (SAMPLE_COUNT - 1) * i;
+
+        if (zip_source_seek(src, (zip_int64_t)offset, SEEK_SET) < 0) {
+            zip_error_set_from_source(&za->error, src);
+            zip_source_close(src);
+            return -1;
+        }
+        for (done = 0; done < *sample_size; done += (zip_uint64_t)n) {
+            if ((n = zip_source_read(src, buffer + i * *sample_size + done, *sample_size - done)) < 0) {
+                zip_error_set_from_source(&za->error, src);
+                zip_source_close(src);
+                return -1;
+            }
+            if (n == 0) {
+                /* data shorter than stat claimed, zip_close() reports it when copying */
+                zip_source_close(src);
+                *length = i * *sample_size + done;
+                *sample_size = *length;
+                return 0;
+            }
+        }
+    }
+
+    zip_source_close(src);
+    *length = count * *sample_size;
+    return 0;
+}
+
+
+static zip_uint32_t
+entropy(const zip_uint8_t *data, zip_uint64_t length) {
+    zip_uint64_t counts[256] = {0};
+    zip_uint64_t i, sum;
+
+    if (length == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < length; i++) {
+        counts[data[i]]++;
+    }
+
+    /* H = log2(n) - sum(c * log2(c)) / n */
+    sum = 0;
+    for (i = 0; i < 256; i++) {
+        if (counts[i] > 0) {
+            sum += counts[i] * log2_fixed(counts[i]);
+        }
+    }
+
+    return log2_fixed(length) - (zip_uint32_t)(sum / length);
+}
+
+
+/* log2(x) in 16.16 fixed point, x > 0 */
+
+static zip_uint32_t
+log2_fixed(zip_uint64_t x) {
+    zip_uint32_t result = 0;
+    zip_uint64_t y;
+    int i;
+
+    while (result < 63 && x >> (result + 1) != 0) {
+        result++;
+    }
+    /* mantissa in [1, 2) with 30 fractional bits */
+    y = result <= 30 ? x << (30 - result) : x >> (result - 30);
+    result <<= 16;
+
+    for (i = 15; i >= 0; i--) {
+        y = (y * y) >> 30;
+        if (y >= (zip_uint64_t)1 << 31) {
+            y >>= 1;
+            result |= 1u << i;
+        }
+    }
+
+    return result;
+}
+
+
+/* Deflate each sample on its own at FAST_LEVEL and return compressed size in percent of the input. */
+
+static int
+trial_ratio(zip_t *za, zip_uint8_t *data, zip_uint64_t length, zip_uint64_t sample_size, zip_uint64_t *ratio) {
+    zip_compression_algorithm_t *algorithm;
+    zip_compression_status_t status;
+    zip_uint8_t out[BUFSIZE];
+    zip_uint64_t offset, out_length, compressed;
+    zip_stat_t st;
+    zip_file_attributes_t attributes;
+    void *ud;
+
+    if ((algorithm = _zip_get_compression_algorithm(ZIP_CM_DEFLATE, true)) == NULL) {
+        zip_error_set(&za->error, ZIP_ER_COMPNOTSUPP, 0);
+        return -1;
+    }
+    if ((ud = algorithm->allocate(ZIP_CM_DEFLATE, FAST_LEVEL, &za->error)) == NULL) {
+        return -1;
+    }
+
+    zip_stat_init(&st);
+    zip_file_attributes_init(&attributes);
+    compressed = 0;
+
+    for (offset = 0; offset < length; offset += sample_size) {
+        if (!algorithm->start(ud, &st, &attributes)) {
+            algorithm->deallocate(ud);
+            return -1;
+        }
+        if (!algorithm->input(ud, data + offset, ZIP_MIN(sample_size, length - offset)) || !algorithm->end_of_input(ud)) {
+            algorithm->end(ud);
+            algorithm->deallocate(ud);
+            return -1;
+        }
+        do {
+            out_length = sizeof(out);
+            status = algorithm->process(ud, out, &out_length);
+            compressed += out_length;
+        } while (status == ZIP_COMPRESSION_OK);
+
+        if (!algorithm->end(ud) || status != ZIP_COMPRESSION_END) {
+            algorithm->deallocate(ud);
+            return -1;
+        }
+    }
+
+    algorithm->deallocate(ud);
+
+    *ratio = length > 0 ? compressed * 100 / length : 100;
+    return 0;
+}
@@ -0,0 +1,397 @@
+/*
+  zip_crc32.c -- CRC-32 with hardware acceleration
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+  The CRC-32 used by zip (the one zlib computes), chosen at run time:
+  - x86 with PCLMULQDQ: fold 64 bytes per iteration with carry-less
+    multiplication (Intel, "Fast CRC Computation for Generic Polynomials
+    Using PCLMULQDQ Instruction").
+  - ARMv8 with the CRC32 extension: the crc32x instruction, 8 bytes at a time.
+  - otherwise: slice-by-16 tables.
+
+  Internally the CRC is kept inverted, as in the tables' definition;
+  zip_crc32() inverts on entry and exit.
+*/
+
+#include "zipint.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_PCLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__)
+#define CRC32_ARM
+#include <arm_acle.h>
+#if !defined(__ARM_FEATURE_CRC32) && defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+#endif
+
+#define CRC32_POLY 0xedb88320u
+
+typedef zip_uint32_t (*crc32_function_t)(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length);
+
+static zip_uint32_t crc32_table[16][256];
+static zip_uint32_t x2n_table[32];
+static crc32_function_t crc32_implementation;
+
+static void crc32_init(void);
+static zip_uint32_t crc32_slice16(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length);
+static zip_uint32_t multmodp(zip_uint32_t a, zip_uint32_t b);
+static zip_uint32_t x2nmodp(zip_uint64_t n, unsigned int k);
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+#define CRC32_INIT() pthread_once(&crc32_once, crc32_init)
+#else
+#define CRC32_INIT()                      \
+    do {                                  \
+        if (crc32_implementation == NULL) \
+            crc32_init();                 \
+    } while (0)
+#endif
+
+
+ZIP_EXTERN zip_uint32_t
+zip_crc32(zip_uint32_t crc, const void *data, zip_uint64_t length) {
+    if (data == NULL || length == 0) {
+        return crc;
+    }
+
+    CRC32_INIT();
+
+    return ~crc32_implementation(~crc, (const zip_uint8_t *)data, length);
+}
+
+
+ZIP_EXTERN zip_uint32_t
+zip_crc32_combine(zip_uint32_t crc1, zip_uint32_t crc2, zip_uint64_t length2) {
+    CRC32_INIT();
+
+    return multmodp(x2nmodp(length2, 3), crc1) ^ crc2;
+}
+
+
+static zip_uint32_t
+crc32_slice16(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    while (length >= 16) {
+        crc = crc32_table[15][(crc ^ data[0]) & 0xff] ^ crc32_table[14][((crc >> 8) ^ data[1]) & 0xff] ^ crc32_table[13][((crc >> 16) ^ data[2]) & 0xff] ^ crc32_table[12][((crc >> 24) ^ data[3]) & 0xff]
+              ^ crc32_table[11][data[4]] ^ crc32_table[10][data[5]] ^ crc32_table[9][data[6]] ^ crc32_table[8][data[7]]
+              ^ crc32_table[7][data[8]] ^ crc32_table[6][data[9]] ^ crc32_table[5][data[10]] ^ crc32_table[4][data[11]]
+              ^ crc32_table[3][data[12]] ^ crc32_table[2][data[13]] ^ crc32_table[1][data[14]] ^ crc32_table[0][data[15]];
+        data += 16;
+        length -= 16;
+    }
+
+    while (length > 0) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *data) & 0xff];
+        data++;
+        length--;
+    }
+
+    return crc;
+}
+
+
+#ifdef CRC32_PCLMUL
+/* Constants from the paper, for the bit-reflected polynomial. */
+static const zip_uint64_t pclmul_k1k2[2] __attribute__((aligned(16))) = {0x0154442bd4, 0x01c6e41596};
+static const zip_uint64_t pclmul_k3k4[2] __attribute__((aligned(16))) = {0x01751997d0, 0x00ccaa009e};
+static const zip_uint64_t pclmul_k5k0[2] __attribute__((aligned(16))) = {0x0163cd6124, 0x0000000000};
+static const zip_uint64_t pclmul_poly[2] __attribute__((aligned(16))) = {0x01db710641, 0x01f7011641};
+
+/* length must be a multiple of 16, at least 64 */
+__attribute__((target("pclmul,sse4.1"))) static zip_uint32_t
+crc32_pclmul_fold(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    x0 = _mm_load_si128((const __m128i *)pclmul_k1k2);
+
+    data += 64;
+    length -= 64;
+
+    /* fold four blocks of 16 bytes in parallel */
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        length -= 64;
+    }
+
+    /* fold into 128 bits */
+    x0 = _mm_load_si128((const __m128i *)pclmul_k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* remaining blocks of 16 bytes */
+    while (length >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)data);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        length -= 16;
+    }
+
+    /* fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i *)pclmul_k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)pclmul_poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (zip_uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+
+static zip_uint32_t
+crc32_pclmul(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    if (length >= 64) {
+        zip_uint64_t n = length & ~(zip_uint64_t)15;
+
+        crc = crc32_pclmul_fold(crc, data, n);
+        data += n;
+        length -= n;
+    }
+
+    return crc32_slice16(crc, data, length);
+}
+
+
+static bool
+have_pclmul(void) {
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif /* CRC32_PCLMUL */
+
+
+#ifdef CRC32_ARM
+#if defined(__clang__)
+#define CRC32_TARGET_ARM __attribute__((target("crc")))
+#else
+#define CRC32_TARGET_ARM __attribute__((target("+crc")))
+#endif
+
+CRC32_TARGET_ARM static zip_uint32_t
+crc32_arm(zip_uint32_t crc, const zip_uint8_t *data, zip_uint64_t length) {
+    while (length > 0 && ((uintptr_t)data & 7) != 0) {
+        crc = __crc32b(crc, *data);
+        data++;
+        length--;
+    }
+
+    while (length >= 32) {
+        zip_uint64_t v[4];
+
+        (void)memcpy_s(v, sizeof(v), data, sizeof(v));
+        crc = __crc32d(crc, v[0]);
+        crc = __crc32d(crc, v[1]);
+        crc = __crc32d(crc, v[2]);
+        crc = __crc32d(crc, v[3]);
+        data += 32;
+        length -= 32;
+    }
+
+    while (length >= 8) {
+        zip_uint64_t v;
+
+        (void)memcpy_s(&v, sizeof(v), data, sizeof(v));
+        crc = __crc32d(crc, v);
+        data += 8;
+        length -= 8;
+    }
+
+    while (length > 0) {
+        crc = __crc32b(crc, *data);
+        data++;
+        length--;
+    }
+
+    return crc;
+}
+
+
+static bool
+have_arm_crc32(void) {
+#if defined(__ARM_FEATURE_CRC32)
+    return true;
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return false;
+#endif
+}
+#endif /* CRC32_ARM */
+
+
+static void
+crc32_init(void) {
+    zip_uint32_t i, j, c, p;
+
+    for (i = 0; i < 256; i++) {
+        c = i;
+        for (j = 0; j < 8; j++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+        }
+        crc32_table[0][i] = c;
+    }
+    for (i = 0; i < 256; i++) {
+        c = crc32_table[0][i];
+        for (j = 1; j < 16; j++) {
+            c = (c >> 8) ^ crc32_table[0][c & 0xff];
+            crc32_table[j][i] = c;
+        }
+    }
+
+    /* x^(2^n) mod p, starting from x^1 */
+    p = (zip_uint32_t)1 << 30;
+    x2n_table[0] = p;
+    for (i = 1; i < 32; i++) {
+        x2n_table[i] = p = multmodp(p, p);
+    }
+
+    crc32_implementation = crc32_slice16;
+#ifdef CRC32_PCLMUL
+    if (have_pclmul()) {
+        crc32_implementation = crc32_pclmul;
+    }
+#endif
+#ifdef CRC32_ARM
+    if (have_arm_crc32()) {
+        crc32_implementation = crc32_arm;
+    }
+#endif
+}
+
+
+/* a * b mod p, polynomials in reflected bit order */
+static zip_uint32_t
+multmodp(zip_uint32_t a, zip_uint32_t b) {
+    zip_uint32_t m, p;
+
+    m = (zip_uint32_t)1 << 31;
+    p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+    }
+    return p;
+}
+
+
+/* x^(n * 2^k) mod p */
+static zip_uint32_t
+x2nmodp(zip_uint64_t n, unsigned int k) {
+    zip_uint32_t p;
+
+    p = (zip_uint32_t)1 << 31; /* x^0 == 1 */
+    while (n) {
+        if (n & 1) {
+            p = multmodp(x2n_table[k & 31], p);
+        }
+        n >>= 1;
+        k++;
+    }
+    return p;
+}
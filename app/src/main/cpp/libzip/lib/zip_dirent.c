@@ -37,7 +37,6 @@
 #include <string.h>
 #include <sys/types.h>
 #include <time.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
@@ -58,6 +57,7 @@ _zip_cdir_free(zip_cdir_t *cd) {
         _zip_entry_finalize(cd->entry + i);
     free(cd->entry);
     _zip_string_free(cd->comment);
+    _zip_lazy_cdir_free(cd->lazy);
     free(cd);
 }
 
@@ -76,6 +76,7 @@ _zip_cdir_new(zip_error_t *error) {
     cd->size = cd->offset = 0;
     cd->comment = NULL;
     cd->is_zip64 = false;
+    cd->lazy = NULL;
 
     return cd;
 }
@@ -131,7 +132,7 @@ _zip_cdir_write(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivor
     offset = (zip_uint64_t)off;
 
     if (ZIP_WANT_TORRENTZIP(za)) {
-        cdir_crc = (zip_uint32_t)crc32(0, NULL, 0);
+        cdir_crc = 0;
         za->write_crc = &cdir_crc;
     }
 
@@ -1150,6 +1151,9 @@ _zip_get_dirent(zip_t *za, zip_uint64_t idx, zip_flags_t flags, zip_error_t *err
     }
 
     if ((flags & ZIP_FL_UNCHANGED) || za->entry[idx].changes == NULL) {
+        if (!_zip_lazy_cdir_load(za, idx, error)) {
+            return NULL;
+        }
         if (za->entry[idx].orig == NULL) {
             zip_error_set(error, ZIP_ER_INVAL, 0);
             return NULL;
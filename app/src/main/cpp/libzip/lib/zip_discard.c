@@ -58,12 +58,14 @@ zip_discard(zip_t *za) {
     _zip_string_free(za->comment_changes);
 
     _zip_hash_free(za->names);
+    _zip_name_index_reset(za);
 
     if (za->entry) {
         for (i = 0; i < za->nentry; i++)
             _zip_entry_finalize(za->entry + i);
         free(za->entry);
     }
+    _zip_lazy_cdir_free(za->lazy_cdir);
 
     for (i = 0; i < za->nopen_source; i++) {
         _zip_source_invalidate(za->open_source[i]);
@@ -71,6 +73,9 @@ zip_discard(zip_t *za) {
     free(za->open_source);
 
     _zip_progress_free(za->progress);
+    if (za->entry_written_ud_free) {
+        za->entry_written_ud_free(za->entry_written_ud);
+    }
 
     zip_error_fini(&za->error);
 
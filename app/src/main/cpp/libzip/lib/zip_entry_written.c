@@ -0,0 +1,84 @@
+/*
+  zip_entry_written.c -- report entries written by zip_close()
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "zipint.h"
+
+
+ZIP_EXTERN int
+zip_register_entry_written_callback_with_state(zip_t *za, zip_entry_written_callback callback, void (*ud_free)(void *), void *ud) {
+    if (za->entry_written_ud_free) {
+        za->entry_written_ud_free(za->entry_written_ud);
+    }
+
+    za->entry_written_callback = callback;
+    za->entry_written_ud_free = callback ? ud_free : NULL;
+    za->entry_written_ud = callback ? ud : NULL;
+
+    return 0;
+}
+
+
+/* call the entry written callback after zip_close() wrote the local header and data of entry index */
+void
+_zip_entry_written(zip_t *za, zip_uint64_t index) {
+    zip_entry_t *entry;
+    zip_dirent_t *de;
+    zip_stat_t st;
+
+    if (za->entry_written_callback == NULL) {
+        return;
+    }
+
+    entry = za->entry + index;
+    de = entry->changes ? entry->changes : entry->orig;
+    if (de == NULL) {
+        return;
+    }
+
+    zip_stat_init(&st);
+    st.index = index;
+    st.name = (const char *)_zip_string_get(de->filename, NULL, 0, NULL);
+    st.size = de->uncomp_size;
+    st.comp_size = de->comp_size;
+    st.mtime = zip_dirent_get_last_mod_mtime(de);
+    st.crc = de->crc;
+    st.comp_method = (zip_uint16_t)de->comp_method;
+    st.encryption_method = de->encryption_method;
+    st.valid = ZIP_STAT_INDEX | ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE | ZIP_STAT_MTIME | ZIP_STAT_CRC | ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+    if (st.name != NULL) {
+        st.valid |= ZIP_STAT_NAME;
+    }
+
+    za->entry_written_callback(za, index, &st, za->entry_written_ud);
+}
@@ -0,0 +1,102 @@
+/*
+  zip_file_get_mapped_data.c -- get pointer to data of stored entry in mapped archive
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+
+#include "zipint.h"
+
+
+/* Returns a pointer to the data of a stored, unencrypted entry in the
+   archive's source, valid until the archive is closed. The source must
+   support ZIP_SOURCE_MAP, like the one from zip_source_mmap(). */
+
+ZIP_EXTERN int
+zip_file_get_mapped_data(zip_t *za, zip_uint64_t idx, zip_flags_t flags, const zip_uint8_t **datap, zip_uint64_t *lengthp) {
+    static const zip_uint8_t empty[1] = "";
+    const zip_uint8_t *data;
+    zip_dirent_t *de;
+    zip_uint64_t offset;
+    zip_int64_t n;
+
+    if (datap == NULL || lengthp == NULL) {
+        zip_error_set(&za->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (_zip_get_dirent(za, idx, flags, NULL) == NULL) {
+        return -1;
+    }
+
+    /* new or replaced data is not in the archive yet */
+    if ((flags & ZIP_FL_UNCHANGED) == 0 && ZIP_ENTRY_DATA_CHANGED(za->entry + idx)) {
+        zip_error_set(&za->error, ZIP_ER_CHANGED, 0);
+        return -1;
+    }
+
+    /* describes the data in the archive, even if the entry's metadata was changed */
+    de = za->entry[idx].orig;
+
+    if (de->comp_method != ZIP_CM_STORE || de->encryption_method != ZIP_EM_NONE || !ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(za->src), ZIP_SOURCE_MAP)) {
+        zip_error_set(&za->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+    if (de->comp_size != de->uncomp_size) {
+        zip_error_set(&za->error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_STORED_SIZE_MISMATCH, idx));
+        return -1;
+    }
+
+    if (de->comp_size == 0) {
+        data = empty;
+    }
+    else {
+        if ((offset = _zip_file_get_offset(za, idx, &za->error)) == 0) {
+            return -1;
+        }
+        if (zip_source_seek(za->src, (zip_int64_t)offset, SEEK_SET) < 0 || (n = _zip_source_map(za->src, &data, de->comp_size)) < 0) {
+            zip_error_set_from_source(&za->error, za->src);
+            return -1;
+        }
+        if ((zip_uint64_t)n != de->comp_size) {
+            zip_error_set(&za->error, ZIP_ER_EOF, 0);
+            return -1;
+        }
+    }
+
+    if ((flags & ZIP_FL_CHECK_CRC) && zip_crc32(0, data, de->comp_size) != de->crc) {
+        zip_error_set(&za->error, ZIP_ER_CRC, 0);
+        return -1;
+    }
+
+    *datap = data;
+    *lengthp = de->comp_size;
+    return 0;
+}
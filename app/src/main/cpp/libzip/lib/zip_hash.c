@@ -35,9 +35,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-/* parameter for the string hash function */
-#define HASH_MULTIPLIER 33
-#define HASH_START 5381
+/* parameters for the string hash function */
+#define HASH_MULTIPLIER 0x9e3779b97f4a7c15ull
+#define HASH_START 0xcbf29ce484222325ull
 
 /* hash table's fill ratio is kept between these by doubling/halfing its size as necessary */
 #define HASH_MAX_FILL .75
@@ -47,91 +47,155 @@
 #define HASH_MIN_SIZE 256
 #define HASH_MAX_SIZE 0x80000000ul
 
+/* The table uses open addressing with linear probing: entries are stored in the
+   table itself, so adding a name allocates nothing and a lookup usually reads
+   one or two neighbouring slots. An empty slot has name NULL. Deleting shifts
+   the following entries of the probe sequence back, so no tombstones are needed. */
+
 struct zip_hash_entry {
     const zip_uint8_t *name;
     zip_int64_t orig_index;
     zip_int64_t current_index;
-    struct zip_hash_entry *next;
-    zip_uint32_t hash_value;
+    zip_uint64_t hash_value;
 };
 typedef struct zip_hash_entry zip_hash_entry_t;
 
 struct zip_hash {
     zip_uint32_t table_size;
     zip_uint64_t nentries;
-    zip_hash_entry_t **table;
+    zip_hash_entry_t *table;
 };
 
 
-/* free list of entries */
-static void
-free_list(zip_hash_entry_t *entry) {
-    while (entry != NULL) {
-        zip_hash_entry_t *next = entry->next;
-        free(entry);
-        entry = next;
-    }
-}
-
-
-/* compute hash of string, full 32 bit value */
-static zip_uint32_t
+/* compute hash of string, full 64 bit value; processes 8 bytes at a time */
+static zip_uint64_t
 hash_string(const zip_uint8_t *name) {
     zip_uint64_t value = HASH_START;
+    zip_uint64_t word;
+    size_t length, i;
 
     if (name == NULL) {
         return 0;
     }
 
-    while (*name != 0) {
-        value = (zip_uint64_t)(((value * HASH_MULTIPLIER) + (zip_uint8_t)*name) % 0x100000000ul);
-        name++;
+    length = strlen((const char *)name);
+
+    for (i = 0; i + sizeof(word) <= length; i += sizeof(word)) {
+        memcpy(&word, name + i, sizeof(word));
+        value = (value ^ word) * HASH_MULTIPLIER;
+        value ^= value >> 32;
     }
 
-    return (zip_uint32_t)value;
+    word = 0;
+    memcpy(&word, name + i, length - i);
+    value = (value ^ word ^ ((zip_uint64_t)length << 56)) * HASH_MULTIPLIER;
+
+    /* spread high bits into the low ones used as table index */
+    value ^= value >> 29;
+    value *= HASH_MULTIPLIER;
+    value ^= value >> 32;
+
+    return value;
 }
 
 
-/* resize hash table; new_size must be a power of 2, can be larger or smaller than current size */
-static bool
-hash_resize(zip_hash_t *hash, zip_uint32_t new_size, zip_error_t *error) {
-    zip_hash_entry_t **new_table;
+/* find slot of name, or of the empty slot where it would be added */
+static zip_uint32_t
+find_slot(const zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t hash_value) {
+    zip_uint32_t mask = hash->table_size - 1;
+    zip_uint32_t index = (zip_uint32_t)hash_value & mask;
 
-    if (new_size == hash->table_size) {
-        return true;
+    while (hash->table[index].name != NULL) {
+        if (hash->table[index].hash_value == hash_value && strcmp((const char *)name, (const char *)hash->table[index].name) == 0) {
+            break;
+        }
+        index = (index + 1) & mask;
     }
 
-    if ((new_table = (zip_hash_entry_t **)calloc(new_size, sizeof(zip_hash_entry_t *))) == NULL) {
+    return index;
+}
+
+
+/* Move all entries into a new table of new_size, which must be a power of 2 and can be
+   larger or smaller than current size. If revert is true, entries that were added since
+   the archive was opened are dropped and the others get their original index back. */
+static bool
+hash_rebuild(zip_hash_t *hash, zip_uint32_t new_size, bool revert, zip_error_t *error) {
+    zip_hash_entry_t *new_table;
+    zip_uint64_t nentries = 0;
+    zip_uint32_t i, mask = new_size - 1;
+
+    if ((new_table = (zip_hash_entry_t *)calloc(new_size, sizeof(zip_hash_entry_t))) == NULL) {
         zip_error_set(error, ZIP_ER_MEMORY, 0);
         return false;
     }
 
-    if (hash->nentries > 0) {
-        zip_uint32_t i;
-
-        for (i = 0; i < hash->table_size; i++) {
-            zip_hash_entry_t *entry = hash->table[i];
-            while (entry) {
-                zip_hash_entry_t *next = entry->next;
-
-                zip_uint32_t new_index = entry->hash_value % new_size;
+    for (i = 0; i < hash->table_size; i++) {
+        zip_hash_entry_t *entry = hash->table + i;
+        zip_uint32_t new_index;
 
-                entry->next = new_table[new_index];
-                new_table[new_index] = entry;
+        if (entry->name == NULL || (revert && entry->orig_index == -1)) {
+            continue;
+        }
 
-                entry = next;
-            }
+        new_index = (zip_uint32_t)entry->hash_value & mask;
+        while (new_table[new_index].name != NULL) {
+            new_index = (new_index + 1) & mask;
+        }
+        new_table[new_index] = *entry;
+        if (revert) {
+            new_table[new_index].current_index = entry->orig_index;
         }
+        nentries++;
     }
 
     free(hash->table);
     hash->table = new_table;
     hash->table_size = new_size;
+    hash->nentries = nentries;
 
     return true;
 }
 
 
+/* resize hash table; new_size must be a power of 2, can be larger or smaller than current size */
+static bool
+hash_resize(zip_hash_t *hash, zip_uint32_t new_size, zip_error_t *error) {
+    if (new_size == hash->table_size) {
+        return true;
+    }
+
+    return hash_rebuild(hash, new_size, false, error);
+}
+
+
+/* remove entry in slot index, moving back entries whose probe sequence passes it */
+static void
+remove_slot(zip_hash_t *hash, zip_uint32_t index) {
+    zip_uint32_t mask = hash->table_size - 1;
+    zip_uint32_t next = index;
+
+    for (;;) {
+        zip_uint32_t home;
+
+        next = (next + 1) & mask;
+        if (hash->table[next].name == NULL) {
+            break;
+        }
+
+        /* entry at next may move to index only if its home slot is not in (index, next] */
+        home = (zip_uint32_t)hash->table[next].hash_value & mask;
+        if (((next - home) & mask) >= ((next - index) & mask)) {
+            hash->table[index] = hash->table[next];
+            index = next;
+        }
+    }
+
+    hash->table[index].name = NULL;
+    hash->nentries--;
+}
+
+
 static zip_uint32_t
 size_for_capacity(zip_uint64_t capacity) {
     double needed_size = capacity / HASH_MAX_FILL;
@@ -182,20 +246,11 @@ _zip_hash_new(zip_error_t *error) {
 
 void
 _zip_hash_free(zip_hash_t *hash) {
-    zip_uint32_t i;
-
     if (hash == NULL) {
         return;
     }
 
-    if (hash->table != NULL) {
-        for (i = 0; i < hash->table_size; i++) {
-            if (hash->table[i] != NULL) {
-                free_list(hash->table[i]);
-            }
-        }
-        free(hash->table);
-    }
+    free(hash->table);
     free(hash);
 }
 
@@ -203,7 +258,8 @@ _zip_hash_free(zip_hash_t *hash) {
 /* insert into hash, return error on existence or memory issues */
 bool
 _zip_hash_add(zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t index, zip_flags_t flags, zip_error_t *error) {
-    zip_uint32_t hash_value, table_index;
+    zip_uint64_t hash_value;
+    zip_uint32_t table_index;
     zip_hash_entry_t *entry;
 
     if (hash == NULL || name == NULL || index > ZIP_INT64_MAX) {
@@ -218,36 +274,32 @@ _zip_hash_add(zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t index, zip
     }
 
     hash_value = hash_string(name);
-    table_index = hash_value % hash->table_size;
+    table_index = find_slot(hash, name, hash_value);
+    entry = hash->table + table_index;
 
-    for (entry = hash->table[table_index]; entry != NULL; entry = entry->next) {
-        if (entry->hash_value == hash_value && strcmp((const char *)name, (const char *)entry->name) == 0) {
-            if (((flags & ZIP_FL_UNCHANGED) && entry->orig_index != -1) || entry->current_index != -1) {
-                zip_error_set(error, ZIP_ER_EXISTS, 0);
+    if (entry->name != NULL) {
+        if (((flags & ZIP_FL_UNCHANGED) && entry->orig_index != -1) || entry->current_index != -1) {
+            zip_error_set(error, ZIP_ER_EXISTS, 0);
+            return false;
+        }
+    }
+    else {
+        if (hash->nentries + 1 > hash->table_size * HASH_MAX_FILL && hash->table_size < HASH_MAX_SIZE) {
+            if (!hash_resize(hash, hash->table_size * 2, error)) {
                 return false;
             }
-            else {
-                break;
-            }
+            table_index = find_slot(hash, name, hash_value);
+            entry = hash->table + table_index;
         }
-    }
-
-    if (entry == NULL) {
-        if ((entry = (zip_hash_entry_t *)malloc(sizeof(zip_hash_entry_t))) == NULL) {
+        /* one slot has to stay empty to end probing */
+        if (hash->nentries + 1 >= hash->table_size) {
             zip_error_set(error, ZIP_ER_MEMORY, 0);
             return false;
         }
         entry->name = name;
-        entry->next = hash->table[table_index];
-        hash->table[table_index] = entry;
         entry->hash_value = hash_value;
         entry->orig_index = -1;
         hash->nentries++;
-        if (hash->nentries > hash->table_size * HASH_MAX_FILL && hash->table_size < HASH_MAX_SIZE) {
-            if (!hash_resize(hash, hash->table_size * 2, error)) {
-                return false;
-            }
-        }
     }
 
     if (flags & ZIP_FL_UNCHANGED) {
@@ -262,8 +314,8 @@ _zip_hash_add(zip_hash_t *hash, const zip_uint8_t *name, zip_uint64_t index, zip
 /* remove entry from hash, error if not found */
 bool
 _zip_hash_delete(zip_hash_t *hash, const zip_uint8_t *name, zip_error_t *error) {
-    zip_uint32_t hash_value, index;
-    zip_hash_entry_t *entry, *previous;
+    zip_uint32_t index;
+    zip_hash_entry_t *entry;
 
     if (hash == NULL || name == NULL) {
         zip_error_set(error, ZIP_ER_INVAL, 0);
@@ -271,34 +323,21 @@ _zip_hash_delete(zip_hash_t *hash, const zip_uint8_t *name, zip_error_t *error)
     }
 
     if (hash->nentries > 0) {
-        hash_value = hash_string(name);
-        index = hash_value % hash->table_size;
-        previous = NULL;
-        entry = hash->table[index];
-        while (entry) {
-            if (entry->hash_value == hash_value && strcmp((const char *)name, (const char *)entry->name) == 0) {
-                if (entry->orig_index == -1) {
-                    if (previous) {
-                        previous->next = entry->next;
-                    }
-                    else {
-                        hash->table[index] = entry->next;
-                    }
-                    free(entry);
-                    hash->nentries--;
-                    if (hash->nentries < hash->table_size * HASH_MIN_FILL && hash->table_size > HASH_MIN_SIZE) {
-                        if (!hash_resize(hash, hash->table_size / 2, error)) {
-                            return false;
-                        }
+        index = find_slot(hash, name, hash_string(name));
+        entry = hash->table + index;
+        if (entry->name != NULL) {
+            if (entry->orig_index == -1) {
+                remove_slot(hash, index);
+                if (hash->nentries < hash->table_size * HASH_MIN_FILL && hash->table_size > HASH_MIN_SIZE) {
+                    if (!hash_resize(hash, hash->table_size / 2, error)) {
+                        return false;
                     }
                 }
-                else {
-                    entry->current_index = -1;
-                }
-                return true;
             }
-            previous = entry;
-            entry = entry->next;
+            else {
+                entry->current_index = -1;
+            }
+            return true;
         }
     }
 
@@ -310,7 +349,6 @@ _zip_hash_delete(zip_hash_t *hash, const zip_uint8_t *name, zip_error_t *error)
 /* find value for entry in hash, -1 if not found */
 zip_int64_t
 _zip_hash_lookup(zip_hash_t *hash, const zip_uint8_t *name, zip_flags_t flags, zip_error_t *error) {
-    zip_uint32_t hash_value, index;
     zip_hash_entry_t *entry;
 
     if (hash == NULL || name == NULL) {
@@ -319,21 +357,17 @@ _zip_hash_lookup(zip_hash_t *hash, const zip_uint8_t *name, zip_flags_t flags, z
     }
 
     if (hash->nentries > 0) {
-        hash_value = hash_string(name);
-        index = hash_value % hash->table_size;
-        for (entry = hash->table[index]; entry != NULL; entry = entry->next) {
-            if (strcmp((const char *)name, (const char *)entry->name) == 0) {
-                if (flags & ZIP_FL_UNCHANGED) {
-                    if (entry->orig_index != -1) {
-                        return entry->orig_index;
-                    }
+        entry = hash->table + find_slot(hash, name, hash_string(name));
+        if (entry->name != NULL) {
+            if (flags & ZIP_FL_UNCHANGED) {
+                if (entry->orig_index != -1) {
+                    return entry->orig_index;
                 }
-                else {
-                    if (entry->current_index != -1) {
-                        return entry->current_index;
-                    }
+            }
+            else {
+                if (entry->current_index != -1) {
+                    return entry->current_index;
                 }
-                break;
             }
         }
     }
@@ -343,6 +377,8 @@ _zip_hash_lookup(zip_hash_t *hash, const zip_uint8_t *name, zip_flags_t flags, z
 }
 
 
+/* Size table for capacity entries, so that adding them doesn't resize it.
+   zip_open calls this with the number of entries in the central directory. */
 bool
 _zip_hash_reserve_capacity(zip_hash_t *hash, zip_uint64_t capacity, zip_error_t *error) {
     zip_uint32_t new_size;
@@ -367,44 +403,34 @@ _zip_hash_reserve_capacity(zip_hash_t *hash, zip_uint64_t capacity, zip_error_t
 
 bool
 _zip_hash_revert(zip_hash_t *hash, zip_error_t *error) {
-    zip_uint32_t i;
-    zip_hash_entry_t *entry, *previous;
+    zip_uint64_t nentries = 0;
+    zip_uint32_t i, new_size;
+    bool added = false;
 
     for (i = 0; i < hash->table_size; i++) {
-        previous = NULL;
-        entry = hash->table[i];
-        while (entry) {
-            if (entry->orig_index == -1) {
-                zip_hash_entry_t *p;
-                if (previous) {
-                    previous->next = entry->next;
-                }
-                else {
-                    hash->table[i] = entry->next;
-                }
-                p = entry;
-                entry = entry->next;
-                /* previous does not change */
-                free(p);
-                hash->nentries--;
-            }
-            else {
-                entry->current_index = entry->orig_index;
-                previous = entry;
-                entry = entry->next;
-            }
-        }
-    }
+        zip_hash_entry_t *entry = hash->table + i;
 
-    if (hash->nentries < hash->table_size * HASH_MIN_FILL && hash->table_size > HASH_MIN_SIZE) {
-        zip_uint32_t new_size = hash->table_size / 2;
-        while (hash->nentries < new_size * HASH_MIN_FILL && new_size > HASH_MIN_SIZE) {
-            new_size /= 2;
+        if (entry->name == NULL) {
+            continue;
         }
-        if (!hash_resize(hash, new_size, error)) {
-            return false;
+        if (entry->orig_index == -1) {
+            added = true;
+        }
+        else {
+            entry->current_index = entry->orig_index;
+            nentries++;
         }
     }
 
-    return true;
+    if (!added) {
+        return true;
+    }
+
+    /* removing entries in place would have to move others around, so build a new table */
+    new_size = hash->table_size;
+    while (nentries < new_size * HASH_MIN_FILL && new_size > HASH_MIN_SIZE) {
+        new_size /= 2;
+    }
+
+    return hash_rebuild(hash, new_size, true, error);
 }
@@ -31,10 +31,8 @@
  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
@@ -133,13 +131,7 @@ _zip_write(zip_t *za, const void *data, zip_uint64_t length) {
     }
 
     if (za->write_crc != NULL) {
-        zip_uint64_t position = 0;
-        while (position < length) {
-            zip_uint64_t nn = ZIP_MIN(UINT_MAX, length - position);
-
-            *za->write_crc = (zip_uint32_t)crc32(*za->write_crc, (const Bytef *)data + position, (uInt)nn);
-            position += nn;
-        }
+        *za->write_crc = zip_crc32(*za->write_crc, data, length);
     }
 
     return 0;
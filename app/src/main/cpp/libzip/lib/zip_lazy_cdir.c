@@ -0,0 +1,318 @@
+/*
+  zip_lazy_cdir.c -- central directory entries decoded on first use
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "zipint.h"
+
+/*
+  With ZIP_LAZY_CDIR, zip_open() copies the central directory into memory and
+  only records where each entry starts. An entry is decoded into a
+  zip_dirent_t by _zip_get_dirent() when it is first used, so opening an
+  archive and reading a few of its entries doesn't depend on the number of
+  entries in it. Archives opened this way are read-only.
+
+  zip_name_locate() needs the names of all entries. Names that decode to the
+  raw bytes (printable ASCII without a UTF-8 name extra field) are hashed
+  from the copy without decoding their entries.
+*/
+
+#define CDIR_NAME_LENGTH_OFFSET 28
+#define CDIR_EXTRA_LENGTH_OFFSET 30
+#define CDIR_COMMENT_LENGTH_OFFSET 32
+
+static zip_uint16_t get_16(const zip_uint8_t *data);
+static bool is_plain_name(const zip_uint8_t *entry);
+static zip_uint64_t scan_cdir(const zip_cdir_t *cd, const zip_uint8_t *data, zip_uint64_t *offsets, zip_error_t *error);
+
+
+void
+_zip_lazy_cdir_free(zip_lazy_cdir_t *lazy) {
+    if (lazy == NULL) {
+        return;
+    }
+
+    free(lazy->data);
+    free(lazy->offsets);
+    free(lazy->names);
+    free(lazy);
+}
+
+
+/* Add the names of all entries to za->names. */
+bool
+_zip_lazy_cdir_hash_names(zip_t *za, zip_error_t *error) {
+    zip_lazy_cdir_t *lazy = za->lazy_cdir;
+    zip_uint64_t i, length;
+    char *p;
+
+    if (lazy == NULL || lazy->names_hashed) {
+        return true;
+    }
+
+    if (lazy->names == NULL) {
+        length = 0;
+        for (i = 0; i < lazy->nentry; i++) {
+            const zip_uint8_t *entry = lazy->data + lazy->offsets[i];
+
+            if (is_plain_name(entry)) {
+                length += (zip_uint64_t)get_16(entry + CDIR_NAME_LENGTH_OFFSET) + 1;
+            }
+        }
+        if ((lazy->names = (char *)malloc(length > 0 ? length : 1)) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+    }
+
+    if (!_zip_hash_reserve_capacity(za->names, lazy->nentry, error)) {
+        return false;
+    }
+
+    p = lazy->names;
+    for (i = 0; i < lazy->nentry; i++) {
+        const zip_uint8_t *entry = lazy->data + lazy->offsets[i];
+        const zip_uint8_t *name;
+        zip_error_t add_error;
+
+        if (is_plain_name(entry)) {
+            length = get_16(entry + CDIR_NAME_LENGTH_OFFSET);
+            (void)memcpy_s(p, (size_t)length + 1, entry + CDENTRYSIZE, (size_t)length);
+            p[length] = '\0';
+            name = (const zip_uint8_t *)p;
+            p += length + 1;
+        }
+        else {
+            if (!_zip_lazy_cdir_load(za, i, error)) {
+                return false;
+            }
+            if ((name = _zip_string_get(za->entry[i].orig->filename, NULL, 0, error)) == NULL) {
+                return false;
+            }
+        }
+
+        /* like zip_open(), the first of several entries with the same name is found */
+        zip_error_init(&add_error);
+        if (!_zip_hash_add(za->names, name, i, ZIP_FL_UNCHANGED, &add_error) && zip_error_code_zip(&add_error) != ZIP_ER_EXISTS) {
+            _zip_error_copy(error, &add_error);
+            zip_error_fini(&add_error);
+            return false;
+        }
+        zip_error_fini(&add_error);
+    }
+
+    lazy->names_hashed = true;
+    return true;
+}
+
+
+/* Decode entry idx if it hasn't been yet. */
+bool
+_zip_lazy_cdir_load(zip_t *za, zip_uint64_t idx, zip_error_t *error) {
+    zip_lazy_cdir_t *lazy = za->lazy_cdir;
+    zip_buffer_t *buffer;
+    zip_dirent_t *de;
+
+    if (!ZIP_ENTRY_IS_LAZY(za, idx)) {
+        return true;
+    }
+
+    if ((buffer = _zip_buffer_new(lazy->data + lazy->offsets[idx], lazy->offsets[idx + 1] - lazy->offsets[idx])) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+    if ((de = _zip_dirent_new()) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_buffer_free(buffer);
+        return false;
+    }
+
+    if (_zip_dirent_read(de, za->src, buffer, false, 0, false, error) < 0) {
+        if (zip_error_code_zip(error) == ZIP_ER_INCONS) {
+            zip_error_set(error, ZIP_ER_INCONS, ADD_INDEX_TO_DETAIL(zip_error_code_system(error), idx));
+        }
+        else if (zip_error_code_zip(error) == ZIP_ER_NOZIP) {
+            zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_CDIR_ENTRY_INVALID, idx));
+        }
+        _zip_dirent_free(de);
+        _zip_buffer_free(buffer);
+        return false;
+    }
+
+    _zip_buffer_free(buffer);
+    za->entry[idx].orig = de;
+    return true;
+}
+
+
+/* Copy central directory cd, from buffer if not NULL, else from the current position of src, and find its entries. */
+zip_lazy_cdir_t *
+_zip_lazy_cdir_new(zip_cdir_t *cd, zip_source_t *src, zip_buffer_t *buffer, zip_error_t *error) {
+    zip_lazy_cdir_t *lazy;
+    zip_uint64_t nentry;
+
+    if (cd->size > SIZE_MAX) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    if ((lazy = (zip_lazy_cdir_t *)malloc(sizeof(*lazy))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    lazy->offsets = NULL;
+    lazy->nentry = 0;
+    lazy->names = NULL;
+    lazy->names_hashed = false;
+
+    if ((lazy->data = (zip_uint8_t *)malloc(cd->size > 0 ? (size_t)cd->size : 1)) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_lazy_cdir_free(lazy);
+        return NULL;
+    }
+
+    if (buffer != NULL) {
+        if (_zip_buffer_read(buffer, lazy->data, cd->size) != cd->size) {
+            zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_LENGTH_INVALID);
+            _zip_lazy_cdir_free(lazy);
+            return NULL;
+        }
+    }
+    else if (_zip_read(src, lazy->data, cd->size, error) < 0) {
+        _zip_lazy_cdir_free(lazy);
+        return NULL;
+    }
+
+    if ((nentry = scan_cdir(cd, lazy->data, NULL, error)) == ZIP_UINT64_MAX) {
+        _zip_lazy_cdir_free(lazy);
+        return NULL;
+    }
+
+    if (nentry >= SIZE_MAX / sizeof(*lazy->offsets) || (lazy->offsets = (zip_uint64_t *)malloc((size_t)(nentry + 1) * sizeof(*lazy->offsets))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        _zip_lazy_cdir_free(lazy);
+        return NULL;
+    }
+    lazy->nentry = scan_cdir(cd, lazy->data, lazy->offsets, error);
+
+    return lazy;
+}
+
+
+static zip_uint16_t
+get_16(const zip_uint8_t *data) {
+    return (zip_uint16_t)(data[0] | (data[1] << 8));
+}
+
+
+/* Whether the name of entry is returned unchanged by _zip_string_get(). */
+static bool
+is_plain_name(const zip_uint8_t *entry) {
+    zip_uint16_t name_length = get_16(entry + CDIR_NAME_LENGTH_OFFSET);
+    zip_uint16_t extra_length = get_16(entry + CDIR_EXTRA_LENGTH_OFFSET);
+    const zip_uint8_t *name = entry + CDENTRYSIZE;
+    const zip_uint8_t *extra = name + name_length;
+    zip_uint16_t i;
+
+    for (i = 0; i < name_length; i++) {
+        if ((name[i] < 32 && name[i] != '\r' && name[i] != '\n' && name[i] != '\t') || name[i] >= 128) {
+            return false;
+        }
+    }
+
+    while (extra_length >= 4) {
+        zip_uint16_t id = get_16(extra);
+        zip_uint16_t size = get_16(extra + 2);
+
+        if (id == ZIP_EF_UTF_8_NAME || size > extra_length - 4) {
+            return false;
+        }
+        extra += 4 + size;
+        extra_length -= (zip_uint16_t)(4 + size);
+    }
+
+    return true;
+}
+
+
+/* Check the framing of the entries in data and count them, storing their offsets if offsets is not NULL.
+   Returns ZIP_UINT64_MAX on error. */
+static zip_uint64_t
+scan_cdir(const zip_cdir_t *cd, const zip_uint8_t *data, zip_uint64_t *offsets, zip_error_t *error) {
+    zip_uint64_t offset, nentry;
+
+    offset = 0;
+    nentry = 0;
+    while (offset < cd->size) {
+        zip_uint64_t left = cd->size - offset;
+        zip_uint64_t length;
+
+        if (nentry >= cd->num_entries && (cd->is_zip64 || left < CDENTRYSIZE)) {
+            /* InfoZIP stores the number of entries modulo 0x10000 instead of using Zip64, checked below */
+            zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_WRONG_ENTRIES_COUNT);
+            return ZIP_UINT64_MAX;
+        }
+
+        if (left < CDENTRYSIZE || memcmp(data + offset, CENTRAL_MAGIC, 4) != 0) {
+            if (nentry < cd->num_entries) {
+                zip_error_set(error, ZIP_ER_NOZIP, 0);
+            }
+            else {
+                zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_CDIR_ENTRY_INVALID, nentry));
+            }
+            return ZIP_UINT64_MAX;
+        }
+
+        length = CDENTRYSIZE + (zip_uint64_t)get_16(data + offset + CDIR_NAME_LENGTH_OFFSET) + get_16(data + offset + CDIR_EXTRA_LENGTH_OFFSET) + get_16(data + offset + CDIR_COMMENT_LENGTH_OFFSET);
+        if (length > left) {
+            zip_error_set(error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_VARIABLE_SIZE_OVERFLOW, nentry));
+            return ZIP_UINT64_MAX;
+        }
+
+        if (offsets != NULL) {
+            offsets[nentry] = offset;
+        }
+        offset += length;
+        nentry++;
+    }
+
+    if (nentry != cd->num_entries && (cd->is_zip64 || nentry < cd->num_entries || (nentry - cd->num_entries) % 0x10000 != 0)) {
+        zip_error_set(error, ZIP_ER_INCONS, ZIP_ER_DETAIL_CDIR_WRONG_ENTRIES_COUNT);
+        return ZIP_UINT64_MAX;
+    }
+
+    if (offsets != NULL) {
+        offsets[nentry] = offset;
+    }
+    return nentry;
+}
@@ -0,0 +1,406 @@
+/*
+  zip_name_index.c -- name indexes for case insensitive and basename lookup
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+#include "zipint.h"
+
+/*
+  Index for zip_name_locate() with ZIP_FL_NOCASE or ZIP_FL_NODIR. Keys are
+  case folded names, or case folded basenames for ZIP_FL_NODIR, so names that
+  compare equal under either flag have the same key. Each key has a list of
+  entry indices in ascending order. A lookup compares the current names of the
+  entries in the list like the linear search does and returns the first match,
+  so the result is the same.
+
+  An index is built by the first lookup that needs it. Renamed, added and
+  restored entries are added to it; deleted entries and old names stay in the
+  lists and fail the name comparison. When too many of those pile up, and on
+  zip_unchange_all(), the index is dropped and built again when next needed.
+*/
+
+#define INDEX_NONE ZIP_UINT64_MAX
+
+/* key table's fill ratio is kept below this by doubling its size */
+#define INDEX_MAX_FILL .75
+#define INDEX_MIN_SIZE 256
+
+/* parameters for the key hash function (FNV-1a) */
+#define HASH_START 0xcbf29ce484222325ull
+#define HASH_MULTIPLIER 0x100000001b3ull
+
+struct zip_name_index_key {
+    zip_uint64_t hash_value;
+    zip_uint64_t head; /* first node, INDEX_NONE if slot is empty */
+    zip_uint64_t tail; /* last node */
+};
+typedef struct zip_name_index_key zip_name_index_key_t;
+
+struct zip_name_index_node {
+    zip_uint64_t index; /* entry index */
+    zip_uint64_t next;  /* next node with same key, INDEX_NONE at end */
+};
+typedef struct zip_name_index_node zip_name_index_node_t;
+
+struct zip_name_index {
+    bool basename;
+
+    /* open addressing table of keys with linear probing, size is a power of 2 */
+    zip_uint64_t keys_size;
+    zip_uint64_t nkeys;
+    zip_name_index_key_t *keys;
+
+    zip_uint64_t nnodes;
+    zip_uint64_t nnodes_alloc;
+    zip_name_index_node_t *nodes;
+};
+
+static bool index_add(zip_name_index_t *index, const char *name, zip_uint64_t entry_index, zip_error_t *error);
+static void index_free(zip_name_index_t *index);
+static zip_name_index_t *index_new(zip_t *za, bool basename, zip_error_t *error);
+static zip_name_index_key_t *find_key(const zip_name_index_t *index, zip_uint64_t hash_value);
+static zip_uint64_t hash_key(const char *name);
+static bool keys_resize(zip_name_index_t *index, zip_uint64_t new_size, zip_error_t *error);
+static bool update_index(zip_t *za, zip_name_index_t *index, const char *name, zip_uint64_t entry_index);
+
+
+/* Find fname with ZIP_FL_NOCASE and/or ZIP_FL_NODIR in flags using an index.
+   Returns false if flags can't use an index or it couldn't be built; the caller searches linearly then. */
+bool
+_zip_name_index_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_int64_t *idx, zip_error_t *error) {
+    zip_name_index_t **indexp;
+    zip_name_index_key_t *key;
+    int (*cmp)(const char *, const char *);
+    zip_uint64_t node;
+    const char *fn, *p;
+
+    /* only current names in the default encoding are indexed */
+    if (flags & (ZIP_FL_UNCHANGED | ZIP_FL_ENC_RAW | ZIP_FL_ENC_STRICT)) {
+        return false;
+    }
+
+    indexp = (flags & ZIP_FL_NODIR) ? &za->names_nodir : &za->names_nocase;
+    if (*indexp == NULL && (*indexp = index_new(za, (flags & ZIP_FL_NODIR) != 0, NULL)) == NULL) {
+        return false;
+    }
+
+    *idx = -1;
+    cmp = (flags & ZIP_FL_NOCASE) ? strcasecmp : strcmp;
+
+    /* basenames contain no '/' */
+    if ((flags & ZIP_FL_NODIR) && strchr(fname, '/') != NULL) {
+        key = NULL;
+    }
+    else {
+        key = find_key(*indexp, hash_key(fname));
+    }
+
+    for (node = key ? key->head : INDEX_NONE; node != INDEX_NONE; node = (*indexp)->nodes[node].next) {
+        zip_uint64_t i = (*indexp)->nodes[node].index;
+
+        if (i >= za->nentry) {
+            continue;
+        }
+
+        /* deleted entry or error */
+        if ((fn = _zip_get_name(za, i, flags, error)) == NULL) {
+            continue;
+        }
+
+        if (flags & ZIP_FL_NODIR) {
+            p = strrchr(fn, '/');
+            if (p) {
+                fn = p + 1;
+            }
+        }
+
+        if (cmp(fname, fn) == 0) {
+            _zip_error_clear(error);
+            *idx = (zip_int64_t)i;
+            return true;
+        }
+    }
+
+    zip_error_set(error, ZIP_ER_NOENT, 0);
+    return true;
+}
+
+
+/* Entry idx got name, add it to the indexes that have been built. */
+void
+_zip_name_index_add(zip_t *za, const zip_uint8_t *name, zip_uint64_t idx) {
+    if (za->names_nocase != NULL && !update_index(za, za->names_nocase, (const char *)name, idx)) {
+        index_free(za->names_nocase);
+        za->names_nocase = NULL;
+    }
+    if (za->names_nodir != NULL && !update_index(za, za->names_nodir, (const char *)name, idx)) {
+        index_free(za->names_nodir);
+        za->names_nodir = NULL;
+    }
+}
+
+
+/* Drop the indexes; they are built again when needed. */
+void
+_zip_name_index_reset(zip_t *za) {
+    index_free(za->names_nocase);
+    za->names_nocase = NULL;
+    index_free(za->names_nodir);
+    za->names_nodir = NULL;
+}
+
+
+static zip_name_index_key_t *
+find_key(const zip_name_index_t *index, zip_uint64_t hash_value) {
+    zip_uint64_t mask = index->keys_size - 1;
+    zip_uint64_t i;
+
+    for (i = hash_value & mask; index->keys[i].head != INDEX_NONE; i = (i + 1) & mask) {
+        if (index->keys[i].hash_value == hash_value) {
+            return index->keys + i;
+        }
+    }
+
+    return NULL;
+}
+
+
+/* hash of case folded name */
+static zip_uint64_t
+hash_key(const char *name) {
+    zip_uint64_t value = HASH_START;
+
+    for (; *name != '\0'; name++) {
+        value = (value ^ (zip_uint8_t)tolower((unsigned char)*name)) * HASH_MULTIPLIER;
+    }
+
+    /* the low bits select the slot */
+    return value ^ (value >> 32);
+}
+
+
+/* add entry_index to the list of the key of name, keeping the list sorted */
+static bool
+index_add(zip_name_index_t *index, const char *name, zip_uint64_t entry_index, zip_error_t *error) {
+    zip_name_index_key_t *key;
+    zip_uint64_t hash_value, node, previous, next;
+
+    if (index->basename) {
+        const char *p = strrchr(name, '/');
+        if (p) {
+            name = p + 1;
+        }
+    }
+
+    hash_value = hash_key(name);
+
+    if ((key = find_key(index, hash_value)) != NULL) {
+        /* entries are usually added in ascending order */
+        previous = INDEX_NONE;
+        next = key->head;
+        if (index->nodes[key->tail].index < entry_index) {
+            previous = key->tail;
+            next = INDEX_NONE;
+        }
+        while (next != INDEX_NONE && index->nodes[next].index < entry_index) {
+            previous = next;
+            next = index->nodes[next].next;
+        }
+        if (next != INDEX_NONE && index->nodes[next].index == entry_index) {
+            return true;
+        }
+    }
+    else {
+        previous = next = INDEX_NONE;
+    }
+
+    if (index->nnodes >= index->nnodes_alloc) {
+        zip_uint64_t new_alloc = index->nnodes_alloc > 0 ? index->nnodes_alloc * 2 : 16;
+        zip_name_index_node_t *new_nodes;
+
+        if (new_alloc > SIZE_MAX / sizeof(*new_nodes) || (new_nodes = (zip_name_index_node_t *)realloc(index->nodes, (size_t)new_alloc * sizeof(*new_nodes))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            return false;
+        }
+        index->nodes = new_nodes;
+        index->nnodes_alloc = new_alloc;
+    }
+
+    if (key == NULL) {
+        zip_uint64_t i;
+
+        if (index->nkeys + 1 > index->keys_size * INDEX_MAX_FILL) {
+            if (!keys_resize(index, index->keys_size * 2, error)) {
+                return false;
+            }
+        }
+        i = hash_value & (index->keys_size - 1);
+        while (index->keys[i].head != INDEX_NONE) {
+            i = (i + 1) & (index->keys_size - 1);
+        }
+        key = index->keys + i;
+        key->hash_value = hash_value;
+        key->head = key->tail = INDEX_NONE;
+        index->nkeys++;
+    }
+
+    node = index->nnodes++;
+    index->nodes[node].index = entry_index;
+    index->nodes[node].next = next;
+    if (previous == INDEX_NONE) {
+        key->head = node;
+    }
+    else {
+        index->nodes[previous].next = node;
+    }
+    if (next == INDEX_NONE) {
+        key->tail = node;
+    }
+
+    return true;
+}
+
+
+static void
+index_free(zip_name_index_t *index) {
+    if (index == NULL) {
+        return;
+    }
+
+    free(index->keys);
+    free(index->nodes);
+    free(index);
+}
+
+
+/* build index of current names of all entries */
+static zip_name_index_t *
+index_new(zip_t *za, bool basename, zip_error_t *error) {
+    zip_name_index_t *index;
+    zip_uint64_t i, size;
+
+    if ((index = (zip_name_index_t *)malloc(sizeof(*index))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+
+    index->basename = basename;
+    index->keys_size = 0;
+    index->nkeys = 0;
+    index->keys = NULL;
+    index->nnodes = 0;
+    index->nnodes_alloc = 0;
+    index->nodes = NULL;
+
+    size = INDEX_MIN_SIZE;
+    while (size * INDEX_MAX_FILL < za->nentry) {
+        size *= 2;
+    }
+    if (!keys_resize(index, size, error)) {
+        index_free(index);
+        return NULL;
+    }
+
+    if (za->nentry > 0) {
+        if (za->nentry > SIZE_MAX / sizeof(*index->nodes) || (index->nodes = (zip_name_index_node_t *)malloc((size_t)za->nentry * sizeof(*index->nodes))) == NULL) {
+            zip_error_set(error, ZIP_ER_MEMORY, 0);
+            index_free(index);
+            return NULL;
+        }
+        index->nnodes_alloc = za->nentry;
+    }
+
+    for (i = 0; i < za->nentry; i++) {
+        /* deleted or newly added (partially filled) entry */
+        const char *name = _zip_get_name(za, i, 0, NULL);
+
+        if (name != NULL && !index_add(index, name, i, error)) {
+            index_free(index);
+            return NULL;
+        }
+    }
+
+    return index;
+}
+
+
+/* new_size must be a power of 2 and large enough for all keys */
+static bool
+keys_resize(zip_name_index_t *index, zip_uint64_t new_size, zip_error_t *error) {
+    zip_name_index_key_t *new_keys;
+    zip_uint64_t i, j;
+
+    if (new_size > SIZE_MAX / sizeof(*new_keys) || (new_keys = (zip_name_index_key_t *)malloc((size_t)new_size * sizeof(*new_keys))) == NULL) {
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+
+    for (j = 0; j < new_size; j++) {
+        new_keys[j].head = INDEX_NONE;
+    }
+
+    for (i = 0; i < index->keys_size; i++) {
+        if (index->keys[i].head == INDEX_NONE) {
+            continue;
+        }
+        j = index->keys[i].hash_value & (new_size - 1);
+        while (new_keys[j].head != INDEX_NONE) {
+            j = (j + 1) & (new_size - 1);
+        }
+        new_keys[j] = index->keys[i];
+    }
+
+    free(index->keys);
+    index->keys = new_keys;
+    index->keys_size = new_size;
+
+    return true;
+}
+
+
+/* add entry_index under name to index, false if the index should be dropped */
+static bool
+update_index(zip_t *za, zip_name_index_t *index, const char *name, zip_uint64_t entry_index) {
+    /* old names and deleted entries make up more than half of the index */
+    if (index->nnodes > 2 * za->nentry + INDEX_MIN_SIZE) {
+        return false;
+    }
+
+    return index_add(index, name, entry_index, NULL);
+}
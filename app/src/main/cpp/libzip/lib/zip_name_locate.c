@@ -53,6 +53,7 @@ _zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_error_t *e
     zip_string_t *str = NULL;
     const char *fn, *p;
     zip_uint64_t i;
+    zip_int64_t ret;
 
     if (za == NULL) {
         return -1;
@@ -80,6 +81,11 @@ _zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_error_t *e
         }
     }
 
+    if ((flags & (ZIP_FL_NOCASE | ZIP_FL_NODIR)) && _zip_name_index_locate(za, fname, flags, &ret, error)) {
+        _zip_string_free(str);
+        return ret;
+    }
+
     if (flags & (ZIP_FL_NOCASE | ZIP_FL_NODIR | ZIP_FL_ENC_RAW | ZIP_FL_ENC_STRICT)) {
         /* can't use hash table */
         cmp = (flags & ZIP_FL_NOCASE) ? strcasecmp : strcmp;
@@ -109,7 +115,11 @@ _zip_name_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_error_t *e
         return -1;
     }
     else {
-        zip_int64_t ret = _zip_hash_lookup(za->names, (const zip_uint8_t *)fname, flags, error);
+        if (!_zip_lazy_cdir_hash_names(za, error)) {
+            _zip_string_free(str);
+            return -1;
+        }
+        ret = _zip_hash_lookup(za->names, (const zip_uint8_t *)fname, flags, error);
         _zip_string_free(str);
         return ret;
     }
@@ -56,6 +56,9 @@ _zip_new(zip_error_t *error) {
         return NULL;
     }
 
+    za->names_nocase = NULL;
+    za->names_nodir = NULL;
+    za->lazy_cdir = NULL;
     za->src = NULL;
     za->open_flags = 0;
     zip_error_init(&za->error);
@@ -68,7 +71,14 @@ _zip_new(zip_error_t *error) {
     za->nopen_source = za->nopen_source_alloc = 0;
     za->open_source = NULL;
     za->progress = NULL;
+    za->entry_written_callback = NULL;
+    za->entry_written_ud_free = NULL;
+    za->entry_written_ud = NULL;
     za->torrent_mtime = 0;
+    za->close_threads = 0;
+    za->close_memory_limit = PARALLEL_CLOSE_MEMORY_LIMIT;
+    za->deflate_block_threshold = PARALLEL_DEFLATE_THRESHOLD;
+    za->write_data_descriptors = false;
 
     return za;
 }
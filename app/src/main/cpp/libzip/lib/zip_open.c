@@ -103,12 +103,20 @@ zip_open_from_source(zip_source_t *src, int _flags, zip_error_t *error) {
 
     supported = zip_source_supports(src);
     if ((supported & ZIP_SOURCE_SUPPORTS_SEEKABLE) != ZIP_SOURCE_SUPPORTS_SEEKABLE) {
-        zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
-        return NULL;
+        /* a write-only stream can't be read back, it can only receive a new archive */
+        if ((flags & ZIP_TRUNCATE) == 0 || (flags & ZIP_RDONLY) || (supported & ZIP_SOURCE_SUPPORTS_STREAM_WRITABLE) != ZIP_SOURCE_SUPPORTS_STREAM_WRITABLE) {
+            zip_error_set(error, ZIP_ER_OPNOTSUPP, 0);
+            return NULL;
+        }
+        return _zip_allocate_new(src, flags, error);
     }
     if ((supported & ZIP_SOURCE_SUPPORTS_WRITABLE) != ZIP_SOURCE_SUPPORTS_WRITABLE) {
         flags |= ZIP_RDONLY;
     }
+    if (flags & ZIP_LAZY_CDIR) {
+        /* entries that haven't been decoded can't be written */
+        flags |= ZIP_RDONLY;
+    }
 
     if ((flags & (ZIP_RDONLY | ZIP_TRUNCATE)) == (ZIP_RDONLY | ZIP_TRUNCATE)) {
         zip_error_set(error, ZIP_ER_RDONLY, 0);
@@ -222,6 +230,7 @@ _zip_open(zip_source_t *src, unsigned int flags, zip_error_t *error) {
     za->entry = cdir->entry;
     za->nentry = cdir->nentry;
     za->nentry_alloc = cdir->nentry_alloc;
+    za->lazy_cdir = cdir->lazy;
 
     zip_check_torrentzip(za, cdir);
 
@@ -235,6 +244,12 @@ _zip_open(zip_source_t *src, unsigned int flags, zip_error_t *error) {
 
     free(cdir);
 
+    if (za->lazy_cdir != NULL) {
+        /* names are hashed on first use */
+        za->ch_flags = za->flags;
+        return za;
+    }
+
     _zip_hash_reserve_capacity(za->names, za->nentry, &za->error);
 
     for (idx = 0; idx < za->nentry; idx++) {
@@ -419,6 +434,18 @@ static bool _zip_read_cdir(zip_t *za, zip_buffer_t *buffer, zip_uint64_t buf_off
         }
     }
 
+    if ((za->open_flags & (ZIP_LAZY_CDIR | ZIP_CHECKCONS)) == ZIP_LAZY_CDIR) {
+        /* only find the entries, they are decoded on first use */
+        cd->lazy = _zip_lazy_cdir_new(cd, za->src, cd_buffer, error);
+        _zip_buffer_free(cd_buffer);
+        if (cd->lazy == NULL || !_zip_cdir_grow(cd, cd->lazy->nentry, error)) {
+            _zip_cdir_free(cd);
+            return true;
+        }
+        *cdirp = cd;
+        return true;
+    }
+
     if (!_zip_cdir_grow(cd, cd->num_entries, error)) {
         _zip_cdir_free(cd);
         _zip_buffer_free(cd_buffer);
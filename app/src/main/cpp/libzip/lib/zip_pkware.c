@@ -33,7 +33,6 @@
 
 
 #include <stdlib.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
@@ -44,10 +43,10 @@
 
 static void
 update_keys(zip_pkware_keys_t *keys, zip_uint8_t b) {
-    keys->key[0] = (zip_uint32_t)crc32(keys->key[0] ^ 0xffffffffUL, &b, 1) ^ 0xffffffffUL;
+    keys->key[0] = zip_crc32(keys->key[0] ^ 0xffffffffu, &b, 1) ^ 0xffffffffu;
     keys->key[1] = (keys->key[1] + (keys->key[0] & 0xff)) * 134775813 + 1;
     b = (zip_uint8_t)(keys->key[1] >> 24);
-    keys->key[2] = (zip_uint32_t)crc32(keys->key[2] ^ 0xffffffffUL, &b, 1) ^ 0xffffffffUL;
+    keys->key[2] = zip_crc32(keys->key[2] ^ 0xffffffffu, &b, 1) ^ 0xffffffffu;
 }
 
 
@@ -127,6 +127,7 @@ _zip_set_name(zip_t *za, zip_uint64_t idx, const char *name, zip_flags_t flags)
     if (old_name) {
         _zip_hash_delete(za->names, old_name, NULL);
     }
+    _zip_name_index_add(za, new_name, idx);
 
     if (same_as_orig) {
         if (e->changes) {
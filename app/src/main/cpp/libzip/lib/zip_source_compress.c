@@ -36,6 +36,10 @@
 
 #include "zipint.h"
 
+/* how much input to take at once from sources that support ZIP_SOURCE_BORROW;
+   small enough to still be in cache when the algorithm reads it after the CRC was computed */
+#define BORROW_SIZE (64 * 1024)
+
 struct context {
     zip_error_t error;
 
@@ -45,8 +49,13 @@ struct context {
     bool is_stored; /* only valid if end_of_stream is true */
     bool compress;
     bool check_consistency;
+    bool borrow; /* whether input is taken in place from src */
+    bool crc;    /* whether the CRC of the input is computed here instead of by zip_source_crc */
     zip_int32_t method;
 
+    zip_uint32_t input_crc;
+    zip_uint64_t input_size;
+
     zip_uint64_t size;
     zip_int64_t first_read;
     zip_uint8_t buffer[BUFSIZE];
@@ -84,10 +93,11 @@ static struct implementation implementations[] = {
 
 static size_t implementations_size = sizeof(implementations) / sizeof(implementations[0]);
 
-static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags);
+static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags, bool crc);
 static zip_int64_t compress_callback(zip_source_t *, void *, void *, zip_uint64_t, zip_source_cmd_t);
 static void context_free(struct context *ctx);
-static struct context *context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, bool check_consistency);
+static struct context *context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, bool check_consistency, bool crc);
+static zip_int64_t compress_input(zip_source_t *, struct context *, const zip_uint8_t **);
 static zip_int64_t compress_read(zip_source_t *, struct context *, void *, zip_uint64_t);
 
 zip_compression_algorithm_t *_zip_get_compression_algorithm(zip_int32_t method, bool compress) {
@@ -116,16 +126,24 @@ ZIP_EXTERN int zip_compression_method_supported(zip_int32_t method, int compress
 }
 
 zip_source_t *zip_source_compress(zip_t *za, zip_source_t *src, zip_int32_t method, zip_uint32_t compression_flags) {
-    return compression_source_new(za, src, method, true, compression_flags);
+    return compression_source_new(za, src, method, true, compression_flags, false);
+}
+
+/* Like zip_source_compress(), but also computes CRC and size of the uncompressed data,
+   so no zip_source_crc is needed below. Each piece of input is checksummed right before
+   it is compressed, while it is still in cache. */
+zip_source_t *
+_zip_source_compress_crc(zip_t *za, zip_source_t *src, zip_int32_t method, zip_uint32_t compression_flags) {
+    return compression_source_new(za, src, method, true, compression_flags, true);
 }
 
 zip_source_t *
 zip_source_decompress(zip_t *za, zip_source_t *src, zip_int32_t method) {
-    return compression_source_new(za, src, method, false, 0);
+    return compression_source_new(za, src, method, false, 0, false);
 }
 
 
-static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags) {
+static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_int32_t method, bool compress, zip_uint32_t compression_flags, bool crc) {
     struct context *ctx;
     zip_source_t *s2;
     zip_compression_algorithm_t *algorithm = NULL;
@@ -140,11 +158,16 @@ static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_in
         return NULL;
     }
 
-    if ((ctx = context_new(method, compress, compression_flags, algorithm, za->open_flags & ZIP_CHECKCONS)) == NULL) {
+    if ((ctx = context_new(method, compress, compression_flags, algorithm, za->open_flags & ZIP_CHECKCONS, crc)) == NULL) {
         zip_error_set(&za->error, ZIP_ER_MEMORY, 0);
         return NULL;
     }
 
+    if (compress && algorithm == &zip_algorithm_deflate_compress && _zip_deflate_parallel_wanted(za, method, ZIP_UINT64_MAX)) {
+        /* size is only known in start, the algorithm checks the threshold then */
+        _zip_deflate_set_parallel(ctx->ud, _zip_parallel_threads(za), za->deflate_block_threshold);
+    }
+
     if ((s2 = zip_source_layered(za, src, compress_callback, ctx)) == NULL) {
         context_free(ctx);
         return NULL;
@@ -154,7 +177,7 @@ static zip_source_t *compression_source_new(zip_t *za, zip_source_t *src, zip_in
 }
 
 
-static struct context *context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, bool check_consistency) {
+static struct context *context_new(zip_int32_t method, bool compress, zip_uint32_t compression_flags, zip_compression_algorithm_t *algorithm, bool check_consistency, bool crc) {
     struct context *ctx;
 
     if ((ctx = (struct context *)malloc(sizeof(*ctx))) == NULL) {
@@ -169,6 +192,7 @@ static struct context *context_new(zip_int32_t method, bool compress, zip_uint32
     ctx->end_of_stream = false;
     ctx->is_stored = false;
     ctx->check_consistency = check_consistency;
+    ctx->crc = crc;
 
     if ((ctx->ud = ctx->algorithm->allocate(ZIP_CM_ACTUAL(method), compression_flags, &ctx->error)) == NULL) {
         zip_error_fini(&ctx->error);
@@ -193,6 +217,35 @@ context_free(struct context *ctx) {
 }
 
 
+/* Get the next piece of input, borrowing it from src if possible, and add it to the CRC.
+   The first piece is kept in ctx->buffer if it fits, since it is written
+   as is if compression doesn't make it smaller. */
+static zip_int64_t
+compress_input(zip_source_t *src, struct context *ctx, const zip_uint8_t **input) {
+    zip_int64_t n;
+
+    if (!ctx->borrow) {
+        *input = ctx->buffer;
+        n = zip_source_read(src, ctx->buffer, sizeof(ctx->buffer));
+    }
+    else if ((n = _zip_source_borrow(src, input, BORROW_SIZE)) > 0 && ctx->first_read < 0 && ctx->can_store) {
+        if ((zip_uint64_t)n <= sizeof(ctx->buffer)) {
+            (void)memcpy_s(ctx->buffer, sizeof(ctx->buffer), *input, (size_t)n);
+            *input = ctx->buffer;
+        }
+        else {
+            ctx->can_store = false;
+        }
+    }
+
+    if (n > 0 && ctx->crc) {
+        ctx->input_crc = zip_crc32(ctx->input_crc, *input, (zip_uint64_t)n);
+        ctx->input_size += (zip_uint64_t)n;
+    }
+    return n;
+}
+
+
 static zip_int64_t
 compress_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t len) {
     zip_compression_status_t ret;
@@ -200,6 +253,7 @@ compress_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t l
     zip_int64_t n;
     zip_uint64_t out_offset;
     zip_uint64_t out_len;
+    const zip_uint8_t *input;
 
     if (zip_error_code_zip(&ctx->error) != ZIP_ER_OK) {
         return -1;
@@ -269,7 +323,7 @@ compress_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t l
                 break;
             }
 
-            if ((n = zip_source_read(src, ctx->buffer, sizeof(ctx->buffer))) < 0) {
+            if ((n = compress_input(src, ctx, &input)) < 0) {
                 zip_error_set_from_source(&ctx->error, src);
                 end = true;
                 break;
@@ -290,7 +344,8 @@ compress_read(zip_source_t *src, struct context *ctx, void *data, zip_uint64_t l
                     ctx->first_read = n;
                 }
 
-                ctx->algorithm->input(ctx->ud, ctx->buffer, (zip_uint64_t)n);
+                /* algorithms don't modify their input */
+                ctx->algorithm->input(ctx->ud, (zip_uint8_t *)input, (zip_uint64_t)n);
             }
             break;
 
@@ -330,6 +385,9 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
         ctx->end_of_stream = false;
         ctx->is_stored = false;
         ctx->first_read = -1;
+        ctx->input_crc = 0;
+        ctx->input_size = 0;
+        ctx->borrow = ZIP_SOURCE_CHECK_SUPPORTED(zip_source_supports(src), ZIP_SOURCE_BORROW);
         
         if (zip_source_stat(src, &st) < 0 || zip_source_get_file_attributes(src, &attributes) < 0) {
             zip_error_set_from_source(&ctx->error, src);
@@ -354,6 +412,8 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
 
     case ZIP_SOURCE_STAT: {
         zip_stat_t *st;
+        zip_uint32_t crc;
+        zip_uint64_t size;
 
         st = (zip_stat_t *)data;
 
@@ -362,6 +422,28 @@ compress_callback(zip_source_t *src, void *ud, void *data, zip_uint64_t len, zip
                 st->comp_method = ctx->is_stored ? ZIP_CM_STORE : ZIP_CM_ACTUAL(ctx->method);
                 st->comp_size = ctx->size;
                 st->valid |= ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD;
+
+                if (ctx->crc) {
+                    if ((st->valid & ZIP_STAT_SIZE) && st->size != ctx->input_size) {
+                        zip_error_set(&ctx->error, ZIP_ER_DATA_LENGTH, 0);
+                        return -1;
+                    }
+                    st->size = ctx->input_size;
+                    st->crc = ctx->input_crc;
+                    st->encryption_method = ZIP_EM_NONE;
+                    st->valid |= ZIP_STAT_SIZE | ZIP_STAT_CRC | ZIP_STAT_ENCRYPTION_METHOD;
+                }
+
+                /* block-parallel deflate computes the CRC instead of zip_source_crc */
+                if (ctx->algorithm == &zip_algorithm_deflate_compress && _zip_deflate_get_result(ctx->ud, &crc, &size)) {
+                    if ((st->valid & ZIP_STAT_SIZE) && st->size != size) {
+                        zip_error_set(&ctx->error, ZIP_ER_DATA_LENGTH, 0);
+                        return -1;
+                    }
+                    st->size = size;
+                    st->crc = crc;
+                    st->valid |= ZIP_STAT_SIZE | ZIP_STAT_CRC;
+                }
             }
             else {
                 st->valid &= ~(ZIP_STAT_COMP_SIZE | ZIP_STAT_COMP_METHOD);
@@ -32,9 +32,7 @@
 */
 
 
-#include <limits.h>
 #include <stdlib.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
@@ -49,6 +47,7 @@ struct crc_context {
 };
 
 static zip_int64_t crc_read(zip_source_t *, void *, void *, zip_uint64_t, zip_source_cmd_t);
+static zip_int64_t crc_update(zip_source_t *, struct crc_context *, const zip_uint8_t *, zip_int64_t);
 
 
 zip_source_t *
@@ -69,13 +68,54 @@ zip_source_crc_create(zip_source_t *src, int validate, zip_error_t *error) {
     ctx->validate = validate;
     ctx->crc_complete = 0;
     ctx->crc_position = 0;
-    ctx->crc = (zip_uint32_t)crc32(0, NULL, 0);
+    ctx->crc = 0;
     ctx->size = 0;
 
     return zip_source_layered_create(src, crc_read, ctx, error);
 }
 
 
+/* Add n bytes just read or borrowed from src to the CRC; n == 0 marks the end of data. */
+static zip_int64_t
+crc_update(zip_source_t *src, struct crc_context *ctx, const zip_uint8_t *data, zip_int64_t n) {
+    if (n == 0) {
+        if (ctx->crc_position == ctx->position) {
+            ctx->crc_complete = 1;
+            ctx->size = ctx->position;
+
+            if (ctx->validate) {
+                struct zip_stat st;
+
+                if (zip_source_stat(src, &st) < 0) {
+                    zip_error_set_from_source(&ctx->error, src);
+                    return -1;
+                }
+
+                if ((st.valid & ZIP_STAT_CRC) && st.crc != ctx->crc) {
+                    zip_error_set(&ctx->error, ZIP_ER_CRC, 0);
+                    return -1;
+                }
+                if ((st.valid & ZIP_STAT_SIZE) && st.size != ctx->size) {
+                    /* We don't have the index here, but the caller should know which file they are reading from. */
+                    zip_error_set(&ctx->error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, MAX_DETAIL_INDEX));
+                    return -1;
+                }
+            }
+        }
+    }
+    else if (!ctx->crc_complete && ctx->position <= ctx->crc_position) {
+        zip_uint64_t i = ctx->crc_position - ctx->position;
+
+        if (i < (zip_uint64_t)n) {
+            ctx->crc = zip_crc32(ctx->crc, data + i, (zip_uint64_t)n - i);
+            ctx->crc_position += (zip_uint64_t)n - i;
+        }
+    }
+    ctx->position += (zip_uint64_t)n;
+    return n;
+}
+
+
 static zip_int64_t
 crc_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     struct crc_context *ctx;
@@ -93,44 +133,14 @@ crc_read(zip_source_t *src, void *_ctx, void *data, zip_uint64_t len, zip_source
             zip_error_set_from_source(&ctx->error, src);
             return -1;
         }
+        return crc_update(src, ctx, (const zip_uint8_t *)data, n);
 
-        if (n == 0) {
-            if (ctx->crc_position == ctx->position) {
-                ctx->crc_complete = 1;
-                ctx->size = ctx->position;
-
-                if (ctx->validate) {
-                    struct zip_stat st;
-
-                    if (zip_source_stat(src, &st) < 0) {
-                        zip_error_set_from_source(&ctx->error, src);
-                        return -1;
-                    }
-
-                    if ((st.valid & ZIP_STAT_CRC) && st.crc != ctx->crc) {
-                        zip_error_set(&ctx->error, ZIP_ER_CRC, 0);
-                        return -1;
-                    }
-                    if ((st.valid & ZIP_STAT_SIZE) && st.size != ctx->size) {
-                        /* We don't have the index here, but the caller should know which file they are reading from. */
-                        zip_error_set(&ctx->error, ZIP_ER_INCONS, MAKE_DETAIL_WITH_INDEX(ZIP_ER_DETAIL_INVALID_FILE_LENGTH, MAX_DETAIL_INDEX));
-                        return -1;
-                    }
-                }
-            }
-        }
-        else if (!ctx->crc_complete && ctx->position <= ctx->crc_position) {
-            zip_uint64_t i, nn;
-
-            for (i = ctx->crc_position - ctx->position; i < (zip_uint64_t)n; i += nn) {
-                nn = ZIP_MIN(UINT_MAX, (zip_uint64_t)n - i);
-
-                ctx->crc = (zip_uint32_t)crc32(ctx->crc, (const Bytef *)data + i, (uInt)nn);
-                ctx->crc_position += nn;
-            }
+    case ZIP_SOURCE_BORROW:
+        if ((n = _zip_source_borrow(src, (const zip_uint8_t **)data, len)) < 0) {
+            zip_error_set_from_source(&ctx->error, src);
+            return -1;
         }
-        ctx->position += (zip_uint64_t)n;
-        return n;
+        return crc_update(src, ctx, *(const zip_uint8_t **)data, n);
 
     case ZIP_SOURCE_CLOSE:
         return 0;
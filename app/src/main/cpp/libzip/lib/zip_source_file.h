@@ -72,7 +72,9 @@ struct zip_source_file_context {
    - close, read, seek, and stat must always be implemented.
    - To support specifying the file by name, open, and strdup must be implemented.
    - For write support, the file must be specified by name and close, commit_write, create_temp_output, remove, rollback_write, and tell must be implemented.
-   - create_temp_output_cloning is always optional. */
+   - create_temp_output_cloning is always optional.
+   - borrow is optional; if implemented, it must return a pointer to the next bytes of the file, valid until the next read, borrow, seek, or close.
+   - map is optional; like borrow, but the data stays valid until close. */
 
 struct zip_source_file_operations {
     void (*close)(zip_source_file_context_t *ctx);
@@ -88,6 +90,8 @@ struct zip_source_file_operations {
     char *(*string_duplicate)(zip_source_file_context_t *ctx, const char *);
     zip_int64_t (*tell)(zip_source_file_context_t *ctx, void *f);
     zip_int64_t (*write)(zip_source_file_context_t *ctx, const void *data, zip_uint64_t len);
+    zip_int64_t (*borrow)(zip_source_file_context_t *ctx, const zip_uint8_t **data, zip_uint64_t len);
+    zip_int64_t (*map)(zip_source_file_context_t *ctx, const zip_uint8_t **data, zip_uint64_t len);
 };
 
 zip_source_t *zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zip_int64_t len, const zip_stat_t *st, zip_source_file_operations_t *ops, void *ops_userdata, zip_error_t *error);
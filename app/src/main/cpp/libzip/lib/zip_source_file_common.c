@@ -194,6 +194,12 @@ zip_source_file_common_new(const char *fname, void *file, zip_uint64_t start, zi
     }
 
     ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_ACCEPT_EMPTY);
+    if (ops->borrow != NULL && sb.exists && sb.regular_file) {
+        ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BORROW);
+    }
+    if (ops->map != NULL && sb.exists && sb.regular_file) {
+        ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_MAP);
+    }
     if (ops->create_temp_output_cloning != NULL) {
         if (ctx->supports & ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE)) {
             ctx->supports |= ZIP_SOURCE_MAKE_COMMAND_BITMASK(ZIP_SOURCE_BEGIN_WRITE_CLONING);
@@ -222,6 +228,44 @@ read_file(void *state, void *data, zip_uint64_t len, zip_source_cmd_t cmd) {
     case ZIP_SOURCE_ACCEPT_EMPTY:
         return 0;
 
+    case ZIP_SOURCE_BORROW: {
+        zip_int64_t i;
+        zip_uint64_t n;
+
+        if (ctx->len > 0) {
+            n = ZIP_MIN(ctx->len - ctx->offset, len);
+        }
+        else {
+            n = len;
+        }
+
+        if ((i = ctx->ops->borrow(ctx, (const zip_uint8_t **)data, n)) < 0) {
+            return -1;
+        }
+        ctx->offset += (zip_uint64_t)i;
+
+        return i;
+    }
+
+    case ZIP_SOURCE_MAP: {
+        zip_int64_t i;
+        zip_uint64_t n;
+
+        if (ctx->len > 0) {
+            n = ZIP_MIN(ctx->len - ctx->offset, len);
+        }
+        else {
+            n = len;
+        }
+
+        if ((i = ctx->ops->map(ctx, (const zip_uint8_t **)data, n)) < 0) {
+            return -1;
+        }
+        ctx->offset += (zip_uint64_t)i;
+
+        return i;
+    }
+
     case ZIP_SOURCE_BEGIN_WRITE:
         /* write support should not be set if fname is NULL */
         if (ctx->fname == NULL) {
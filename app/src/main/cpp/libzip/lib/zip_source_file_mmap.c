@@ -0,0 +1,384 @@
+/*
+  zip_source_file_mmap.c -- read-only source for memory mapped file opened by name
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "zipint.h"
+
+#ifdef HAVE_MMAP
+
+#include "zip_source_file.h"
+#include "zip_source_file_stdio.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The file must not be truncated while the source is open: accessing
+   pages of the mapping beyond the new end of file raises SIGBUS instead
+   of returning an error like read(2). */
+
+/* Files up to this size are mapped at once. Larger files are mapped in
+   pieces of this size, one at a time, so they don't exhaust the address space. */
+#ifndef ZIP_MMAP_WINDOW
+#if SIZE_MAX > 0xffffffffu
+#define ZIP_MMAP_WINDOW ((zip_uint64_t)1 << 30)
+#else
+#define ZIP_MMAP_WINDOW ((zip_uint64_t)32 << 20)
+#endif
+#endif
+
+struct mmap_file {
+    int fd;
+    bool mappable;           /* regular file; otherwise data is read with read(2) */
+    zip_uint64_t size;       /* size of file when it was opened */
+    zip_uint64_t position;   /* current offset in file */
+    zip_uint64_t page_size;
+    zip_uint8_t *map;        /* mapped part of file, NULL if none */
+    zip_uint64_t map_offset; /* offset of map in file, multiple of page_size */
+    zip_uint64_t map_length;
+    zip_uint8_t *whole_map;  /* mapping of the whole file for map, NULL if none */
+};
+typedef struct mmap_file mmap_file_t;
+
+static zip_int64_t _zip_mmap_op_borrow(zip_source_file_context_t *ctx, const zip_uint8_t **data, zip_uint64_t len);
+static void _zip_mmap_op_close(zip_source_file_context_t *ctx);
+static zip_int64_t _zip_mmap_op_map(zip_source_file_context_t *ctx, const zip_uint8_t **data, zip_uint64_t len);
+static bool _zip_mmap_op_open(zip_source_file_context_t *ctx);
+static zip_int64_t _zip_mmap_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len);
+static bool _zip_mmap_op_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence);
+static char *_zip_mmap_op_strdup(zip_source_file_context_t *ctx, const char *string);
+static bool map_window(zip_source_file_context_t *ctx, mmap_file_t *file);
+static void unmap_window(mmap_file_t *file);
+
+/* clang-format off */
+static zip_source_file_operations_t ops_mmap = {
+    _zip_mmap_op_close,
+    NULL,
+    NULL,
+    NULL,
+    _zip_mmap_op_open,
+    _zip_mmap_op_read,
+    NULL,
+    NULL,
+    _zip_mmap_op_seek,
+    _zip_stdio_op_stat, /* only uses ctx->f if fname is NULL, which never happens here */
+    _zip_mmap_op_strdup,
+    NULL,
+    NULL,
+    _zip_mmap_op_borrow,
+    _zip_mmap_op_map
+};
+/* clang-format on */
+
+#endif /* HAVE_MMAP */
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_mmap(zip_t *za, const char *fname, zip_uint64_t start, zip_int64_t len) {
+    if (za == NULL)
+        return NULL;
+
+    return zip_source_mmap_create(fname, start, len, &za->error);
+}
+
+
+ZIP_EXTERN zip_source_t *
+zip_source_mmap_create(const char *fname, zip_uint64_t start, zip_int64_t length, zip_error_t *error) {
+    if (fname == NULL || length < ZIP_LENGTH_UNCHECKED) {
+        zip_error_set(error, ZIP_ER_INVAL, 0);
+        return NULL;
+    }
+
+#ifdef HAVE_MMAP
+    return zip_source_file_common_new(fname, NULL, start, length, NULL, &ops_mmap, NULL, error);
+#else
+    return zip_source_file_create(fname, start, length, error);
+#endif
+}
+
+
+#ifdef HAVE_MMAP
+
+static zip_int64_t
+_zip_mmap_op_borrow(zip_source_file_context_t *ctx, const zip_uint8_t **data, zip_uint64_t len) {
+    mmap_file_t *file = (mmap_file_t *)ctx->f;
+    zip_uint64_t n;
+
+    if (!file->mappable) {
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+    if (file->position >= file->size || len == 0) {
+        return 0;
+    }
+
+    if (file->map == NULL || file->position < file->map_offset || file->position >= file->map_offset + file->map_length) {
+        if (!map_window(ctx, file)) {
+            return -1;
+        }
+    }
+
+    n = ZIP_MIN(len, file->map_offset + file->map_length - file->position);
+    *data = file->map + (file->position - file->map_offset);
+    file->position += n;
+
+    return (zip_int64_t)n;
+}
+
+
+static void
+_zip_mmap_op_close(zip_source_file_context_t *ctx) {
+    mmap_file_t *file = (mmap_file_t *)ctx->f;
+
+    unmap_window(file);
+    if (file->whole_map != NULL) {
+        (void)munmap(file->whole_map, (size_t)file->size);
+    }
+    close(file->fd);
+    free(file);
+}
+
+
+/* Unlike the window used by borrow and read, the whole file is mapped, so
+   the data stays valid until the source is closed. */
+static zip_int64_t
+_zip_mmap_op_map(zip_source_file_context_t *ctx, const zip_uint8_t **data, zip_uint64_t len) {
+    mmap_file_t *file = (mmap_file_t *)ctx->f;
+    zip_uint64_t n;
+    void *map;
+
+    if (!file->mappable) {
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+    if (file->position >= file->size || len == 0) {
+        return 0;
+    }
+
+    if (file->whole_map == NULL) {
+        if (file->size > SIZE_MAX) {
+            zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+            return -1;
+        }
+        if ((map = mmap(NULL, (size_t)file->size, PROT_READ, MAP_PRIVATE, file->fd, 0)) == MAP_FAILED) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return -1;
+        }
+        file->whole_map = (zip_uint8_t *)map;
+    }
+
+    n = ZIP_MIN(len, file->size - file->position);
+    *data = file->whole_map + file->position;
+    file->position += n;
+
+    return (zip_int64_t)n;
+}
+
+
+static bool
+_zip_mmap_op_open(zip_source_file_context_t *ctx) {
+    mmap_file_t *file;
+    struct stat sb;
+    long page_size;
+
+    if ((file = (mmap_file_t *)malloc(sizeof(*file))) == NULL) {
+        zip_error_set(&ctx->error, ZIP_ER_MEMORY, 0);
+        return false;
+    }
+
+    if ((file->fd = open(ctx->fname, O_RDONLY | O_CLOEXEC)) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_OPEN, errno);
+        free(file);
+        return false;
+    }
+    if (fstat(file->fd, &sb) < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+        close(file->fd);
+        free(file);
+        return false;
+    }
+
+    page_size = sysconf(_SC_PAGESIZE);
+
+    file->mappable = S_ISREG(sb.st_mode);
+    file->size = file->mappable ? (zip_uint64_t)sb.st_size : 0;
+    file->position = 0;
+    file->page_size = page_size > 0 ? (zip_uint64_t)page_size : 4096;
+    file->map = NULL;
+    file->map_offset = 0;
+    file->map_length = 0;
+    file->whole_map = NULL;
+
+    ctx->f = file;
+    return true;
+}
+
+
+static zip_int64_t
+_zip_mmap_op_read(zip_source_file_context_t *ctx, void *buf, zip_uint64_t len) {
+    mmap_file_t *file = (mmap_file_t *)ctx->f;
+    const zip_uint8_t *data;
+    zip_uint64_t done;
+    zip_int64_t n;
+
+#if SIZE_MAX < ZIP_UINT64_MAX
+    if (len > SIZE_MAX) {
+        len = SIZE_MAX;
+    }
+#endif
+
+    if (!file->mappable) {
+        ssize_t i;
+
+        if ((i = read(file->fd, buf, (size_t)len)) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return -1;
+        }
+        file->position += (zip_uint64_t)i;
+        return (zip_int64_t)i;
+    }
+
+    done = 0;
+    while (done < len) {
+        if ((n = _zip_mmap_op_borrow(ctx, &data, len - done)) < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        (void)memcpy_s((zip_uint8_t *)buf + done, (size_t)(len - done), data, (size_t)n);
+        done += (zip_uint64_t)n;
+    }
+
+    return (zip_int64_t)done;
+}
+
+
+static bool
+_zip_mmap_op_seek(zip_source_file_context_t *ctx, void *f, zip_int64_t offset, int whence) {
+    mmap_file_t *file = (mmap_file_t *)f;
+    zip_int64_t base;
+
+    if (!file->mappable) {
+        if (lseek(file->fd, (off_t)offset, whence) < 0) {
+            zip_error_set(&ctx->error, ZIP_ER_SEEK, errno);
+            return false;
+        }
+        return true;
+    }
+
+    switch (whence) {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = (zip_int64_t)file->position;
+        break;
+    case SEEK_END:
+        base = (zip_int64_t)file->size;
+        break;
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, EINVAL);
+        return false;
+    }
+
+    if ((offset > 0 && base > ZIP_INT64_MAX - offset) || base + offset < 0) {
+        zip_error_set(&ctx->error, ZIP_ER_SEEK, EINVAL);
+        return false;
+    }
+
+    /* the mapping is kept, borrow replaces it if the new position is outside */
+    file->position = (zip_uint64_t)(base + offset);
+    return true;
+}
+
+
+static char *
+_zip_mmap_op_strdup(zip_source_file_context_t *ctx, const char *string) {
+    (void)ctx;
+    return strdup(string);
+}
+
+
+/* Map the piece of the file containing the current position. */
+static bool
+map_window(zip_source_file_context_t *ctx, mmap_file_t *file) {
+    zip_uint64_t window, offset, length;
+    void *map;
+
+    window = ZIP_MMAP_WINDOW - ZIP_MMAP_WINDOW % file->page_size;
+    if (window == 0) {
+        window = file->page_size;
+    }
+
+    unmap_window(file);
+
+    offset = file->position - file->position % file->page_size;
+    length = ZIP_MIN(window, file->size - offset);
+
+    while ((map = mmap(NULL, (size_t)length, PROT_READ, MAP_PRIVATE, file->fd, (off_t)offset)) == MAP_FAILED) {
+        /* not enough address space left, try a smaller piece */
+        if (errno != ENOMEM || length <= file->page_size) {
+            zip_error_set(&ctx->error, ZIP_ER_READ, errno);
+            return false;
+        }
+        length = (length / 2 + file->page_size - 1) / file->page_size * file->page_size;
+    }
+
+    /* Data is read front to back: read ahead aggressively and drop pages behind. */
+#ifdef MADV_SEQUENTIAL
+    (void)madvise(map, (size_t)length, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+    (void)madvise(map, (size_t)length, MADV_WILLNEED);
+#endif
+
+    file->map = (zip_uint8_t *)map;
+    file->map_offset = offset;
+    file->map_length = length;
+    return true;
+}
+
+
+static void
+unmap_window(mmap_file_t *file) {
+    if (file->map != NULL) {
+        (void)munmap(file->map, (size_t)file->map_length);
+        file->map = NULL;
+        file->map_length = 0;
+    }
+}
+
+#endif /* HAVE_MMAP */
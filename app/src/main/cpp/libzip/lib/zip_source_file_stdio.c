@@ -60,6 +60,8 @@ static zip_source_file_operations_t ops_stdio_read = {
     _zip_stdio_op_stat,
     NULL,
     _zip_stdio_op_tell,
+    NULL,
+    NULL,
     NULL
 };
 /* clang-format on */
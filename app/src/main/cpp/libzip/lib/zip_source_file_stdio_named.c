@@ -86,7 +86,9 @@ static zip_source_file_operations_t ops_stdio_named = {
     _zip_stdio_op_stat,
     _zip_stdio_op_strdup,
     _zip_stdio_op_tell,
-    _zip_stdio_op_write
+    _zip_stdio_op_write,
+    NULL,
+    NULL
 };
 /* clang-format on */
 
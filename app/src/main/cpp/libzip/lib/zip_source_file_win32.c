@@ -52,6 +52,8 @@ static zip_source_file_operations_t ops_win32_read = {
     _zip_win32_op_stat,
     NULL,
     _zip_win32_op_tell,
+    NULL,
+    NULL,
     NULL
 };
 
@@ -58,7 +58,9 @@ zip_source_file_operations_t _zip_source_file_win32_named_ops = {
     _zip_win32_named_op_stat,
     _zip_win32_named_op_string_duplicate,
     _zip_win32_op_tell,
-    _zip_win32_named_op_write
+    _zip_win32_named_op_write,
+    NULL,
+    NULL
 };
 /* clang-format on */
 
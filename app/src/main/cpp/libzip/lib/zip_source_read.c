@@ -90,6 +90,91 @@ zip_source_read(zip_source_t *src, void *data, zip_uint64_t len) {
 }
 
 
+/* Like zip_source_read, but returns a pointer to up to len bytes owned by
+   the source instead of copying them. The data stays valid until the next
+   read, borrow, or close. Only call this if the source supports
+   ZIP_SOURCE_BORROW. */
+zip_int64_t
+_zip_source_borrow(zip_source_t *src, const zip_uint8_t **data, zip_uint64_t len) {
+    zip_int64_t n;
+
+    if (src->source_closed) {
+        return -1;
+    }
+    if (!ZIP_SOURCE_IS_OPEN_READING(src) || len > ZIP_INT64_MAX || data == NULL) {
+        zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (src->had_read_error) {
+        return -1;
+    }
+
+    if (_zip_source_eof(src) || len == 0) {
+        return 0;
+    }
+
+    if ((n = _zip_source_call(src, (void *)data, len, ZIP_SOURCE_BORROW)) < 0) {
+        src->had_read_error = true;
+        return -1;
+    }
+
+    if (n == 0) {
+        src->eof = 1;
+    }
+
+    if (src->bytes_read + (zip_uint64_t)n < src->bytes_read) {
+        src->bytes_read = ZIP_UINT64_MAX;
+    }
+    else {
+        src->bytes_read += (zip_uint64_t)n;
+    }
+    return n;
+}
+
+
+/* Like _zip_source_borrow, but the data stays valid until the source is
+   closed, and an error doesn't end reading. Only call this if the source
+   supports ZIP_SOURCE_MAP. */
+zip_int64_t
+_zip_source_map(zip_source_t *src, const zip_uint8_t **data, zip_uint64_t len) {
+    zip_int64_t n;
+
+    if (src->source_closed) {
+        return -1;
+    }
+    if (!ZIP_SOURCE_IS_OPEN_READING(src) || len > ZIP_INT64_MAX || data == NULL) {
+        zip_error_set(&src->error, ZIP_ER_INVAL, 0);
+        return -1;
+    }
+
+    if (src->had_read_error) {
+        return -1;
+    }
+
+    if (_zip_source_eof(src) || len == 0) {
+        return 0;
+    }
+
+    /* failing to map data doesn't keep the source from being read */
+    if ((n = _zip_source_call(src, (void *)data, len, ZIP_SOURCE_MAP)) < 0) {
+        return -1;
+    }
+
+    if (n == 0) {
+        src->eof = 1;
+    }
+
+    if (src->bytes_read + (zip_uint64_t)n < src->bytes_read) {
+        src->bytes_read = ZIP_UINT64_MAX;
+    }
+    else {
+        src->bytes_read += (zip_uint64_t)n;
+    }
+    return n;
+}
+
+
 bool
 _zip_source_eof(zip_source_t *src) {
     return src->eof;
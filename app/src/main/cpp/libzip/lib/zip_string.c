@@ -34,7 +34,6 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <zlib.h>
 
 #include "zipint.h"
 
@@ -42,10 +41,10 @@ zip_uint32_t
 _zip_string_crc32(const zip_string_t *s) {
     zip_uint32_t crc;
 
-    crc = (zip_uint32_t)crc32(0L, Z_NULL, 0);
+    crc = 0;
 
     if (s != NULL)
-        crc = (zip_uint32_t)crc32(crc, s->raw, s->length);
+        crc = zip_crc32(crc, s->raw, s->length);
 
     return crc;
 }
@@ -87,6 +87,9 @@ _zip_unchange(zip_t *za, zip_uint64_t idx, int allow_duplicates) {
                 return -1;
             }
         }
+        if (orig_name) {
+            _zip_name_index_add(za, (const zip_uint8_t *)orig_name, idx);
+        }
     }
 
     _zip_dirent_free(za->entry[idx].changes);
@@ -43,6 +43,7 @@ zip_unchange_all(zip_t *za) {
     if (!_zip_hash_revert(za->names, &za->error)) {
         return -1;
     }
+    _zip_name_index_reset(za);
 
     ret = 0;
     for (i = 0; i < za->nentry; i++)
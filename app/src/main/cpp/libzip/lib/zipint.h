@@ -66,6 +66,8 @@
 #define EOCD64LEN 56
 #define CDBUFSIZE (MAXCOMLEN + EOCDLEN + EOCD64LOCLEN)
 #define BUFSIZE 8192
+#define PARALLEL_CLOSE_MEMORY_LIMIT (256 * 1024 * 1024)
+#define PARALLEL_DEFLATE_THRESHOLD (16 * 1024 * 1024)
 #define EFZIP64SIZE 28
 #define EF_WINZIP_AES_SIZE 7
 #define MAX_DATA_DESCRIPTOR_LENGTH 24
@@ -285,7 +287,11 @@ typedef struct zip_extra_field zip_extra_field_t;
 typedef struct zip_string zip_string_t;
 typedef struct zip_buffer zip_buffer_t;
 typedef struct zip_hash zip_hash_t;
+typedef struct zip_lazy_cdir zip_lazy_cdir_t;
+typedef struct zip_name_index zip_name_index_t;
 typedef struct zip_progress zip_progress_t;
+typedef struct zip_close_parallel zip_close_parallel_t;
+typedef struct zip_deflate_parallel zip_deflate_parallel_t;
 
 /* zip archive, part of API */
 
@@ -312,11 +318,24 @@ struct zip {
     zip_source_t **open_source;      /* open sources using archive */
 
     zip_hash_t *names; /* hash table for name lookup */
+    zip_name_index_t *names_nocase; /* index for ZIP_FL_NOCASE lookup, built on first use */
+    zip_name_index_t *names_nodir;  /* index for ZIP_FL_NODIR lookup, built on first use */
+    zip_lazy_cdir_t *lazy_cdir;     /* undecoded central directory entries (ZIP_LAZY_CDIR), or NULL */
 
     zip_progress_t *progress; /* progress callback for zip_close() */
 
+    zip_entry_written_callback entry_written_callback; /* called by zip_close() after each entry */
+    void (*entry_written_ud_free)(void *);
+    void *entry_written_ud;
+
     zip_uint32_t* write_crc; /* have _zip_write() compute CRC */
     time_t torrent_mtime;
+
+    zip_uint32_t close_threads;      /* worker threads for ZIP_AFL_PARALLEL_CLOSE, 0 for number of CPUs */
+    zip_uint64_t close_memory_limit; /* maximum compressed data buffered by workers */
+    zip_uint64_t deflate_block_threshold; /* entries at least this large are deflated in blocks on all close threads */
+
+    bool write_data_descriptors; /* output can't seek back, sizes and CRC follow entry data */
 };
 
 /* file in zip archive, part of API */
@@ -390,8 +409,21 @@ struct zip_cdir {
     zip_uint64_t eocd_offset; /* offset of EOCD in file */
     zip_string_t *comment; /* zip archive comment */
     bool is_zip64;         /* central directory in zip64 format */
+    zip_lazy_cdir_t *lazy; /* undecoded entries if opened with ZIP_LAZY_CDIR */
+};
+
+/* central directory read with ZIP_LAZY_CDIR: entries are decoded on first use */
+
+struct zip_lazy_cdir {
+    zip_uint8_t *data;     /* copy of central directory */
+    zip_uint64_t *offsets; /* offset of each entry in data, offsets[nentry] is size of data */
+    zip_uint64_t nentry;   /* number of entries */
+    char *names;           /* names of entries hashed without decoding them */
+    bool names_hashed;     /* all names have been added to za->names */
 };
 
+#define ZIP_ENTRY_IS_LAZY(za, idx) ((za)->lazy_cdir != NULL && (idx) < (za)->lazy_cdir->nentry && (za)->entry[(idx)].orig == NULL)
+
 struct zip_extra_field {
     zip_extra_field_t *next;
     zip_flags_t flags; /* in local/central header */
@@ -610,10 +642,21 @@ zip_hash_t *_zip_hash_new(zip_error_t *error);
 bool _zip_hash_reserve_capacity(zip_hash_t *hash, zip_uint64_t capacity, zip_error_t *error);
 bool _zip_hash_revert(zip_hash_t *hash, zip_error_t *error);
 
+void _zip_lazy_cdir_free(zip_lazy_cdir_t *lazy);
+bool _zip_lazy_cdir_hash_names(zip_t *za, zip_error_t *error);
+bool _zip_lazy_cdir_load(zip_t *za, zip_uint64_t idx, zip_error_t *error);
+zip_lazy_cdir_t *_zip_lazy_cdir_new(zip_cdir_t *cd, zip_source_t *src, zip_buffer_t *buffer, zip_error_t *error);
+
 int _zip_mkstempm(char *path, int mode, bool create_file);
 
+void _zip_name_index_add(zip_t *za, const zip_uint8_t *name, zip_uint64_t idx);
+bool _zip_name_index_locate(zip_t *za, const char *fname, zip_flags_t flags, zip_int64_t *idx, zip_error_t *error);
+void _zip_name_index_reset(zip_t *za);
+
 zip_t *_zip_open(zip_source_t *, unsigned int, zip_error_t *);
 
+void _zip_entry_written(zip_t *za, zip_uint64_t index);
+
 void _zip_progress_end(zip_progress_t *progress);
 void _zip_progress_free(zip_progress_t *progress);
 int _zip_progress_start(zip_progress_t *progress);
@@ -634,7 +677,10 @@ int _zip_register_source(zip_t *za, zip_source_t *src);
 void _zip_set_open_error(int *zep, const zip_error_t *err, int ze);
 
 bool zip_source_accept_empty(zip_source_t *src);
+zip_int64_t _zip_source_borrow(zip_source_t *src, const zip_uint8_t **data, zip_uint64_t len);
+zip_int64_t _zip_source_map(zip_source_t *src, const zip_uint8_t **data, zip_uint64_t len);
 zip_int64_t _zip_source_call(zip_source_t *src, void *data, zip_uint64_t length, zip_source_cmd_t command);
+zip_source_t *_zip_source_compress_crc(zip_t *za, zip_source_t *src, zip_int32_t cm, zip_uint32_t compression_flags);
 bool _zip_source_eof(zip_source_t *);
 int zip_source_get_dos_time(zip_source_t *src, zip_dostime_t *dos_time);
 
@@ -667,6 +713,22 @@ void _zip_pkware_keys_free(zip_pkware_keys_t *keys);
 void _zip_pkware_keys_reset(zip_pkware_keys_t *keys);
 
 int _zip_changed(const zip_t *, zip_uint64_t *);
+int _zip_close_add_data(zip_t *za, zip_source_t *src, zip_dirent_t *de, zip_uint32_t changed);
+int _zip_close_sample(zip_t *za, zip_source_t *src, const zip_stat_t *st, zip_dirent_t *de);
+void _zip_close_parallel_free(zip_close_parallel_t *ctx);
+bool _zip_close_parallel_has_entry(const zip_close_parallel_t *ctx, zip_uint64_t position);
+zip_close_parallel_t *_zip_close_parallel_new(zip_t *za, const zip_filelist_t *filelist, zip_uint64_t survivors, zip_uint64_t unchanged_offset);
+int _zip_close_parallel_write(zip_close_parallel_t *ctx, zip_uint64_t position);
+zip_uint32_t _zip_parallel_threads(const zip_t *za);
+bool _zip_deflate_get_result(void *ud, zip_uint32_t *crc, zip_uint64_t *size);
+void _zip_deflate_set_parallel(void *ud, zip_uint32_t threads, zip_uint64_t min_size);
+bool _zip_deflate_parallel_end_of_input(zip_deflate_parallel_t *ctx);
+void _zip_deflate_parallel_free(zip_deflate_parallel_t *ctx);
+bool _zip_deflate_parallel_input(zip_deflate_parallel_t *ctx, zip_uint8_t *data, zip_uint64_t length);
+zip_deflate_parallel_t *_zip_deflate_parallel_new(int level, int mem_level, zip_uint32_t threads, zip_error_t *error);
+zip_compression_status_t _zip_deflate_parallel_process(zip_deflate_parallel_t *ctx, zip_uint8_t *data, zip_uint64_t *length);
+void _zip_deflate_parallel_result(const zip_deflate_parallel_t *ctx, zip_uint32_t *crc, zip_uint64_t *size);
+bool _zip_deflate_parallel_wanted(const zip_t *za, zip_int32_t method, zip_uint64_t size);
 const char *_zip_get_name(zip_t *, zip_uint64_t, zip_flags_t, zip_error_t *);
 int _zip_local_header_read(zip_t *, int);
 void *_zip_memdup(const void *, size_t, zip_error_t *);
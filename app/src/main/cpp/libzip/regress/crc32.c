@@ -0,0 +1,114 @@
+/*
+  crc32.c -- test zip_crc32() and zip_crc32_combine()
+  Copyright (C) 2025 Dieter Baron and Thomas Klausner
+
+  This file is part of libzip, a library to manipulate ZIP archives.
+  The authors can be contacted at <info@libzip.org>
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+  1. Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in
+     the documentation and/or other materials provided with the
+     distribution.
+  3. The names of the authors may not be used to endorse or promote
+     products derived from this software without specific prior
+     written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS
+  OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+  ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+  DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+  DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+  GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+  IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+  OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+  IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+
+#include "zip.h"
+
+/* all lengths up to this are checked at every alignment */
+#define MAX_LENGTH 1100
+#define MAX_OFFSET 16
+
+static zip_uint8_t data[MAX_OFFSET + MAX_LENGTH];
+
+static int check(const char *what, zip_uint64_t offset, zip_uint64_t length, zip_uint32_t got, zip_uint32_t expected);
+static zip_uint32_t crc32_bitwise(zip_uint32_t crc, zip_uint8_t b);
+
+
+int
+main(int argc, char *argv[]) {
+    zip_uint64_t offset, length, split;
+    zip_uint32_t seed, reference, crc1, crc2;
+    int errors;
+
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 1;
+    }
+
+    seed = 1;
+    for (offset = 0; offset < sizeof(data); offset++) {
+        seed = seed * 1103515245 + 12345;
+        data[offset] = (zip_uint8_t)(seed >> 16);
+    }
+
+    errors = 0;
+
+    errors += check("check value", 0, 9, zip_crc32(0, "123456789", 9), 0xcbf43926);
+    errors += check("NULL data", 0, 0, zip_crc32(0x12345678, NULL, 5), 0x12345678);
+
+    for (offset = 0; offset < MAX_OFFSET; offset++) {
+        reference = 0xffffffff;
+        for (length = 0; length <= MAX_LENGTH; length++) {
+            if (length > 0) {
+                reference = crc32_bitwise(reference, data[offset + length - 1]);
+            }
+            errors += check("single pass", offset, length, zip_crc32(0, data + offset, length), ~reference);
+        }
+    }
+
+    for (length = 0; length <= MAX_LENGTH; length += 61) {
+        crc1 = zip_crc32(0, data, length);
+        for (split = 0; split <= length; split += 7) {
+            crc2 = zip_crc32(zip_crc32(0, data, split), data + split, length - split);
+            errors += check("two passes", split, length, crc2, crc1);
+            crc2 = zip_crc32_combine(zip_crc32(0, data, split), zip_crc32(0, data + split, length - split), length - split);
+            errors += check("combine", split, length, crc2, crc1);
+        }
+        errors += check("combine with empty", length, length, zip_crc32_combine(crc1, 0, 0), crc1);
+    }
+
+    return errors > 0 ? 1 : 0;
+}
+
+
+static int
+check(const char *what, zip_uint64_t offset, zip_uint64_t length, zip_uint32_t got, zip_uint32_t expected) {
+    if (got == expected) {
+        return 0;
+    }
+    fprintf(stderr, "%s of %llu bytes at %llu: got %08x, expected %08x\n", what, (unsigned long long)length, (unsigned long long)offset, got, expected);
+    return 1;
+}
+
+
+static zip_uint32_t
+crc32_bitwise(zip_uint32_t crc, zip_uint8_t b) {
+    int i;
+
+    crc ^= b;
+    for (i = 0; i < 8; i++) {
+        crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+    return crc;
+}
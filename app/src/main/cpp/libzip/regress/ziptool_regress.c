@@ -6,7 +6,7 @@
 
 #define FOR_REGRESS
 
-typedef enum { SOURCE_TYPE_NONE, SOURCE_TYPE_IN_MEMORY, SOURCE_TYPE_HOLE } source_type_t;
+typedef enum { SOURCE_TYPE_NONE, SOURCE_TYPE_IN_MEMORY, SOURCE_TYPE_HOLE, SOURCE_TYPE_STREAM } source_type_t;
 
 source_type_t source_type = SOURCE_TYPE_NONE;
 zip_uint64_t fragment_size = 0;
@@ -25,9 +25,9 @@ static int unchange_one(char *argv[]);
 static int unchange_all(char *argv[]);
 static int zin_close(char *argv[]);
 
-#define OPTIONS_REGRESS "F:Himx"
+#define OPTIONS_REGRESS "F:HimSx"
 
-#define USAGE_REGRESS " [-Himx] [-F fragment-size]"
+#define USAGE_REGRESS " [-HimSx] [-F fragment-size]"
 
 #define GETOPT_REGRESS                              \
     case 'H':                                       \
@@ -39,6 +39,9 @@ static int zin_close(char *argv[]);
     case 'm':                                       \
         source_type = SOURCE_TYPE_IN_MEMORY;        \
         break;                                      \
+    case 'S':                                       \
+        source_type = SOURCE_TYPE_STREAM;           \
+        break;                                      \
     case 'F':                                       \
         fragment_size = strtoull(optarg, NULL, 10); \
         break;                                      \
@@ -128,6 +131,7 @@ static int get_whence(const char *str);
 zip_source_t *source_hole_create(const char *, int flags, zip_error_t *);
 static zip_t *read_to_memory(const char *archive, int flags, zip_error_t *error, zip_source_t **srcp);
 static zip_source_t *source_nul(zip_t *za, zip_uint64_t length);
+static zip_t *write_to_stream(const char *archive, int flags, zip_error_t *error);
 
 
 static int
@@ -575,6 +579,105 @@ source_nul(zip_t *zs, zip_uint64_t length) {
 }
 
 
+typedef struct source_stream {
+    zip_error_t error;
+    char *name;
+    FILE *fp;
+    zip_uint64_t offset;
+} source_stream_t;
+
+/* write-only output without seek_write, like a pipe */
+static zip_int64_t
+source_stream_cb(void *ud, void *data, zip_uint64_t length, zip_source_cmd_t command) {
+    source_stream_t *ctx = (source_stream_t *)ud;
+
+    switch (command) {
+    case ZIP_SOURCE_BEGIN_WRITE:
+        if ((ctx->fp = fopen(ctx->name, "wb")) == NULL) {
+            zip_error_set(&ctx->error, ZIP_ER_OPEN, errno);
+            return -1;
+        }
+        ctx->offset = 0;
+        return 0;
+
+    case ZIP_SOURCE_COMMIT_WRITE:
+        if (fclose(ctx->fp) != 0) {
+            ctx->fp = NULL;
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return -1;
+        }
+        ctx->fp = NULL;
+        return 0;
+
+    case ZIP_SOURCE_ERROR:
+        return zip_error_to_data(&ctx->error, data, length);
+
+    case ZIP_SOURCE_FREE:
+        if (ctx->fp != NULL) {
+            fclose(ctx->fp);
+        }
+        free(ctx->name);
+        free(ctx);
+        return 0;
+
+    case ZIP_SOURCE_ROLLBACK_WRITE:
+        if (ctx->fp != NULL) {
+            fclose(ctx->fp);
+            ctx->fp = NULL;
+        }
+        (void)remove(ctx->name);
+        return 0;
+
+    case ZIP_SOURCE_TELL_WRITE:
+        return (zip_int64_t)ctx->offset;
+
+    case ZIP_SOURCE_WRITE:
+        if (length > 0 && fwrite(data, length, 1, ctx->fp) < 1) {
+            zip_error_set(&ctx->error, ZIP_ER_WRITE, errno);
+            return -1;
+        }
+        ctx->offset += length;
+        return (zip_int64_t)length;
+
+    case ZIP_SOURCE_SUPPORTS:
+        return ZIP_SOURCE_SUPPORTS_STREAM_WRITABLE;
+
+    default:
+        zip_error_set(&ctx->error, ZIP_ER_OPNOTSUPP, 0);
+        return -1;
+    }
+}
+
+
+static zip_t *
+write_to_stream(const char *archive, int flags, zip_error_t *error) {
+    source_stream_t *ctx;
+    zip_source_t *src;
+    zip_t *zs;
+
+    if ((ctx = (source_stream_t *)malloc(sizeof(*ctx))) == NULL || (ctx->name = strdup(archive)) == NULL) {
+        free(ctx);
+        zip_error_set(error, ZIP_ER_MEMORY, 0);
+        return NULL;
+    }
+    zip_error_init(&ctx->error);
+    ctx->fp = NULL;
+    ctx->offset = 0;
+
+    if ((src = zip_source_function_create(source_stream_cb, ctx, error)) == NULL) {
+        free(ctx->name);
+        free(ctx);
+        return NULL;
+    }
+
+    if ((zs = zip_open_from_source(src, flags, error)) == NULL) {
+        zip_source_free(src);
+    }
+
+    return zs;
+}
+
+
 static int
 write_memory_src_to_file(const char *archive, zip_source_t *src) {
     zip_stat_t zst;
@@ -642,6 +745,10 @@ ziptool_open(const char *archive, int flags, zip_error_t *error, zip_uint64_t of
     case SOURCE_TYPE_HOLE:
         za = read_hole(archive, flags, error);
         break;
+
+    case SOURCE_TYPE_STREAM:
+        za = write_to_stream(archive, flags, error);
+        break;
     }
 
     return za;
@@ -45,7 +45,6 @@
 #ifdef HAVE_FTS_H
 #include <fts.h>
 #endif
-#include <zlib.h>
 
 #ifndef HAVE_GETOPT
 #include "getopt.h"
@@ -364,9 +363,9 @@ compare_zip(char *const zn[]) {
 static zip_int64_t
 compute_crc(const char *fname) {
     FILE *f;
-    uLong crc = crc32(0L, Z_NULL, 0);
+    zip_uint32_t crc = 0;
     size_t n;
-    Bytef buffer[8192];
+    zip_uint8_t buffer[8192];
 
 
     if ((f = fopen(fname, "rb")) == NULL) {
@@ -375,7 +374,7 @@ compute_crc(const char *fname) {
     }
 
     while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
-        crc = crc32(crc, buffer, (unsigned int)n);
+        crc = zip_crc32(crc, buffer, n);
     }
 
     if (ferror(f)) {
@@ -844,12 +843,12 @@ test_file(zip_t *za, zip_uint64_t idx, const char *zipname, const char *filename
         return -1;
     }
 
-    ncrc = (zip_uint32_t)crc32(0, NULL, 0);
+    ncrc = 0;
     nsize = 0;
 
     while ((n = zip_fread(zf, buf, sizeof(buf))) > 0) {
         nsize += (zip_uint64_t)n;
-        ncrc = (zip_uint32_t)crc32(ncrc, (const Bytef *)buf, (unsigned int)n);
+        ncrc = zip_crc32(ncrc, buf, (zip_uint64_t)n);
     }
 
     if (n < 0) {
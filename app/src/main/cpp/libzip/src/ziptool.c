@@ -82,6 +82,7 @@ static const char* encode_filename(const char* name);
 zip_t *za, *z_in[16];
 unsigned int z_in_count;
 zip_flags_t stat_flags;
+int archive_mmap = 0;
 int hex_encoded_filenames = 0; // Can only be set in ziptool_regress.
 
 static int
@@ -205,6 +206,25 @@ add_file(char *argv[]) {
     return 0;
 }
 
+static int
+add_file_mmap(char *argv[]) {
+    zip_source_t *zs;
+    zip_uint64_t start = strtoull(argv[2], NULL, 10);
+    zip_int64_t len = strtoll(argv[3], NULL, 10);
+
+    if ((zs = zip_source_mmap(za, argv[1], start, len)) == NULL) {
+        fprintf(stderr, "can't create zip_source from mapped file: %s\n", zip_strerror(za));
+        return -1;
+    }
+
+    if (zip_file_add(za, decode_filename(argv[0]), zs, 0) == -1) {
+        zip_source_free(zs);
+        fprintf(stderr, "can't add file '%s': %s\n", argv[0], zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
 static int
 add_from_zip(char *argv[]) {
     zip_uint64_t idx, start;
@@ -250,6 +270,30 @@ cat(char *argv[]) {
     return cat_impl(idx, 0, 0);
 }
 
+static int
+cat_mapped(char *argv[]) {
+    /* output contents of stored file, read in place from the mapped archive, to stdout */
+    const zip_uint8_t *data;
+    zip_uint64_t idx, length;
+    zip_flags_t flags;
+
+    idx = strtoull(argv[0], NULL, 10);
+    flags = get_flags(argv[1]);
+    if (zip_file_get_mapped_data(za, idx, flags, &data, &length) < 0) {
+        fprintf(stderr, "can't get mapped data for index '%" PRIu64 "': %s\n", idx, zip_strerror(za));
+        return -1;
+    }
+#ifdef _WIN32
+    /* Need to set stdout to binary mode for Windows */
+    setmode(fileno(stdout), _O_BINARY);
+#endif
+    if (length > 0 && fwrite(data, (size_t)length, 1, stdout) != 1) {
+        fprintf(stderr, "can't write file contents: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
 static int
 cat_partial(char *argv[]) {
     /* output partial file contents to stdout */
@@ -429,6 +473,21 @@ get_file_comment(char *argv[]) {
     return 0;
 }
 
+static int
+get_local_header_offset(char *argv[]) {
+    zip_int64_t offset;
+    zip_uint64_t idx;
+    zip_flags_t flags;
+    idx = strtoull(argv[0], NULL, 10);
+    flags = get_flags(argv[1]);
+    if ((offset = zip_file_get_local_header_offset(za, idx, flags)) < 0) {
+        fprintf(stderr, "can't get local header offset for index '%" PRIu64 "': %s\n", idx, zip_strerror(za));
+        return -1;
+    }
+    printf("local header of '%s' at offset %" PRId64 "\n", zip_get_name(za, idx, 0), offset);
+    return 0;
+}
+
 static int
 get_num_entries(char *argv[]) {
     zip_int64_t count;
@@ -475,6 +534,17 @@ print_progress(char *argv[]) {
     return 0;
 }
 
+static void
+entry_written_callback(zip_t *archive, zip_uint64_t idx, const zip_stat_t *st, void *ud) {
+    printf("wrote '%s': size %" PRIu64 ", compressed size %" PRIu64 ", compression method %d\n", st->name, st->size, st->comp_size, st->comp_method);
+}
+
+static int
+print_written(char *argv[]) {
+    zip_register_entry_written_callback_with_state(za, entry_written_callback, NULL, NULL);
+    return 0;
+}
+
 static int
 zrename(char *argv[]) {
     zip_uint64_t idx;
@@ -641,6 +711,30 @@ set_file_mtime_all(char *argv[]) {
     return 0;
 }
 
+static int
+set_parallel_close_limits(char *argv[]) {
+    zip_uint32_t threads;
+    zip_uint64_t memory_limit;
+    threads = (zip_uint32_t)strtoull(argv[0], NULL, 10);
+    memory_limit = strtoull(argv[1], NULL, 10);
+    if (zip_set_parallel_close_limits(za, threads, memory_limit) < 0) {
+        fprintf(stderr, "can't set parallel close limits to '%" PRIu32 "' threads, '%" PRIu64 "' bytes: %s\n", threads, memory_limit, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
+static int
+set_parallel_deflate_threshold(char *argv[]) {
+    zip_uint64_t min_size;
+    min_size = strtoull(argv[0], NULL, 10);
+    if (zip_set_parallel_deflate_threshold(za, min_size) < 0) {
+        fprintf(stderr, "can't set parallel deflate threshold to '%" PRIu64 "' bytes: %s\n", min_size, zip_strerror(za));
+        return -1;
+    }
+    return 0;
+}
+
 static int
 set_password(char *argv[]) {
     /* set default password */
@@ -709,6 +803,12 @@ static int parse_archive_flag(const char* arg) {
     else if (strcasecmp(arg, "create-or-keep-file-for-empty-archive") == 0) {
         return ZIP_AFL_CREATE_OR_KEEP_FILE_FOR_EMPTY_ARCHIVE;
     }
+    else if (strcasecmp(arg, "parallel-close") == 0) {
+        return ZIP_AFL_PARALLEL_CLOSE;
+    }
+    else if (strcasecmp(arg, "adaptive-compression") == 0) {
+        return ZIP_AFL_ADAPTIVE_COMPRESSION;
+    }
     return -1;
 }
 
@@ -725,6 +825,8 @@ get_flags(const char *arg) {
         flags |= ZIP_FL_LOCAL;
     if (strchr(arg, 'u') != NULL)
         flags |= ZIP_FL_UNCHANGED;
+    if (strchr(arg, 'v') != NULL)
+        flags |= ZIP_FL_CHECK_CRC;
     if (strchr(arg, '8') != NULL)
         flags |= ZIP_FL_ENC_UTF_8;
     if (strchr(arg, '4') != NULL)
@@ -807,7 +909,7 @@ read_from_file(const char *archive, int flags, zip_error_t *error, zip_uint64_t
     zip_source_t *source;
     int err;
 
-    if (offset == 0 && length == 0) {
+    if (offset == 0 && length == 0 && !archive_mmap) {
         if (strcmp(archive, "/dev/stdin") == 0) {
             zaa = zip_fdopen(STDIN_FILENO, flags & ~ZIP_CREATE, &err);
         }
@@ -824,7 +926,13 @@ read_from_file(const char *archive, int flags, zip_error_t *error, zip_uint64_t
             zip_error_set(error, ZIP_ER_INVAL, 0);
             return NULL;
         }
-        if ((source = zip_source_file_create(archive, offset, (zip_int64_t)length, error)) == NULL || (zaa = zip_open_from_source(source, flags, error)) == NULL) {
+        if (archive_mmap) {
+            source = zip_source_mmap_create(archive, offset, (zip_int64_t)length, error);
+        }
+        else {
+            source = zip_source_file_create(archive, offset, (zip_int64_t)length, error);
+        }
+        if (source == NULL || (zaa = zip_open_from_source(source, flags, error)) == NULL) {
             zip_source_free(source);
             return NULL;
         }
@@ -836,8 +944,10 @@ read_from_file(const char *archive, int flags, zip_error_t *error, zip_uint64_t
 dispatch_table_t dispatch_table[] = {{"add", 2, "name content", "add file called name using content", add},
                                      {"add_dir", 1, "name", "add directory", add_dir},
                                      {"add_file", 4, "name file_to_add offset len", "add file to archive, len bytes starting from offset", add_file},
+                                     {"add_file_mmap", 4, "name file_to_add offset len", "add file to archive reading it through a memory mapping, len bytes starting from offset", add_file_mmap},
                                      {"add_from_zip", 5, "name archivename index offset len", "add file from another archive, len bytes starting from offset", add_from_zip},
                                      {"cat", 1, "index", "output file contents to stdout", cat},
+                                     {"cat_mapped", 2, "index flags", "output contents of stored file from memory mapped archive to stdout", cat_mapped},
                                      {"cat_partial", 3, "index start length", "output partial file contents to stdout", cat_partial},
                                      {"count_extra", 2, "index flags", "show number of extra fields for archive entry", count_extra},
                                      {"count_extra_by_id", 3, "index extra_id flags", "show number of extra fields of type extra_id for archive entry", count_extra_by_id},
@@ -849,9 +959,11 @@ dispatch_table_t dispatch_table[] = {{"add", 2, "name content", "add file called
                                      {"get_extra", 3, "index extra_index flags", "show extra field", get_extra},
                                      {"get_extra_by_id", 4, "index extra_id extra_index flags", "show extra field of type extra_id", get_extra_by_id},
                                      {"get_file_comment", 1, "index", "get file comment", get_file_comment},
+                                     {"get_local_header_offset", 2, "index flags", "show offset of local header in archive", get_local_header_offset},
                                      {"get_num_entries", 1, "flags", "get number of entries in archive", get_num_entries},
                                      {"name_locate", 2, "name flags", "find entry in archive", name_locate},
                                      {"print_progress", 0, "", "print progress during zip_close()", print_progress},
+                                     {"print_written", 0, "", "print each entry written by zip_close()", print_written},
                                      {"rename", 2, "index name", "rename entry", zrename},
                                      {"replace_file_contents", 2, "index data", "replace entry with data", replace_file_contents},
                                      {"set_archive_comment", 1, "comment", "set archive comment", set_archive_comment},
@@ -863,6 +975,8 @@ dispatch_table_t dispatch_table[] = {{"add", 2, "name content", "add file called
                                      {"set_file_encryption", 3, "index method password", "set file encryption method", set_file_encryption},
                                      {"set_file_mtime", 2, "index timestamp", "set file modification time", set_file_mtime},
                                      {"set_file_mtime_all", 1, "timestamp", "set file modification time for all files", set_file_mtime_all},
+                                     {"set_parallel_close_limits", 2, "threads memory_limit", "set number of threads and memory for parallel close", set_parallel_close_limits},
+                                     {"set_parallel_deflate_threshold", 1, "min_size", "deflate entries of at least min_size bytes in blocks on all threads for parallel close", set_parallel_deflate_threshold},
                                      {"set_password", 1, "password", "set default password for encryption", set_password},
                                      {"stat", 1, "index", "print information about entry", zstat}
 #ifdef DISPATCH_REGRESS
@@ -902,7 +1016,7 @@ usage(const char *progname, const char *reason) {
         out = stdout;
     else
         out = stderr;
-    fprintf(out, "usage: %s [-ceghnrst]" USAGE_REGRESS " [-l len] [-o offset] archive command1 [args] [command2 [args] ...]\n", progname);
+    fprintf(out, "usage: %s [-ceghLMnrst]" USAGE_REGRESS " [-l len] [-o offset] archive command1 [args] [command2 [args] ...]\n", progname);
     if (reason != NULL) {
         fprintf(out, "%s\n", reason);
         exit(1);
@@ -919,10 +1033,12 @@ usage(const char *progname, const char *reason) {
                  "\t-H\t\twrite files with holes compactly\n"
 #endif
                  "\t-h\t\tdisplay this usage\n"
+                 "\t-L\t\tdecode central directory entries on first use (read-only)\n"
                  "\t-l len\t\tonly use len bytes of file\n"
 #ifdef FOR_REGRESS
                  "\t-m\t\tread archive into memory, and modify there; write out at end\n"
 #endif
+                 "\t-M\t\tread archive through a memory mapping\n"
                  "\t-n\t\tcreate archive if it doesn't exist\n"
                  "\t-o offset\tstart reading file at offset\n"
                  "\t-r\t\tprint raw file name encoding without translation (for stat)\n"
@@ -944,8 +1060,10 @@ usage(const char *progname, const char *reason) {
                  "\ts\tZIP_FL_ENC_STRICT\n"
                  "\tu\tZIP_FL_UNCHANGED\n");
     fprintf(out, "\nSupported archive flags are:\n"
+	         "\tadaptive-compression\n"
 	         "\tcreate-or-keep-empty-file-for-archive\n"
 	         "\tis-torrentzip\n"
+	         "\tparallel-close\n"
 	         "\trdonly\n"
 	         "\twant-torrentzip\n");
     fprintf(out, "\nSupported compression methods are:\n"
@@ -997,7 +1115,7 @@ main(int argc, char *argv[]) {
     flags = 0;
     prg = argv[0];
 
-    while ((c = getopt(argc, argv, "ceghl:no:rst" OPTIONS_REGRESS)) != -1) {
+    while ((c = getopt(argc, argv, "ceghLl:Mno:rst" OPTIONS_REGRESS)) != -1) {
         switch (c) {
         case 'c':
             flags |= ZIP_CHECKCONS;
@@ -1011,9 +1129,15 @@ main(int argc, char *argv[]) {
         case 'h':
             usage(prg, NULL);
             break;
+        case 'L':
+            flags |= ZIP_LAZY_CDIR;
+            break;
         case 'l':
             len = strtoull(optarg, NULL, 10);
             break;
+        case 'M':
+            archive_mmap = 1;
+            break;
         case 'n':
             flags |= ZIP_CREATE;
             break;
@@ -0,0 +1,20 @@
+#include "memory_budget.h"
+
+bool MemoryBudget::try_reserve(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (used + bytes > limit) {
+        return false;
+    }
+    used += bytes;
+    return true;
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    used -= bytes;
+}
+
+uint64_t MemoryBudget::in_use() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
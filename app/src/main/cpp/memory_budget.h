@@ -0,0 +1,34 @@
+#ifndef ARCHIVER_MEMORY_BUDGET_H
+#define ARCHIVER_MEMORY_BUDGET_H
+
+#include <cstdint>
+#include <mutex>
+
+// Ограничение на объём данных файлов, одновременно находящихся в памяти
+// во время createZip: прочитанных в буферы входов, сжатых в памяти копий
+// дубликатов (резервы держатся до конца zip_close) и - остатком бюджета -
+// сжатых потоками zip_close, но еще не записанных записей.
+// try_reserve() не ждёт: если места нет, файл читается потоково.
+// Вне бюджета: свободные буферы, которые BufferPool оставляет себе для
+// следующих заданий (до 32 МиБ), и рабочая память потоков libzip -
+// состояние zlib и блоки параллельного deflate больших записей.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit) : limit(limit) {}
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    bool try_reserve(uint64_t bytes);
+    void release(uint64_t bytes);
+
+    uint64_t capacity() const { return limit; }
+    uint64_t in_use();
+
+private:
+    const uint64_t limit;
+    uint64_t used = 0;
+    std::mutex mutex;
+};
+
+#endif // ARCHIVER_MEMORY_BUDGET_H
@@ -1,179 +1,366 @@
 #include <jni.h>
 #include <zip.h>
-#include <android/log.h>
 #include <vector>
-#include <fstream>
 #include <string>
-#include <thread>
+#include <ctime>
+#include <cstdint>
 #include <mutex>
-#include <queue>
-#include <condition_variable>
-
-#define LOG_TAG "ZipArchiver"
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-
-// Структура для хранения данных файла
-struct FileData {
-    std::vector<char> content;
-    std::string name;
-};
-
-// Глобальные переменные для очереди и синхронизации
-std::queue<FileData> file_queue;
-std::mutex queue_mutex;
-std::condition_variable queue_cv;
-bool all_files_processed = false;
-std::mutex zip_mutex;
-
-void process_file(const std::string& file_path, const std::string& file_name) {
-    LOGD("Processing file: %s", file_path.c_str());
-
-    FileData file_data;
-    file_data.name = file_name;
-
-    // Читаем содержимое файла
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-        LOGE("Failed to open file: %s", file_path.c_str());
-        return;
-    }
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive_session.h"
+#include "archiver_log.h"
+#include "blob_cache.h"
+#include "progress_reporter.h"
+
+// Живые сессии по handle. Handle - порядковый номер, а не адрес: номера не
+// повторяются, поэтому запоздалый cancelZip не попадет в чужую сессию,
+// созданную по тому же адресу
+static std::mutex sessions_mutex;
+static std::unordered_map<jlong, ArchiveSession*> sessions;
+static jlong next_handle = 1;
+
+// Сессия по handle из Kotlin. Вызывается из потока задания, который
+// владеет сессией, поэтому destroySession не может удалить ее параллельно
+static ArchiveSession* session_from_handle(jlong handle) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto it = sessions.find(handle);
+    return it == sessions.end() ? nullptr : it->second;
+}
 
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    file_data.content.resize(size);
+static std::string string_from_java(JNIEnv* env, jstring value) {
+    const char* raw = env->GetStringUTFChars(value, nullptr);
+    std::string result(raw);
+    env->ReleaseStringUTFChars(value, raw);
+    return result;
+}
 
-    if (!file.read(file_data.content.data(), size)) {
-        LOGE("Failed to read file: %s", file_path.c_str());
-        return;
-    }
+// Входные файлы по путям; имя в архиве - имя файла без каталогов
+static std::vector<InputFile> inputs_from_paths(JNIEnv* env, jobjectArray file_paths) {
+    jsize file_count = env->GetArrayLength(file_paths);
+    std::vector<InputFile> inputs;
+    inputs.reserve(file_count);
+    for (jsize i = 0; i < file_count; i++) {
+        jstring file_path = (jstring)env->GetObjectArrayElement(file_paths, i);
 
-    // Добавляем в очередь
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        file_queue.push(std::move(file_data));
+        InputFile input;
+        input.path = string_from_java(env, file_path);
+
+        // Получаем имя файла
+        size_t last_slash = input.path.find_last_of("/\\");
+        input.name = (last_slash == std::string::npos) ? input.path : input.path.substr(last_slash + 1);
+
+        struct stat st;
+        input.mtime = time(nullptr);
+        if (stat(input.path.c_str(), &st) == 0) {
+            input.size = static_cast<uint64_t>(st.st_size);
+            input.mtime = st.st_mtime;
+        }
+        inputs.push_back(std::move(input));
+
+        env->DeleteLocalRef(file_path);
     }
-    queue_cv.notify_one();
+    return inputs;
+}
 
-    LOGD("Finished processing: %s", file_path.c_str());
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_com_example_myapplication_MainActivity_createSession(
+        JNIEnv *env,
+        jobject thiz
+) {
+    auto* session = new ArchiveSession();
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    jlong handle = next_handle++;
+    sessions.emplace(handle, session);
+    return handle;
 }
 
-void zip_writer_thread(zip_t* zip) {
-    while (true) {
-        FileData file_data;
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_example_myapplication_MainActivity_destroySession(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session
+) {
+    ArchiveSession* archive = nullptr;
+    {
+        // После удаления из реестра cancelZip сессию уже не найдет
+        std::lock_guard<std::mutex> lock(sessions_mutex);
+        auto it = sessions.find(session);
+        if (it != sessions.end()) {
+            archive = it->second;
+            sessions.erase(it);
+        }
+    }
+    delete archive;
+}
 
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            queue_cv.wait(lock, []{
-                return !file_queue.empty() || all_files_processed;
-            });
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_myapplication_MainActivity_createZip(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session,
+        jobjectArray file_paths,
+        jstring output_zip_path,
+        jobject progress_callback
+) {
+    ArchiveSession* archive = session_from_handle(session);
+    if (!archive) {
+        LOGE("createZip called without a session");
+        return JNI_FALSE;
+    }
 
-            if (file_queue.empty() && all_files_processed) {
-                break;
-            }
+    std::string output = string_from_java(env, output_zip_path);
+    std::vector<InputFile> inputs = inputs_from_paths(env, file_paths);
 
-            if (file_queue.empty()) {
-                continue;
-            }
+    // Прогресс и отмена zip_close()
+    ProgressReporter progress(env, progress_callback, archive->cancel_flag());
 
-            file_data = std::move(file_queue.front());
-            file_queue.pop();
-        }
+    return archive->create_zip(inputs, output, progress) ? JNI_TRUE : JNI_FALSE;
+}
 
-        // Создаем копию данных для архива
-        char* data_copy = new char[file_data.content.size()];
-        std::copy(file_data.content.begin(), file_data.content.end(), data_copy);
-
-        {
-            std::lock_guard<std::mutex> lock(zip_mutex);
-            zip_source_t* source = zip_source_buffer(zip, data_copy, file_data.content.size(), 1);
-            if (!source) {
-                LOGE("Failed to create source for %s", file_data.name.c_str());
-                delete[] data_copy;
-                continue;
-            }
-
-            if (zip_file_add(zip, file_data.name.c_str(), source, ZIP_FL_ENC_UTF_8) < 0) {
-                LOGE("Failed to add %s to archive: %s", file_data.name.c_str(), zip_strerror(zip));
-                zip_source_free(source);
-            } else {
-                LOGI("Added to archive: %s (size: %zu bytes)",
-                     file_data.name.c_str(), file_data.content.size());
-            }
-        }
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_myapplication_MainActivity_createZipFromDirectory(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session,
+        jstring directory,
+        jstring output_zip_path,
+        jobject progress_callback
+) {
+    ArchiveSession* archive = session_from_handle(session);
+    if (!archive) {
+        LOGE("createZipFromDirectory called without a session");
+        return JNI_FALSE;
     }
+
+    // Обход дерева - в нативном коде, Kotlin передает только корень
+    std::string root = string_from_java(env, directory);
+    std::string output = string_from_java(env, output_zip_path);
+
+    ProgressReporter progress(env, progress_callback, archive->cancel_flag());
+
+    return archive->create_zip_from_directory(root, output, progress) ? JNI_TRUE : JNI_FALSE;
 }
 
 extern "C"
 JNIEXPORT jboolean JNICALL
-Java_com_example_myapplication_MainActivity_createZip(
+Java_com_example_myapplication_MainActivity_updateZip(
         JNIEnv *env,
         jobject thiz,
+        jlong session,
         jobjectArray file_paths,
-        jstring output_zip_path,
+        jstring archive_path,
+        jboolean check_crc,
+        jboolean remove_missing,
         jobject progress_callback
 ) {
-    const char* output_path = env->GetStringUTFChars(output_zip_path, nullptr);
-    LOGI("Creating zip archive at: %s", output_path);
-
-    // Создаем архив
-    int err = 0;
-    zip_t* zip = zip_open(output_path, ZIP_CREATE | ZIP_TRUNCATE, &err);
-    if (!zip) {
-        LOGE("Failed to create zip archive: error %d", err);
-        env->ReleaseStringUTFChars(output_zip_path, output_path);
+    ArchiveSession* archive = session_from_handle(session);
+    if (!archive) {
+        LOGE("updateZip called without a session");
         return JNI_FALSE;
     }
 
-    jsize file_count = env->GetArrayLength(file_paths);
-    LOGI("Processing %d files", file_count);
+    std::string path = string_from_java(env, archive_path);
+    std::vector<InputFile> inputs = inputs_from_paths(env, file_paths);
 
-    // Запускаем writer thread
-    std::thread writer(zip_writer_thread, zip);
+    UpdateOptions options;
+    options.check_crc = check_crc == JNI_TRUE;
+    options.remove_missing = remove_missing == JNI_TRUE;
 
-    // Создаем и запускаем worker threads
-    std::vector<std::thread> workers;
+    ProgressReporter progress(env, progress_callback, archive->cancel_flag());
+
+    return archive->update_zip(inputs, path, options, progress) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_myapplication_MainActivity_createZipFromFds(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session,
+        jintArray fds,
+        jobjectArray names,
+        jint output_fd,
+        jobject progress_callback
+) {
+    // Дескрипторы (и входные, и output_fd) приходят из
+    // ParcelFileDescriptor.detachFd(), с этого момента за их закрытие
+    // отвечаем мы
+    jsize file_count = env->GetArrayLength(fds);
+    std::vector<jint> raw_fds(file_count);
+    env->GetIntArrayRegion(fds, 0, file_count, raw_fds.data());
+
+    ArchiveSession* archive = session_from_handle(session);
+    if (!archive || env->GetArrayLength(names) != file_count) {
+        LOGE("createZipFromFds called with invalid arguments");
+        for (jint fd : raw_fds) {
+            close(fd);
+        }
+        close(output_fd);
+        return JNI_FALSE;
+    }
+
+    std::vector<InputFile> inputs;
+    inputs.reserve(file_count);
     for (jsize i = 0; i < file_count; i++) {
-        jstring file_path = (jstring)env->GetObjectArrayElement(file_paths, i);
-        const char* raw_path = env->GetStringUTFChars(file_path, nullptr);
+        jstring name = (jstring)env->GetObjectArrayElement(names, i);
+        const char* raw_name = env->GetStringUTFChars(name, nullptr);
+
+        InputFile input;
+        input.fd = raw_fds[i];
+        input.name = raw_name;
+
+        struct stat st;
+        input.mtime = time(nullptr);
+        if (fstat(input.fd, &st) == 0 && S_ISREG(st.st_mode)) {
+            input.size = static_cast<uint64_t>(st.st_size);
+            input.mtime = st.st_mtime;
+        } else {
+            // размер неизвестен (канал и т.п.), такой файл можно только читать потоком
+            input.size = UINT64_MAX;
+        }
+        inputs.push_back(std::move(input));
 
-        // Получаем имя файла
-        std::string full_path(raw_path);
-        size_t last_slash = full_path.find_last_of("/\\");
-        std::string file_name = (last_slash == std::string::npos) ? full_path : full_path.substr(last_slash + 1);
+        env->ReleaseStringUTFChars(name, raw_name);
+        env->DeleteLocalRef(name);
+    }
 
-        workers.emplace_back(process_file, full_path, file_name);
+    // Прогресс и отмена zip_close()
+    ProgressReporter progress(env, progress_callback, archive->cancel_flag());
 
-        env->ReleaseStringUTFChars(file_path, raw_path);
-        env->DeleteLocalRef(file_path);
+    return archive->create_zip(inputs, output_fd, progress) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_example_myapplication_MainActivity_extractZip(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session,
+        jint archive_fd,
+        jstring output_dir,
+        jobject progress_callback
+) {
+    // archive_fd приходит из ParcelFileDescriptor.detachFd(), закрываем его мы
+    ArchiveSession* archive = session_from_handle(session);
+    if (!archive) {
+        LOGE("extractZip called without a session");
+        close(archive_fd);
+        return JNI_FALSE;
     }
 
-    // Ждем завершения всех worker threads
-    for (auto& worker : workers) {
-        if (worker.joinable()) {
-            worker.join();
-        }
+    const char* raw_dir = env->GetStringUTFChars(output_dir, nullptr);
+    std::string directory(raw_dir);
+    env->ReleaseStringUTFChars(output_dir, raw_dir);
+
+    ProgressReporter progress(env, progress_callback, archive->cancel_flag());
+
+    return archive->extract_zip(archive_fd, directory, progress) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_example_myapplication_MainActivity_cancelZip(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session
+) {
+    // zip_close() проверяет флаг между блоками данных, распаковка - между
+    // кусками каждой записи. Вызывается из UI-потока, поэтому сессия
+    // ищется и отменяется под замком реестра: destroySession из потока
+    // задания не удалит ее между поиском и cancel()
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto it = sessions.find(session);
+    if (it != sessions.end()) {
+        it->second->cancel();
     }
+}
 
-    // Сообщаем writer thread, что все файлы обработаны
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        all_files_processed = true;
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_example_myapplication_MainActivity_setMemoryBudget(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session,
+        jlong bytes
+) {
+    ArchiveSession* archive = session_from_handle(session);
+    if (archive && bytes > 0) {
+        archive->set_memory_budget(static_cast<uint64_t>(bytes));
+    }
+}
+
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_com_example_myapplication_MainActivity_getSessionStats(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session
+) {
+    ArchiveSession* archive = session_from_handle(session);
+    if (!archive) {
+        return nullptr;
     }
-    queue_cv.notify_one();
 
-    // Ждем завершения writer thread
-    if (writer.joinable()) {
-        writer.join();
+    // Порядок полей совпадает с SessionStats в Kotlin
+    SessionStats stats = archive->stats();
+    jlong values[] = {
+            static_cast<jlong>(stats.files_added),
+            static_cast<jlong>(stats.files_streamed),
+            static_cast<jlong>(stats.files_failed),
+            static_cast<jlong>(stats.bytes_buffered),
+            static_cast<jlong>(stats.files_unchanged),
+            static_cast<jlong>(stats.files_removed),
+            static_cast<jlong>(stats.files_cached),
+            static_cast<jlong>(stats.files_deduplicated),
+    };
+    constexpr jsize count = sizeof(values) / sizeof(values[0]);
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
     }
+    return result;
+}
 
-    zip_close(zip);
-    env->ReleaseStringUTFChars(output_zip_path, output_path);
-    LOGI("Zip archive created successfully with %d files", file_count);
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_example_myapplication_MainActivity_getJobStats(
+        JNIEnv *env,
+        jobject thiz,
+        jlong session,
+        jobject buffer
+) {
+    ArchiveSession* archive = session_from_handle(session);
+    if (!archive || !buffer) {
+        return -1;
+    }
 
-    // Сбрасываем флаги для следующего вызова
-    all_files_processed = false;
+    // Статистика пишется прямо в память direct ByteBuffer без копий через
+    // JNI; если буфер мал, возвращается нужный размер и буфер не меняется
+    void* address = env->GetDirectBufferAddress(buffer);
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (!address || capacity < 0) {
+        LOGE("getJobStats needs a direct buffer");
+        return -1;
+    }
+    size_t size = archive->job_stats().serialize(address, static_cast<size_t>(capacity));
+    return static_cast<jint>(size);
+}
 
-    return JNI_TRUE;
-}
\ No newline at end of file
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_example_myapplication_MainActivity_configureBlobCache(
+        JNIEnv *env,
+        jobject thiz,
+        jstring directory,
+        jlong max_bytes
+) {
+    // Кэш общий для всех сессий; повторный вызов с тем же каталогом только
+    // меняет предел
+    BlobCache::instance().configure(string_from_java(env, directory), max_bytes > 0 ? static_cast<uint64_t>(max_bytes) : 0);
+}
@@ -0,0 +1,15 @@
+#include "progress.h"
+
+void Progress::attach(zip_t* zip) {
+    // libzip вызывает нас часто, прореживание - дело report()
+    zip_register_progress_callback_with_state(zip, 0.001, progress_callback, nullptr, this);
+    zip_register_cancel_callback_with_state(zip, cancel_callback, nullptr, this);
+}
+
+void Progress::progress_callback(zip_t*, double progress, void* userdata) {
+    static_cast<Progress*>(userdata)->report(progress);
+}
+
+int Progress::cancel_callback(zip_t*, void* userdata) {
+    return static_cast<Progress*>(userdata)->is_cancelled() ? 1 : 0;
+}
@@ -0,0 +1,38 @@
+#ifndef ARCHIVER_PROGRESS_H
+#define ARCHIVER_PROGRESS_H
+
+#include <zip.h>
+
+#include <atomic>
+#include <chrono>
+
+// Прогресс и отмена задания сессии. attach() подключает их к zip_close();
+// report() вызывается только из потока, запустившего задание. Базовый
+// класс прогресс никуда не передает - так ядро работает без JNI.
+class Progress {
+public:
+    // Как часто распаковка опрашивает пул, чтобы сообщить прогресс
+    static constexpr std::chrono::milliseconds POLL_INTERVAL{100};
+
+    explicit Progress(const std::atomic<bool>& cancelled) : cancelled(cancelled) {}
+    virtual ~Progress() = default;
+
+    Progress(const Progress&) = delete;
+    Progress& operator=(const Progress&) = delete;
+
+    // Регистрирует обработчики прогресса и отмены в архиве
+    void attach(zip_t* zip);
+
+    // Доля выполненной работы от 0 до 1
+    virtual void report(double) {}
+
+    bool is_cancelled() const { return cancelled.load(std::memory_order_relaxed); }
+
+private:
+    static void progress_callback(zip_t* zip, double progress, void* userdata);
+    static int cancel_callback(zip_t* zip, void* userdata);
+
+    const std::atomic<bool>& cancelled;
+};
+
+#endif // ARCHIVER_PROGRESS_H
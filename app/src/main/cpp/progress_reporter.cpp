@@ -0,0 +1,61 @@
+#include "progress_reporter.h"
+
+#include "archiver_log.h"
+
+ProgressReporter::ProgressReporter(JNIEnv* env, jobject callback, const std::atomic<bool>& cancelled)
+        : Progress(cancelled), env(env), callback(callback) {
+    if (!callback) {
+        return;
+    }
+
+    // Kotlin-лямбда (Float) -> Unit реализует kotlin.jvm.functions.Function1
+    jclass callback_class = env->GetObjectClass(callback);
+    invoke = env->GetMethodID(callback_class, "invoke", "(Ljava/lang/Object;)Ljava/lang/Object;");
+    env->DeleteLocalRef(callback_class);
+
+    jclass local_float = env->FindClass("java/lang/Float");
+    if (local_float) {
+        float_class = static_cast<jclass>(env->NewGlobalRef(local_float));
+        float_value_of = env->GetStaticMethodID(float_class, "valueOf", "(F)Ljava/lang/Float;");
+        env->DeleteLocalRef(local_float);
+    }
+
+    if (!invoke || !float_value_of) {
+        LOGE("Progress callback is not a (Float) -> Unit, progress disabled");
+        env->ExceptionClear();
+        invoke = nullptr;
+    }
+}
+
+ProgressReporter::~ProgressReporter() {
+    if (float_class) {
+        env->DeleteGlobalRef(float_class);
+    }
+}
+
+void ProgressReporter::report(double progress) {
+    if (!invoke) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool final = progress >= 1.0 && last_progress < 1.0;
+    if (!final) {
+        if (progress - last_progress < MIN_STEP || now - last_time < MIN_INTERVAL) {
+            return;
+        }
+    }
+    last_progress = progress;
+    last_time = now;
+
+    jobject boxed = env->CallStaticObjectMethod(float_class, float_value_of, static_cast<jfloat>(progress));
+    jobject result = env->CallObjectMethod(callback, invoke, boxed);
+    if (env->ExceptionCheck()) {
+        LOGE("Progress callback threw an exception");
+        env->ExceptionClear();
+    }
+    if (result) {
+        env->DeleteLocalRef(result);
+    }
+    env->DeleteLocalRef(boxed);
+}
@@ -0,0 +1,38 @@
+#ifndef ARCHIVER_PROGRESS_REPORTER_H
+#define ARCHIVER_PROGRESS_REPORTER_H
+
+#include <jni.h>
+
+#include <atomic>
+#include <chrono>
+
+#include "progress.h"
+
+// Передает прогресс задания в Kotlin-лямбду (Float) -> Unit. Вызовы в Java
+// прореживаются по времени и по проценту, чтобы на весь архив их было не
+// больше нескольких сотен.
+class ProgressReporter : public Progress {
+public:
+    // Минимальный шаг прогресса между вызовами Kotlin
+    static constexpr double MIN_STEP = 0.005;
+    // Минимальный интервал между вызовами Kotlin
+    static constexpr std::chrono::milliseconds MIN_INTERVAL{100};
+
+    ProgressReporter(JNIEnv* env, jobject callback, const std::atomic<bool>& cancelled);
+    ~ProgressReporter() override;
+
+    // Сообщает значение в Kotlin, если прошло достаточно времени или прогресса
+    void report(double progress) override;
+
+private:
+    JNIEnv* env;
+    jobject callback;
+    jmethodID invoke = nullptr;
+    jclass float_class = nullptr;
+    jmethodID float_value_of = nullptr;
+
+    double last_progress = -1.0;
+    std::chrono::steady_clock::time_point last_time;
+};
+
+#endif // ARCHIVER_PROGRESS_REPORTER_H
@@ -0,0 +1,180 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+void TaskGroup::add(size_t count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending += count;
+}
+
+void TaskGroup::done() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending == 0) {
+        cv.notify_all();
+    }
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return pending == 0; });
+}
+
+bool TaskGroup::wait_for(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return cv.wait_for(lock, timeout, [this] { return pending == 0; });
+}
+
+bool TaskGroup::try_start() {
+    unsigned current = running.load();
+    while (current < limit.load()) {
+        if (running.compare_exchange_weak(current, current + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ThreadPool::ThreadPool(unsigned thread_count) {
+    thread_count = std::max(1u, thread_count);
+    for (unsigned i = 0; i < thread_count; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (unsigned i = 0; i < thread_count; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+void ThreadPool::submit(std::vector<Task> tasks, TaskGroup& group) {
+    if (tasks.empty()) {
+        return;
+    }
+    group.add(tasks.size());
+
+    // LPT: самые тяжёлые задачи идут первыми, каждая попадает в наименее
+    // загруженную очередь этого пакета
+    std::stable_sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) {
+        return a.weight > b.weight;
+    });
+
+    std::lock_guard<std::mutex> submit_lock(submit_mutex);
+    std::vector<uint64_t> load(queues.size(), 0);
+    std::vector<std::vector<QueuedTask>> assigned(queues.size());
+    for (auto& task : tasks) {
+        // при равной загрузке начинаем не с нулевой очереди, чтобы мелкие
+        // пакеты разных вызовов не сваливались на один поток
+        size_t best = next_queue % queues.size();
+        for (size_t i = 0; i < queues.size(); i++) {
+            size_t q = (next_queue + i) % queues.size();
+            if (load[q] < load[best]) {
+                best = q;
+            }
+        }
+        load[best] += std::min(std::max<uint64_t>(task.weight, 1), UINT64_MAX - load[best]);
+        assigned[best].push_back(QueuedTask{std::move(task.run), &group});
+    }
+    next_queue = static_cast<unsigned>((next_queue + 1) % queues.size());
+
+    for (size_t i = 0; i < queues.size(); i++) {
+        if (assigned[i].empty()) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(queues[i]->mutex);
+        for (auto& queued_task : assigned[i]) {
+            queues[i]->tasks.push_back(std::move(queued_task));
+        }
+    }
+
+    wake_workers();
+}
+
+void ThreadPool::set_limit(TaskGroup& group, unsigned max_running) {
+    group.limit = std::max(1u, max_running);
+    wake_workers();
+}
+
+void ThreadPool::wake_workers() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        generation++;
+    }
+    sleep_cv.notify_all();
+}
+
+bool ThreadPool::pop_task(unsigned index, QueuedTask& task) {
+    // Сначала своя очередь с головы (самые крупные задачи)
+    {
+        WorkerQueue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        for (auto it = own.tasks.begin(); it != own.tasks.end(); ++it) {
+            if (it->group->try_start()) {
+                task = std::move(*it);
+                own.tasks.erase(it);
+                return true;
+            }
+        }
+    }
+
+    // Затем крадём с хвоста у соседей (самые мелкие задачи)
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkerQueue& victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        for (auto it = victim.tasks.rbegin(); it != victim.tasks.rend(); ++it) {
+            if (it->group->try_start()) {
+                task = std::move(*it);
+                victim.tasks.erase(std::next(it).base());
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned index) {
+    QueuedTask task;
+
+    while (true) {
+        uint64_t seen;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        if (pop_task(index, task)) {
+            try {
+                task.run();
+            } catch (...) {
+                // задачи сами сообщают о своих ошибках, пул должен выжить
+            }
+            TaskGroup* group = task.group;
+            task = QueuedTask{};
+            group->finish();
+            // освободилось место в группе, её следующая задача может стартовать
+            wake_workers();
+            group->done();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [this, seen] { return stopping || generation != seen; });
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef ARCHIVER_THREAD_POOL_H
+#define ARCHIVER_THREAD_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Задача для пула: функция и её "вес" (обычно размер файла в байтах),
+// по которому пул упорядочивает работу
+struct Task {
+    std::function<void()> run;
+    uint64_t weight = 0;
+};
+
+// Счётчик незавершённых задач, на котором можно ждать окончания пакета.
+// Ограничение limit задаёт, сколько задач группы пул выполняет
+// одновременно: так несколько архивов делят ядра поровну.
+class TaskGroup {
+public:
+    void add(size_t count);
+    void done();
+    void wait();
+    // Ждет не дольше timeout; true, если все задачи завершены
+    bool wait_for(std::chrono::milliseconds timeout);
+
+private:
+    friend class ThreadPool;
+
+    bool try_start();
+    void finish() { running--; }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t pending = 0;
+
+    std::atomic<unsigned> limit{UINT_MAX};
+    std::atomic<unsigned> running{0};
+};
+
+// Пул потоков фиксированного размера с очередью на каждый поток и
+// перехватом работы (work stealing). Пакет задач раскладывается по
+// очередям в порядке убывания веса (LPT), поэтому большие файлы стартуют
+// первыми, а мелкие добирают простаивающие потоки в конце. Задачи группы,
+// исчерпавшей свой лимит, пропускаются в пользу задач других групп.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Общий пул по числу ядер, живёт между вызовами createZip
+    static ThreadPool& instance();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // Ставит пакет задач в очередь; group.done() вызывается после каждой
+    void submit(std::vector<Task> tasks, TaskGroup& group);
+
+    // Сколько задач группы может выполняться одновременно (минимум одна)
+    void set_limit(TaskGroup& group, unsigned max_running);
+
+private:
+    struct QueuedTask {
+        std::function<void()> run;
+        TaskGroup* group;
+    };
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<QueuedTask> tasks;
+    };
+
+    void worker_loop(unsigned index);
+    bool pop_task(unsigned index, QueuedTask& task);
+    void wake_workers();
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    uint64_t generation = 0; // меняется, когда может появиться доступная задача
+    bool stopping = false;
+
+    std::mutex submit_mutex;
+    unsigned next_queue = 0;
+};
+
+#endif // ARCHIVER_THREAD_POOL_H
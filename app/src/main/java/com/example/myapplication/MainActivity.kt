@@ -5,6 +5,8 @@ import android.content.Context
 import android.content.Intent
 import android.net.Uri
 import android.os.Bundle
+import android.os.ParcelFileDescriptor
+import android.provider.DocumentsContract
 import android.provider.OpenableColumns
 import android.util.Log
 import android.widget.Toast
@@ -52,9 +54,96 @@ import kotlinx.coroutines.withContext
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
 import java.io.File
-import java.io.FileOutputStream
-import java.io.InputStream
-import java.io.OutputStream
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.util.concurrent.atomic.AtomicBoolean
+
+// Статистика последнего задания сессии, поля в порядке getSessionStats;
+// filesUnchanged и filesRemoved заполняет только updateZip, filesCached -
+// файлы, сжатые данные которых взяты из кэша блобов, filesDeduplicated -
+// файлы с тем же содержимым, что у другого файла архива, сжатые один раз
+data class SessionStats(
+    val filesAdded: Long,
+    val filesStreamed: Long,
+    val filesFailed: Long,
+    val bytesBuffered: Long,
+    val filesUnchanged: Long,
+    val filesRemoved: Long,
+    val filesCached: Long,
+    val filesDeduplicated: Long
+) {
+    companion object {
+        fun fromArray(values: LongArray) =
+            SessionStats(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7])
+    }
+}
+
+// Подробная статистика последнего задания сессии из getJobStats: стадии
+// конвейера и записи архива. Формат - массив Long в порядке байт
+// платформы, см. JobStats::serialize в job_stats.h
+data class JobStats(
+    val stages: Map<String, StageStats>,
+    val queueHighWater: Long,
+    val entries: List<EntryStats>
+) {
+    data class StageStats(val nanos: Long, val bytes: Long, val calls: Long) {
+        val megabytesPerSecond: Double
+            get() = if (nanos > 0) bytes * 1000.0 / nanos else 0.0
+    }
+
+    data class EntryStats(
+        val index: Long,
+        val size: Long,
+        val compressedSize: Long,
+        val method: Int,
+        val nanos: Long
+    ) {
+        val ratio: Double
+            get() = if (size > 0) compressedSize.toDouble() / size else 1.0
+        val megabytesPerSecond: Double
+            get() = if (nanos > 0) size * 1000.0 / nanos else 0.0
+    }
+
+    override fun toString(): String = buildString {
+        append("очередь до ").append(queueHighWater)
+        stages.forEach { (name, stage) ->
+            if (stage.calls > 0) {
+                append(String.format(" | %s %.1f мс, %d Б, %d выз.", name, stage.nanos / 1e6, stage.bytes, stage.calls))
+            }
+        }
+        append(" | записей ").append(entries.size)
+    }
+
+    companion object {
+        private const val FORMAT_VERSION = 1L
+
+        // Порядок совпадает с enum class Stage в job_stats.h
+        val STAGES = listOf(
+            "job", "read", "queue_wait", "add", "close", "stream_read", "write", "plan", "extract", "cache", "dedupe", "walk", "compress"
+        )
+
+        fun parse(buffer: ByteBuffer, size: Int): JobStats? {
+            val values = buffer.duplicate().order(ByteOrder.nativeOrder())
+            values.limit(size)
+            values.rewind()
+            if (values.remaining() < 4 * 8 || values.long != FORMAT_VERSION) {
+                return null
+            }
+            val stageCount = values.long.toInt()
+            val entryCount = values.long.toInt()
+            val queueHighWater = values.long
+            val stages = LinkedHashMap<String, StageStats>()
+            repeat(stageCount) { index ->
+                val stage = StageStats(values.long, values.long, values.long)
+                stages[STAGES.getOrElse(index) { "stage$index" }] = stage
+            }
+            val entries = List(entryCount) {
+                EntryStats(values.long, values.long, values.long, values.long.toInt(), values.long)
+            }
+            return JobStats(stages, queueHighWater, entries)
+        }
+    }
+}
 
 class MainViewModel : ViewModel() {
     private val _progress = MutableStateFlow(0f)
@@ -66,25 +155,78 @@ class MainViewModel : ViewModel() {
     private val _totalFiles = MutableStateFlow(0)
     val totalFiles: StateFlow<Int> = _totalFiles
 
+    // Нативные сессии выполняющихся заданий, по одной на задание. Под этим
+    // же замком cancel() вызывает cancelZip, а задание убирает свою сессию
+    // и вызывает destroySession, так что отмена не попадет в удаленную сессию
+    private val sessions = mutableSetOf<Long>()
+
+    private inline fun <T> withSession(activity: MainActivity, block: (Long) -> T): T {
+        val handle = activity.createSession()
+        synchronized(sessions) { sessions.add(handle) }
+        try {
+            return block(handle)
+        } finally {
+            synchronized(sessions) {
+                sessions.remove(handle)
+                activity.destroySession(handle)
+            }
+        }
+    }
+
     @SuppressLint("NewApi")
     suspend fun compressFiles(
         uris: List<Uri>,
         activity: MainActivity,
-        outputZipPath: String
+        outputUri: Uri
     ): Boolean = withContext(Dispatchers.IO) {
         try {
             Log.d("Archiver", "Начало сжатия файлов")
             _totalFiles.value = uris.size
             _currentFileIndex.value = 0
 
-            val filePaths = uris.mapIndexed { index, uri ->
-                _currentFileIndex.value = index + 1
-                _progress.value = (index + 1).toFloat() / uris.size
-                getFilePathFromUri(activity, uri)
-            }.toTypedArray()
+            // Файлы не копируются в cacheDir: нативный код читает их
+            // напрямую из дескрипторов и сам их закрывает
+            val stagingStart = System.nanoTime()
+            val names = Array(uris.size) { "" }
+            val fds = IntArray(uris.size) { -1 }
+            try {
+                uris.forEachIndexed { index, uri ->
+                    _currentFileIndex.value = index + 1
+                    val descriptor = activity.contentResolver.openFileDescriptor(uri, "r")
+                        ?: throw IllegalArgumentException("Не удалось открыть Uri: $uri")
+                    names[index] = getDisplayName(activity, uri)
+                    fds[index] = descriptor.detachFd()
+                }
+            } catch (e: Exception) {
+                fds.filter { it >= 0 }.forEach { ParcelFileDescriptor.adoptFd(it).close() }
+                throw e
+            }
+
+            // Архив пишется сразу в выбранный документ, без временного
+            // файла в cacheDir; дескриптор тоже закрывает нативный код
+            val outputFd = try {
+                activity.contentResolver.openFileDescriptor(outputUri, "wt")?.detachFd()
+                    ?: throw IllegalArgumentException("Не удалось открыть Uri: $outputUri")
+            } catch (e: Exception) {
+                fds.forEach { ParcelFileDescriptor.adoptFd(it).close() }
+                throw e
+            }
 
-            return@withContext activity.createZip(filePaths, outputZipPath) { progress ->
-                _progress.value = progress
+            val stagingNanos = System.nanoTime() - stagingStart
+
+            // Каждое задание - своя сессия, поэтому несколько архивов
+            // могут создаваться одновременно
+            withSession(activity) { handle ->
+                // Прогресс приходит из нативного кода во время записи архива
+                val result = activity.createZipFromFds(handle, fds, names, outputFd) { progress ->
+                    _progress.value = progress
+                }
+                activity.getSessionStats(handle)?.let { values ->
+                    Log.d("Archiver", "Статистика: ${SessionStats.fromArray(values)}")
+                }
+                Log.d("Archiver", String.format("Открытие файлов: %.1f мс", stagingNanos / 1e6))
+                logJobStats(activity, handle)
+                result
             }
         } catch (e: Exception) {
             Log.e("Archiver", "Ошибка: ${e.message}", e)
@@ -92,28 +234,86 @@ class MainViewModel : ViewModel() {
         }
     }
 
-    private fun getFilePathFromUri(context: Context, uri: Uri): String {
-        val contentResolver = context.contentResolver
-        val cursor = contentResolver.query(uri, null, null, null, null)
-        cursor?.use {
+    // Распаковывает архив uri в outputDir; архив читается нативным кодом
+    // напрямую из дескриптора, записи распаковываются параллельно
+    suspend fun extractArchive(
+        uri: Uri,
+        activity: MainActivity,
+        outputDir: File
+    ): Boolean = withContext(Dispatchers.IO) {
+        try {
+            Log.d("Archiver", "Начало распаковки в ${outputDir.path}")
+            _totalFiles.value = 0
+            _currentFileIndex.value = 0
+
+            val archiveFd = activity.contentResolver.openFileDescriptor(uri, "r")?.detachFd()
+                ?: throw IllegalArgumentException("Не удалось открыть Uri: $uri")
+
+            withSession(activity) { handle ->
+                val result = activity.extractZip(handle, archiveFd, outputDir.path) { progress ->
+                    _progress.value = progress
+                }
+                activity.getSessionStats(handle)?.let { values ->
+                    Log.d("Archiver", "Статистика: ${SessionStats.fromArray(values)}")
+                }
+                logJobStats(activity, handle)
+                result
+            }
+        } catch (e: Exception) {
+            Log.e("Archiver", "Ошибка: ${e.message}", e)
+            false
+        }
+    }
+
+    // Direct-буфер для getJobStats переиспользуется между заданиями и
+    // растет, если записей больше, чем в него помещается
+    private var jobStatsBuffer: ByteBuffer = ByteBuffer.allocateDirect(64 * 1024)
+
+    @Synchronized
+    private fun readJobStats(activity: MainActivity, handle: Long): JobStats? {
+        var size = activity.getJobStats(handle, jobStatsBuffer)
+        if (size > jobStatsBuffer.capacity()) {
+            jobStatsBuffer = ByteBuffer.allocateDirect(size)
+            size = activity.getJobStats(handle, jobStatsBuffer)
+        }
+        if (size < 0 || size > jobStatsBuffer.capacity()) {
+            return null
+        }
+        return JobStats.parse(jobStatsBuffer, size)
+    }
+
+    private fun logJobStats(activity: MainActivity, handle: Long) {
+        val stats = readJobStats(activity, handle) ?: return
+        Log.d("Archiver", "Стадии: $stats")
+        stats.entries.forEach { entry ->
+            Log.v(
+                "Archiver",
+                String.format(
+                    "Запись %d: %d -> %d Б (%.2f), метод %d, %.1f МБ/с",
+                    entry.index, entry.size, entry.compressedSize, entry.ratio, entry.method,
+                    entry.megabytesPerSecond
+                )
+            )
+        }
+    }
+
+    private fun getDisplayName(context: Context, uri: Uri): String {
+        context.contentResolver.query(uri, null, null, null, null)?.use {
             if (it.moveToFirst()) {
                 val displayNameIndex = it.getColumnIndex(OpenableColumns.DISPLAY_NAME)
-                val displayName = if (displayNameIndex != -1) {
-                    it.getString(displayNameIndex)
-                } else {
-                    uri.lastPathSegment ?: "unknown_file"
+                if (displayNameIndex != -1) {
+                    return it.getString(displayNameIndex)
                 }
-
-                val file = File(context.cacheDir, displayName)
-                val inputStream = contentResolver.openInputStream(uri)
-                val outputStream = FileOutputStream(file)
-                inputStream?.copyTo(outputStream)
-                inputStream?.close()
-                outputStream.close()
-                return file.absolutePath
             }
         }
-        throw IllegalArgumentException("Не удалось получить путь из Uri: $uri")
+        return uri.lastPathSegment ?: "unknown_file"
+    }
+
+    // Отменяет все выполняющиеся задания
+    fun cancel(activity: MainActivity) {
+        synchronized(sessions) {
+            sessions.forEach { activity.cancelZip(it) }
+        }
     }
 
     fun resetProgress() {
@@ -126,6 +326,13 @@ class MainViewModel : ViewModel() {
 class MainActivity : ComponentActivity() {
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
+        // Сжатые данные файлов переживают задания: повторная архивация тех же
+        // файлов в другой архив не сжимает их заново. Кэш настраивается один
+        // раз на процесс: onCreate повторяется при повороте экрана, пока
+        // задание, начатое прежней Activity, еще пишет архив.
+        if (blobCacheConfigured.compareAndSet(false, true)) {
+            configureBlobCache(File(cacheDir, "blobs").path, BLOB_CACHE_BYTES)
+        }
         setContent {
             AndroidArchiverTheme {
                 Surface(
@@ -138,13 +345,81 @@ class MainActivity : ComponentActivity() {
         }
     }
 
+    // Нативная сессия архивации; после использования освобождается destroySession
+    external fun createSession(): Long
+
+    external fun destroySession(session: Long)
+
     external fun createZip(
+        session: Long,
         filePaths: Array<String>,
         outputZipPath: String,
         progressCallback: (Float) -> Unit
     ): Boolean
 
+    // То же по дескрипторам из ParcelFileDescriptor.detachFd(), архив пишется
+    // в outputFd; все дескрипторы закрывает сам
+    external fun createZipFromFds(
+        session: Long,
+        fds: IntArray,
+        names: Array<String>,
+        outputFd: Int,
+        progressCallback: (Float) -> Unit
+    ): Boolean
+
+    // Архивирует дерево каталогов directory с путями от него; каталоги,
+    // в том числе пустые, становятся отдельными записями. Файлы начинают
+    // сжиматься, пока дерево еще обходится.
+    external fun createZipFromDirectory(
+        session: Long,
+        directory: String,
+        outputZipPath: String,
+        progressCallback: (Float) -> Unit
+    ): Boolean
+
+    // Обновляет архив archivePath из filePaths (создает, если его нет):
+    // файлы с прежними размером и mtime (и CRC при checkCrc) не пересжимаются,
+    // сжатые данные их записей переносятся как есть. removeMissing удаляет
+    // записи файлов, которых больше нет среди filePaths.
+    external fun updateZip(
+        session: Long,
+        filePaths: Array<String>,
+        archivePath: String,
+        checkCrc: Boolean,
+        removeMissing: Boolean,
+        progressCallback: (Float) -> Unit
+    ): Boolean
+
+    // Распаковывает архив из archiveFd (ParcelFileDescriptor.detachFd()) в
+    // каталог outputDir; дескриптор закрывает сам
+    external fun extractZip(
+        session: Long,
+        archiveFd: Int,
+        outputDir: String,
+        progressCallback: (Float) -> Unit
+    ): Boolean
+
+    // Прерывает текущий createZip или extractZip сессии, он вернет false
+    external fun cancelZip(session: Long)
+
+    // Ограничивает объем данных файлов, которые сессия держит в памяти
+    external fun setMemoryBudget(session: Long, bytes: Long)
+
+    external fun getSessionStats(session: Long): LongArray?
+
+    // Включает общий кэш сжатых данных в каталоге directory с пределом
+    // maxBytes; 0 выключает его
+    external fun configureBlobCache(directory: String, maxBytes: Long)
+
+    // Пишет JobStats последнего задания в direct-буфер и возвращает размер
+    // данных; если буфер мал, ничего не пишет и возвращает нужный размер
+    external fun getJobStats(session: Long, buffer: ByteBuffer): Int
+
     companion object {
+        // Предел кэша сжатых данных; Android сам чистит cacheDir при нехватке места
+        private const val BLOB_CACHE_BYTES = 256L * 1024 * 1024
+        private val blobCacheConfigured = AtomicBoolean(false)
+
         init {
             System.loadLibrary("myapplication")
         }
@@ -158,7 +433,6 @@ fun HomeScreen() {
     var selectedFiles by rememberSaveable { mutableStateOf(listOf<Uri>()) }
     var errorMessage by rememberSaveable { mutableStateOf("") }
     var isArchiveReady by rememberSaveable { mutableStateOf(false) }
-    var tempZipPath by rememberSaveable { mutableStateOf("") }
     val coroutineScope = rememberCoroutineScope()
     val viewModel = remember { MainViewModel() }
     val progress by viewModel.progress.collectAsState()
@@ -178,38 +452,64 @@ fun HomeScreen() {
         }
     }
 
+    // Сначала выбирается место сохранения, затем архив пишется прямо туда
+    // Архив распаковывается в каталог приложения extracted/<имя архива>
+    val extractArchiveLauncher = rememberLauncherForActivityResult(
+        contract = ActivityResultContracts.OpenDocument(),
+        onResult = { uri ->
+            if (uri != null) {
+                coroutineScope.launch {
+                    val name = getFileName(context, uri).removeSuffix(".zip")
+                    val outputDir = File(context.getExternalFilesDir(null), "extracted/$name")
+                    val result = viewModel.extractArchive(uri, activity, outputDir)
+                    if (result) {
+                        errorMessage = ""
+                        Toast.makeText(
+                            context,
+                            "Архив распакован в ${outputDir.path}",
+                            Toast.LENGTH_LONG
+                        ).show()
+                    } else {
+                        viewModel.resetProgress()
+                        outputDir.deleteRecursively()
+                        errorMessage = "Ошибка при распаковке архива"
+                    }
+                }
+            }
+        }
+    )
+
     val saveArchiveLauncher = rememberLauncherForActivityResult(
         contract = ActivityResultContracts.CreateDocument("application/zip"),
         onResult = { uri ->
             if (uri != null) {
                 coroutineScope.launch {
                     try {
-                        val tempFile = File(tempZipPath)
-                        if (tempFile.exists()) {
-                            val inputStream: InputStream = tempFile.inputStream()
-                            val outputStream: OutputStream? = context.contentResolver.openOutputStream(uri)
-
-                            outputStream?.let {
-                                inputStream.copyTo(it)
-                                inputStream.close()
-                                it.close()
-                                tempFile.delete()
-
-                                Toast.makeText(
-                                    context,
-                                    "Архив успешно сохранён",
-                                    Toast.LENGTH_LONG
-                                ).show()
-
-                                tryOpenFolderWithArchive(context, uri)
-                            } ?: run {
-                                errorMessage = "Не удалось сохранить архив"
-                            }
+                        val result = viewModel.compressFiles(
+                            selectedFiles,
+                            activity,
+                            uri
+                        )
+
+                        if (result) {
+                            isArchiveReady = true
+                            errorMessage = ""
+
+                            Toast.makeText(
+                                context,
+                                "Архив успешно сохранён",
+                                Toast.LENGTH_LONG
+                            ).show()
+
+                            tryOpenFolderWithArchive(context, uri)
                         } else {
-                            errorMessage = "Временный файл архива не найден"
+                            viewModel.resetProgress()
+                            deleteDocument(context, uri)
+                            errorMessage = "Ошибка при создании архива"
                         }
                     } catch (e: Exception) {
-                        errorMessage = "Ошибка при сохранении: ${e.message}"
+                        deleteDocument(context, uri)
+                        errorMessage = "Ошибка: ${e.message ?: "неизвестная ошибка"}"
                     }
                 }
             }
@@ -222,27 +522,7 @@ fun HomeScreen() {
             return
         }
 
-        coroutineScope.launch {
-            try {
-                val tempDir = context.cacheDir
-                tempZipPath = File(tempDir, "temp_archive_${System.currentTimeMillis()}.zip").absolutePath
-
-                val result = viewModel.compressFiles(
-                    selectedFiles,
-                    activity,
-                    tempZipPath
-                )
-
-                if (result) {
-                    isArchiveReady = true
-                    errorMessage = ""
-                } else {
-                    errorMessage = "Ошибка при создании архива"
-                }
-            } catch (e: Exception) {
-                errorMessage = "Ошибка: ${e.message ?: "неизвестная ошибка"}"
-            }
-        }
+        saveArchiveLauncher.launch("archive_${System.currentTimeMillis()}.zip")
     }
 
     Column(
@@ -300,8 +580,10 @@ fun HomeScreen() {
                     .padding(vertical = 16.dp),
                 horizontalAlignment = Alignment.CenterHorizontally
             ) {
-                Text(text = "Обработка файла $currentFileIndex из $totalFiles")
-                Spacer(modifier = Modifier.height(8.dp))
+                if (totalFiles > 0) {
+                    Text(text = "Обработка файла $currentFileIndex из $totalFiles")
+                    Spacer(modifier = Modifier.height(8.dp))
+                }
                 LinearProgressIndicator(
                     progress = { progress },
                     modifier = Modifier.fillMaxWidth()
@@ -315,7 +597,7 @@ fun HomeScreen() {
 
         if (isArchiveReady) {
             Text(
-                text = "Архив готов к сохранению!",
+                text = "Архив сохранён",
                 color = MaterialTheme.colorScheme.primary,
                 modifier = Modifier.padding(vertical = 8.dp)
             )
@@ -329,13 +611,22 @@ fun HomeScreen() {
             Text(text = if (isArchiveReady) "Пересоздать архив" else "Создать архив")
         }
 
-        if (isArchiveReady) {
+        Spacer(modifier = Modifier.height(8.dp))
+        Button(
+            onClick = { extractArchiveLauncher.launch(arrayOf("application/zip")) },
+            modifier = Modifier.fillMaxWidth(),
+            enabled = !(progress > 0f && progress < 1f)
+        ) {
+            Text(text = "Распаковать архив")
+        }
+
+        if (progress > 0f && progress < 1f) {
             Spacer(modifier = Modifier.height(8.dp))
             Button(
-                onClick = { saveArchiveLauncher.launch("archive_${System.currentTimeMillis()}.zip") },
+                onClick = { viewModel.cancel(activity) },
                 modifier = Modifier.fillMaxWidth()
             ) {
-                Text(text = "Сохранить архив")
+                Text(text = "Отменить")
             }
         }
 
@@ -349,6 +640,15 @@ fun HomeScreen() {
     }
 }
 
+// Убирает недописанный архив после ошибки или отмены
+private fun deleteDocument(context: Context, uri: Uri) {
+    try {
+        DocumentsContract.deleteDocument(context.contentResolver, uri)
+    } catch (e: Exception) {
+        Log.e("Archiver", "Не удалось удалить ${uri}: ${e.message}")
+    }
+}
+
 private fun tryOpenFolderWithArchive(context: Context, archiveUri: Uri) {
     try {
         val docFile = DocumentFile.fromSingleUri(context, archiveUri)